@@ -0,0 +1,112 @@
+/**
+ * smbbench.c
+ *
+ * A microbenchmark of the fan-out of smbbroker, which is compiled together with
+ * the broker so that it measures the code of the broker itself
+ *
+ * The benchmark is called without arguments. For every subscriber count of
+ * subscriber_counts, it subscribes that many subscribers to a topic and
+ * measures how long unpacking the destinations of a message from the packed
+ * subscriber arrays into a batch of sendmmsg message headers takes, see
+ * unpack_destinations(). No message is sent.
+ */
+
+// the broker is included as a whole, under a different name for its main
+#define main smbbroker_main
+#include "smbbroker.c"
+#undef main
+
+#define BENCH_DESTINATIONS 50000000L
+
+const int subscriber_counts[] = {10, 1000, 100000};
+
+/**
+ * Returns the current time of the monotonic clock in nanoseconds
+ */
+long long get_time_ns() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Subscribes distinct addresses to the provided topic until it has the
+ * provided number of subscribers
+ *
+ * Returns 0 if all subscriptions were stored, otherwise returns 1
+ */
+int fill_topic(const char *topic, int count) {
+  struct sockaddr_in address;
+  int topic_id, i;
+
+  memset((void *)&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  for (i = 0; (topic_id = find_topic_id(topic)) == empty_topic_id ||
+              topic_subs_map[topic_id].sub_count < count;
+       i++) {
+    // 10.0.0.0/8 leaves room for every subscriber to have its own address
+    address.sin_addr.s_addr = htonl(0x0a000000 + i);
+    address.sin_port = htons(1024 + i % 60000);
+    if (subscribe_topic(topic, NULL, false, &address) != 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main() {
+  char *arguments[] = {"smbbench", "-T", "2", "-S", "100000", "-N", "100000",
+                       "-Q", "1", "-L", "error", "-f", "none", NULL};
+  const char *message = "benchmark message";
+  topic_subs *topic_struct;
+  delivery d;
+  worker *self;
+  long long start, elapsed;
+  long iterations, i;
+  int count, c;
+
+  if (parse_arguments(sizeof(arguments) / sizeof(arguments[0]) - 1,
+                      arguments) != 0 ||
+      allocate_tables() != 0) {
+    return 1;
+  }
+  self = &workers[0];
+  if (allocate_worker_arena(self) != 0) {
+    return 1;
+  }
+
+  d.topic = "bench";
+  d.message = message;
+  d.iovs[0].iov_len = 0;
+  d.iovs[1].iov_base = (void *)message;
+  d.iovs[1].iov_len = strlen(message);
+  d.shared[0] = NULL;
+  d.shared[1] = NULL;
+
+  for (c = 0; c < (int)(sizeof(subscriber_counts) / sizeof(int)); c++) {
+    if (fill_topic("bench", subscriber_counts[c]) != 0) {
+      fprintf(stderr, "Could not subscribe %d subscribers\n",
+              subscriber_counts[c]);
+      return 1;
+    }
+
+    topic_struct = &topic_subs_map[find_topic_id("bench")];
+
+    // every run unpacks about the same number of destinations in total
+    iterations = BENCH_DESTINATIONS / subscriber_counts[c];
+    count = 0;
+    start = get_time_ns();
+    for (i = 0; i < iterations; i++) {
+      count += unpack_destinations(&d, topic_struct, NULL, self);
+    }
+    elapsed = get_time_ns() - start;
+
+    printf("%6d subscribers: %10.1f ns per fan-out, %6.2f ns per "
+           "destination\n",
+           subscriber_counts[c], (double)elapsed / iterations,
+           (double)elapsed / count);
+  }
+
+  return 0;
+}
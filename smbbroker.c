@@ -4,7 +4,14 @@
  * A message broker program that is compatible with the message publisher
  * program smbpublisher and the message subscriber program smbpublisher
  *
- * Does not require any arguments
+ * Optionally accepts settings as program call arguments and in a configuration
+ * file, see print_usage() for the available settings. Settings given as
+ * program call arguments take precedence over the configuration file.
+ *
+ * The configuration file contains one setting per line in the format
+ * name = value
+ * where name is the long name of the corresponding program call argument.
+ * Empty lines and lines starting with '#' are ignored.
  *
  * Runs in an infinite loop, accepting message publishes from any client
  * Published message will be immediately forwarded to any subscribers that are
@@ -12,510 +19,7587 @@
  *
  * Allows for subscribers to subscribe to the '#' topic, which will result in
  * the broker forwarding messages of any topic to such subscribers
+ *
+ * A subscription may carry a filter expression, in which case only messages
+ * that match the filter are forwarded to the subscriber
+ *
+ * Subscribers may also join a named group on a topic instead of subscribing to
+ * it, in which case each message of the topic is only forwarded to a single
+ * member of the group, chosen by the configured group policy
+ *
+ * Requests are processed by one or more worker threads, each of which receives
+ * requests on its own socket. The sockets share the listening address through
+ * SO_REUSEPORT, so that the kernel distributes requests across the workers.
+ * Workers publish messages from immutable snapshots of the subscribers of
+ * topics without holding the lock that protects the tables, as long as the
+ * delivery of a message depends on nothing else.
+ *
+ * Workers either wait for requests with poll and receive and send them in
+ * batches with recvmmsg and sendmmsg, or, if the io_uring backend is selected
+ * and supported by the kernel, receive requests with a multishot recvmsg into
+ * a ring of provided buffers and submit the messages of a fan-out as a batch
+ * of sendmsg operations.
+ *
+ * Optionally, publish requests that arrive on one queue of a network interface
+ * are received through an AF_XDP socket by an additional worker, which sends
+ * the messages to subscribers on the same link as raw frames on that socket.
+ * All other requests and messages take the regular sockets.
+ *
+ * Brokers can be joined into a cluster by configuring each of them with the
+ * addresses of all others as peers. Every broker periodically announces a
+ * summary of the topics that it has subscribers for to its peers, and forwards
+ * publishes that it receives from clients to the peers that are interested in
+ * their topic. Forwarded publishes are never forwarded again, which prevents
+ * loops in the full mesh of peers.
+ *
+ * Requests can be rate limited per client address and publishes per topic,
+ * requests that exceed the limits are discarded before they are parsed. The
+ * number of subscriptions per client address can be limited as well, and
+ * subscribers can be required to prove that they receive messages at their
+ * address by returning a cookie before they are subscribed.
+ *
+ * Subscribers on the same host may receive their messages through a shared
+ * memory ring instead of datagrams, which the broker writes into without a
+ * system call per message (see smbring.h).
+ *
+ * Clients on the same host can also send their requests to a Unix domain
+ * datagram socket, which an additional worker receives from. Subscribers that
+ * subscribe through it receive their messages through it as well.
+ *
+ * Sending SIGUSR1 to the broker logs its request and message counters, the
+ * number of requests dropped by the kernel due to a full receive buffer, and
+ * the egress queue state and drop counters of all subscribers
  */
 
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <linux/bpf.h>
+#include <linux/if_xdp.h>
+#include <linux/io_uring.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
 #include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "smbconstants.h"
+#include "smbring.h"
 
-#define SUB_ADDRESSES_LENGTH 10
-#define TOPIC_SUBS_MAP_LENGTH 10
 #define INDEX_WILDCARD_TOPIC 0
 #define LOG_BUFFER_SIZE 1024
+#define MESSAGE_BUFFER_SIZE 512
+#define CONFIG_LINE_LENGTH 256
+// size of the path of a Unix domain socket address
+#define UNIX_PATH_LENGTH 108
+#define MESSAGE_CACHE_SIZE 32
+// the header of a delivery frame holds the topic, the sequence number and the
+// receive timestamp of a message
+#define DELIVERY_HEADER_SIZE (TOPIC_LENGTH + 64)
+// a received request comes with the kernel drop count and, if the kernel
+// coalesced several datagrams into it (UDP GRO), their segment size
+#define RECEIVE_CONTROL_SIZE                                                   \
+  (CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int)))
+// a provided receive buffer holds the recvmsg header, the client address and
+// the control messages in front of the request
+#define RECEIVE_RING_HEADER_SIZE                                               \
+  (sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) +          \
+   RECEIVE_CONTROL_SIZE)
+// coalesced datagrams fill up to 64 KiB, and up to 64 queued messages are sent
+// as a single buffer that the kernel segments (UDP GSO)
+#define GRO_BUFFER_SIZE 65536
+#define GSO_MAX_SEGMENTS 64
+// large fan-outs are split into chunks on this many lanes, the pool holds a
+// few chunks per lane
+#define FANOUT_LANES 64
+#define FANOUT_CHUNKS_PER_LANE 4
+// the UMEM of the AF_XDP socket is split into frames, the first half of which
+// is used for receiving and the second half for sending
+#define XDP_FRAME_SIZE 2048
+#define XDP_FRAME_COUNT 4096
+#define XDP_RING_SIZE (XDP_FRAME_COUNT / 2)
+#define XDP_HEADERS_LENGTH                                                     \
+  (sizeof(struct ether_header) + sizeof(struct iphdr) + sizeof(struct udphdr))
+// interest summaries are bitmaps of topic hashes, which are announced every
+// second and considered stale once they have not been renewed for a while
+#define MAX_PEERS 32
+#define INTEREST_BITS 1024
+#define INTEREST_WORDS (INTEREST_BITS / 64)
+#define ANNOUNCE_INTERVAL_MS 1000
+#define PEER_TIMEOUT_MS 3500
+// rate limit buckets are looked up among a few slots of a fixed size table
+#define RATE_BUCKET_BITS 12
+#define RATE_BUCKET_COUNT (1 << RATE_BUCKET_BITS)
+#define RATE_PROBE_LENGTH 8
+// subscriptions are counted per client address in a fixed number of counters,
+// addresses that share a counter share the limit
+#define SOURCE_COUNTER_BITS 12
+#define SOURCE_COUNTER_COUNT (1 << SOURCE_COUNTER_BITS)
+// cookies remain valid for one to two periods
+#define COOKIE_PERIOD_MS 30000
 
 const char *empty_topic = "";
 const in_addr_t empty_address = INADDR_NONE;
-const char *log_file_name = "smbbroker.log";
+const int empty_topic_id = -1;
+const int empty_subscriber_id = -1;
+const int empty_filter_id = -1;
+const int empty_group_id = -1;
+const char *log_file_disabled = "none";
 
-char log_buffer[LOG_BUFFER_SIZE];
+_Thread_local char log_buffer[LOG_BUFFER_SIZE];
 FILE *log_file;
 
-typedef struct topic_subs_struct {
-  char topic[TOPIC_LENGTH];
-  struct sockaddr_in sub_addresses[SUB_ADDRESSES_LENGTH];
-} topic_subs;
+/**
+ * Levels of log entries, entries above the configured level are discarded
+ */
+typedef enum log_level_enum {
+  LOG_LEVEL_ERROR,
+  LOG_LEVEL_WARNING,
+  LOG_LEVEL_INFO,
+  // also logs every received request and sent message
+  LOG_LEVEL_DEBUG
+} log_level;
+
+const char *log_level_names[] = {"error", "warning", "info", "debug"};
 
 /**
- * A map where each entry maps a single topic to multiple subscriber addresses
+ * Settings of the listening address, logging, table capacities and batching
+ *
+ * A total subscriber capacity of 0 allows every topic to be fully subscribed
+ * by distinct subscribers
  */
-topic_subs topic_subs_map[TOPIC_SUBS_MAP_LENGTH];
+char listen_address[INET_ADDRSTRLEN] = "0.0.0.0";
+int listen_port;
+char *log_file_name = "smbbroker.log";
+log_level max_log_level = LOG_LEVEL_DEBUG;
+int topic_subs_map_length = 10;
+int sub_addresses_length = 10;
+int subscribers_length = 0;
+int filters_length = 64;
+int groups_length = 16;
+int egress_queue_length = 8;
+int receive_batch_size = 32;
+int send_batch_size = 64;
+int worker_count = 1;
+// fan-outs to more destinations are split into chunks if there are several
+// workers, 0 keeps all fan-outs on the receiving worker
+int fanout_chunk_size = 1024;
+cpu_set_t cpu_affinity;
+bool cpu_affinity_set = false;
+bool incoming_cpu = false;
+bool udp_offload = false;
+// size of the buffers that requests are received into, which hold several
+// coalesced requests with UDP offloads
+int request_buffer_size = MESSAGE_BUFFER_SIZE;
 
 /**
- * Writes the provided string to the log file, preceeded by the current date and
- * time
+ * Settings of the admission of subscribers, a subscription limit of 0 and a
+ * memory limit of 0 are unlimited
  */
-void write_to_log(const char *log_str) {
-  time_t current_time = time(NULL);
-  struct tm *time_struct = localtime(&current_time);
-  fprintf(log_file, "[%d-%02d-%02d %02d:%02d:%02d] %s\n",
-          time_struct->tm_year + 1900, time_struct->tm_mon + 1,
-          time_struct->tm_mday, time_struct->tm_hour, time_struct->tm_min,
-          time_struct->tm_sec, log_str);
-  fflush(log_file);
-}
+int source_subscription_limit = 0;
+int max_table_memory = 0;
+bool verify_subscribers = false;
+bool shared_memory = false;
 
 /**
- * Prints the provided string to the provided stream and also the log file.
- * Automatically appends a newline character when printing to the provided
- * stream.
+ * Backends for receiving requests and sending messages
  */
-void fprintln_and_log(FILE *stream, const char *str) {
-  fprintf(stream, "%s\n", str);
-  write_to_log(str);
-}
+typedef enum io_backend_enum {
+  // poll with recvmmsg and sendmmsg
+  IO_BACKEND_POLL,
+  // multishot recvmsg and batched sendmsg submissions, falls back to poll if
+  // the kernel does not support them
+  IO_BACKEND_IO_URING
+} io_backend;
+
+const char *io_backend_names[] = {"poll", "io_uring"};
+
+io_backend selected_io_backend = IO_BACKEND_POLL;
 
 /**
- * Determines whether the two provided address structures are identical based
- * on their IP address and port.
- *
- * Returns true if the addresses are identical, otherwise returns false
+ * Network interface and queue of the AF_XDP fast path, which is disabled if the
+ * interface name is empty
  */
-bool is_same_address(const struct sockaddr_in *addr1,
-                     const struct sockaddr_in *addr2) {
-  return addr1->sin_addr.s_addr == addr2->sin_addr.s_addr &&
-         addr1->sin_port == addr2->sin_port;
-}
+char xdp_interface[IF_NAMESIZE] = "";
+int xdp_queue = 0;
 
 /**
- * Sets the provided address structure to be recognizably empty
+ * Path of the Unix domain socket that local clients can send requests to, the
+ * socket is disabled if the path is empty
  */
-void set_addr_empty(struct sockaddr_in *addr) {
-  memset((void *)addr, 0, sizeof(*addr));
-  // explicitly set s_addr to an "empty" value that can be compared against
-  // later
-  addr->sin_addr.s_addr = empty_address;
-}
+char unix_socket_path[UNIX_PATH_LENGTH] = "";
 
 /**
- * If the provided topic structure has no subscribers, reset it so that the
- * entry is free to be used for a new topic.
- *
- * If the topic still has a subscribers, do nothing.
+ * Number of buckets of the topic index, which is derived from the topic
+ * capacity
  */
-void remove_unused_topic(topic_subs *topic_struct) {
-  int i;
+int topic_index_length;
 
-  // check if there is still an address subscribed to this topic
-  for (i = 0; i < SUB_ADDRESSES_LENGTH; i++) {
-    if (topic_struct->sub_addresses[i].sin_addr.s_addr != empty_address) {
-      // subscriber found, exit without changing anything
-      return;
-    }
-  }
+/**
+ * Policies for handling a message that is to be forwarded to a subscriber whose
+ * egress queue is already full
+ */
+typedef enum egress_policy_enum {
+  // discard the oldest queued message to make space for the new one
+  EGRESS_DROP_OLDEST,
+  // discard the new message
+  EGRESS_DROP_NEWEST,
+  // discard the new message and unsubscribe the subscriber from all topics
+  // once it has accumulated too many dropped messages
+  EGRESS_DISCONNECT
+} egress_policy;
 
-  snprintf(log_buffer, LOG_BUFFER_SIZE,
-           "Last subscriber was unsubscribed from topic '%s', removing topic",
-           topic_struct->topic);
-  fprintln_and_log(stderr, log_buffer);
-  strcpy(topic_struct->topic, empty_topic);
-}
+const char *egress_policy_names[] = {"drop-oldest", "drop-newest",
+                                     "disconnect"};
+
+egress_policy overflow_policy = EGRESS_DROP_OLDEST;
+unsigned long disconnect_drops = 100;
 
 /**
- * Attempts to find an appropriate topic subs instance for the provided topic in
- * the topic subs list
- *
- * Returns a pointer to the found instance or NULL if none could be found
+ * Policies for choosing the member of a subscriber group that a message is sent
+ * to
  */
-topic_subs *find_topic_sub(const char *topic) {
-  int i;
+typedef enum group_policy_enum {
+  // members take turns in a fixed order
+  GROUP_ROUND_ROBIN,
+  // the member that was sent a message least recently, new members first
+  GROUP_LEAST_RECENT,
+  // the member that the key of the message hashes to, so that messages with the
+  // same key are sent to the same member as long as the group is unchanged
+  GROUP_HASH
+} group_policy;
 
-  // attempt to find corresponding topic subs instance in list
-  for (i = 0; i < TOPIC_SUBS_MAP_LENGTH; i++) {
-    if (strncmp(topic_subs_map[i].topic, topic, sizeof(topic)) == 0) {
-      // instance found, return pointer
-      return &topic_subs_map[i];
-    }
-  }
+const char *group_policy_names[] = {"round-robin", "least-recent", "hash"};
 
-  return NULL;
-}
+group_policy selected_group_policy = GROUP_ROUND_ROBIN;
 
 /**
- * Attempts to find the provided topic in the topic subs list
- *
- * If it is found, a pointer to the corresponding topic subs object is returned
- * If it is not found, a new corresponding topic subs object will be set up in
- * the list and a pointer for that object will be returned
- * If a new object cannot be set up because the list is full, NULL is returned
+ * Field of a message whose value is the key for the hash group policy,
+ * followed by '=', the whole message is the key if this is empty or the message
+ * does not contain the field
  */
-topic_subs *find_or_insert_topic_sub(const char *topic) {
-  topic_subs *found_topic_struct;
-  int i;
+char group_key[FILTER_LENGTH + 1] = "";
+int group_key_length = 0;
 
-  // attempt to find corresponding topic subs instance in list
-  if ((found_topic_struct = find_topic_sub(topic)) != NULL) {
-    return found_topic_struct;
-  }
+/**
+ * Socket settings, a value of 0 keeps the default of the kernel
+ */
+int receive_buffer_size = 0;
+int send_buffer_size = 0;
+int busy_poll_usecs = 0;
+int type_of_service = 0;
 
-  // could not find suitable instance, so configure an unused one for the new
+/**
+ * Another broker of the cluster, together with the summary of its interest and
+ * the batch of publishes that are to be forwarded to it
+ */
+typedef struct peer_struct {
+  struct sockaddr_in address;
+  // the peer wants all messages because it has subscribers of the wildcard
   // topic
-  for (i = 0; i < TOPIC_SUBS_MAP_LENGTH; i++) {
-    if (strlen(topic_subs_map[i].topic) == 0) {
-      strcpy(topic_subs_map[i].topic, topic);
-      return &topic_subs_map[i];
-    }
-  }
+  bool wants_all;
+  // bits of the hashes of the topics that the peer has subscribers for
+  uint64_t interest[INTEREST_WORDS];
+  // time of the last announcement of the peer, 0 if it never announced
+  long long announced_ms;
+  // forward request that is assembled from the publishes of a request batch
+  char batch[MESSAGE_BUFFER_SIZE];
+  int batch_length;
+  unsigned long forwarded_count;
+} peer;
 
-  // no unused instance remaining for the new topic
-  snprintf(log_buffer, LOG_BUFFER_SIZE,
-           "No more free slots to register new topic '%s'", topic);
-  fprintln_and_log(stderr, log_buffer);
-  return NULL;
-}
+peer peers[MAX_PEERS];
+int peer_count = 0;
+
+/**
+ * Set whenever a subscription is added or removed, so that the interest summary
+ * is announced to the peers right away instead of with the next periodic
+ * announcement
+ */
+bool interest_changed;
+
+/**
+ * A token bucket of a rate limit, which is refilled lazily whenever it is
+ * consulted
+ */
+typedef struct rate_bucket_struct {
+  // client key or topic hash, 0 if the bucket is unused
+  uint32_t key;
+  uint32_t refilled_ms;
+  float tokens;
+} rate_bucket;
 
 /**
- * Sends the provided message to the provided address
+ * A rate limit with its table of buckets, which is disabled if the rate is 0
  *
- * Returns 0 if message was sent without issues, otherwise returns 1 on error.
+ * The table is not resized, a bucket that is not found among the probed slots
+ * replaces the bucket that has been refilled least recently. Such a bucket has
+ * usually been refilled to its burst already, so that replacing it makes no
+ * difference.
  */
-int send_message(const char *message, struct sockaddr_in dest_addr,
-                 int sock_fd) {
-  socklen_t dest_size;
-  int length, nbytes;
+typedef struct rate_limit_struct {
+  // tokens per second and maximum number of tokens of a bucket
+  int rate;
+  int burst;
+  rate_bucket *buckets;
+} rate_limit;
 
-  dest_size = sizeof(dest_addr);
+rate_limit client_limit;
+rate_limit topic_limit;
 
-  length = strlen(message);
-  nbytes = sendto(sock_fd, message, length, 0, (struct sockaddr *)&dest_addr,
-                  dest_size);
-  if (nbytes != length) {
-    snprintf(log_buffer, LOG_BUFFER_SIZE,
-             "Failed to send message '%s' to host %s:%d", message,
-             inet_ntoa(dest_addr.sin_addr), ntohs(dest_addr.sin_port));
-    fprintln_and_log(stderr, log_buffer);
-    perror("sendto");
-    return 1;
-  }
+/**
+ * Number of subscriptions and group memberships per client address, indexed by
+ * the hash of the client key, see get_client_key()
+ */
+int source_subscription_counts[SOURCE_COUNTER_COUNT];
 
-  snprintf(log_buffer, LOG_BUFFER_SIZE, "Sent message '%s' to host %s:%d",
-           message, inet_ntoa(dest_addr.sin_addr), ntohs(dest_addr.sin_port));
-  fprintln_and_log(stderr, log_buffer);
-  return 0;
-}
+/**
+ * Number of interned topics including the wildcard topic, so that requests for
+ * new topics can be rejected without a search once the topic table is full
+ */
+int interned_topic_count;
 
 /**
- * Validates the provided topic string
+ * Random key of the cookies that subscribers have to return
+ */
+uint64_t cookie_key[2];
+
+/**
+ * Counters that are logged together with the subscriber statistics
  *
- * Returns 0 if topic is valid, otherwise returns 1
+ * The kernel drop count is reported by the kernel with every received request
+ * and contains the number of requests that were dropped because the socket
+ * receive buffer was full. The request and message counts are updated
+ * atomically, since workers also publish without holding the broker lock.
  */
-int validate_topic(const char *topic, bool wildcardAllowed) {
-  // assert that topic is not an empty string, since that is reserved as an
-  // identifier for empty topics
-  if (strlen(topic) == 0) {
-    fprintln_and_log(stderr, "Topic is not allowed to be an empty string");
-    return 1;
-  }
+unsigned long received_request_count;
+unsigned long sent_message_count;
+// messages sent in chunks of large fan-outs, which is updated atomically as
+// chunks are sent without holding the broker lock
+unsigned long chunk_sent_message_count;
+unsigned long dropped_message_count;
+unsigned long limited_request_count;
 
-  // assert that topic is not too long to store
-  if (strlen(topic) >= TOPIC_LENGTH) {
-    snprintf(log_buffer, LOG_BUFFER_SIZE, "Topic '%s' exceeds max length of %u",
-             topic, TOPIC_LENGTH);
-    fprintln_and_log(stderr, log_buffer);
-    return 1;
-  }
+/**
+ * Cleared once the kernel rejects a segmented send, e.g. because a device
+ * cannot checksum segments, so that queued messages are sent one at a time
+ */
+bool segmented_sends = true;
 
-  // assert that topic does not contain the message delimiter character
-  if (strchr(topic, msg_delim) != NULL) {
-    snprintf(
-        log_buffer, LOG_BUFFER_SIZE,
-        "Topic '%s' is not allowed to contain message delimiter character '%c'",
-        topic, msg_delim);
-    fprintln_and_log(stderr, log_buffer);
-    return 1;
-  }
+/**
+ * How messages reach a subscriber from the AF_XDP fast path
+ */
+typedef enum xdp_route_enum {
+  // not determined yet, or the MAC address of the subscriber is not yet known
+  XDP_ROUTE_UNKNOWN,
+  // the subscriber is a neighbor on the link of the fast path
+  XDP_ROUTE_NEIGHBOR,
+  // the subscriber is not on that link, messages take the regular socket
+  XDP_ROUTE_KERNEL
+} xdp_route;
 
-  // assert that topic does not contain the wildcard character
-  if (!wildcardAllowed && strchr(topic, topic_wildcard) != NULL) {
-    snprintf(log_buffer, LOG_BUFFER_SIZE,
-             "Topic '%s' is not allowed to contain wildcard character '%c'",
-             topic, topic_wildcard);
-    fprintln_and_log(stderr, log_buffer);
-    return 1;
-  }
+/**
+ * A pooled buffer of a message that is queued for at least one subscriber.
+ *
+ * A message is copied into a buffer at most once, all egress queues that it is
+ * appended to hold a reference to the same buffer. The reference count is
+ * protected by the broker lock, the buffer returns to the pool once the last
+ * reference is released.
+ */
+typedef struct message_buffer_struct {
+  int refcount;
+  int length;
+  struct message_buffer_struct *next_free;
+  char data[DELIVERY_HEADER_SIZE + MESSAGE_BUFFER_SIZE];
+} message_buffer;
 
-  return 0;
-}
+/**
+ * A published message on its way to the subscribers. Subscribers that requested
+ * delivery frames receive it preceded by a header with its topic, sequence
+ * number and receive timestamp, all others receive the bare message.
+ *
+ * The header is formatted once, when the first subscriber that requested frames
+ * is encountered, and shared by all of them. The message is likewise copied
+ * into at most one pooled buffer per format, which is shared by all egress
+ * queues that it is appended to.
+ */
+typedef struct delivery_struct {
+  const char *topic;
+  const char *message;
+  // sequence number of the message, which is also sent in its frames
+  unsigned long sequence;
+  // the header followed by the message, bare messages only use the second
+  // entry, the header is empty until it has been formatted
+  struct iovec iovs[2];
+  char header[DELIVERY_HEADER_SIZE];
+  // buffers of the bare and of the framed message
+  message_buffer *shared[2];
+} delivery;
 
 /**
- * Handles a publish request
+ * Free list of the message buffer pool, which is allocated at startup and large
+ * enough to fill all egress queues with distinct messages
  *
- * Forwards received message to all subscribers of the specified topic and
- * all subscribers of the wildcard topic
+ * Each thread keeps a cache of free buffers that it refills from and returns to
+ * the shared free list in batches, so that buffers are mostly reused by the
+ * thread that released them while they are still in its CPU cache.
+ */
+message_buffer *message_pool;
+_Thread_local message_buffer *message_cache;
+_Thread_local int message_cache_count;
+
+/**
+ * A shared memory ring that the messages to a subscriber on the same host are
+ * written into
  *
- * Returns 0 if published message could be forwarded without issues, otherwise
- * returns 1 on errors
+ * The capacity and the write position are kept outside of the shared memory,
+ * so that a subscriber cannot make the broker write outside of the ring.
  */
-int handle_publish(char *request, int sock_fd) {
-  char *topic, *message;
-  topic_subs *found_topic;
-  int i;
+typedef struct ring_writer_struct {
+  ring_header *header;
+  size_t size;
+  uint32_t capacity;
+  uint64_t head;
+  // shared memory object of the ring, which no other subscriber may attach
+  dev_t device;
+  ino_t inode;
+} ring_writer;
 
-  // isolate request components
-  // first jump over method, get the topic as the next token
-  // and then use the remaining substring as message contents
-  strtok(request, "!");
-  topic = strtok(NULL, "!");
-  message = strtok(NULL, "");
+/**
+ * A subscriber that is subscribed to at least one topic, together with the
+ * bounded queue of messages that could not be sent to it yet because the
+ * socket send buffer was full.
+ *
+ * While the queue of a subscriber is empty, messages are sent to it directly.
+ * Otherwise new messages are appended to the queue, so that their order is
+ * preserved while the queue is drained by the main loop.
+ */
+typedef struct subscriber_struct {
+  in_addr_t address;
+  in_port_t port;
+  // number of topics the subscriber is subscribed to, the entry is unused if
+  // this is 0
+  int topic_count;
+  bool disconnect_pending;
+  unsigned long drop_count;
+  int queue_head;
+  int queue_length;
+  message_buffer **messages;
+  xdp_route route;
+  unsigned char mac[ETH_ALEN];
+  // whether messages are sent to the subscriber in delivery frames
+  bool framed;
+  // ring that messages are written into instead of being sent, or NULL
+  ring_writer *ring;
+} subscriber;
 
-  // validate topic
-  if (validate_topic(topic, false) != 0) {
-    return 1;
-  }
+subscriber *subscribers;
 
-  // validate message
-  // assert that message does not contain the message delimiter character
-  if (strchr(message, msg_delim) != NULL) {
-    snprintf(log_buffer, LOG_BUFFER_SIZE,
-             "Message is not allowed to contain message delimiter "
-             "character '%c'",
-             msg_delim);
-    fprintln_and_log(stderr, log_buffer);
-    return 1;
-  }
+/**
+ * Address of a client that sends requests through the Unix domain socket
+ *
+ * Within the broker, such a client is known by the address 0.0.0.0 and the
+ * index of its entry plus one as port, so that subscribers and the subscriber
+ * arrays of topics only hold IPv4 endpoints. Requests from 0.0.0.0 that arrive
+ * through the network are discarded, so this address cannot be spoofed.
+ *
+ * Entries are only kept for subscribers. The entries without one form a list
+ * in the order of their last use, and the least recently used one is reused
+ * for a new client.
+ */
+typedef struct unix_endpoint_struct {
+  struct sockaddr_un address;
+  // length of the address, the entry is unused if this is 0
+  socklen_t length;
+  uint32_t hash;
+  bool subscribed;
+  // neighbours in the list of entries without subscriber, -1 at its ends
+  int prev_free;
+  int next_free;
+} unix_endpoint;
 
-  // forward message to subscribers of wildcard topic
-  found_topic = &topic_subs_map[INDEX_WILDCARD_TOPIC];
-  for (i = 0; i < SUB_ADDRESSES_LENGTH; i++) {
-    if (found_topic->sub_addresses[i].sin_addr.s_addr != empty_address) {
-      send_message(message, found_topic->sub_addresses[i], sock_fd);
-    }
-  }
+unix_endpoint *unix_endpoints;
+int unix_endpoints_length;
+// ends of the list of entries without subscriber, -1 if it is empty
+int first_free_unix_endpoint = -1;
+int last_free_unix_endpoint = -1;
 
-  // try to find list of subscribers for current topic
-  found_topic = find_topic_sub(topic);
-  if (found_topic == NULL) {
-    snprintf(log_buffer, LOG_BUFFER_SIZE,
-             "Topic '%s' has no subscribers, discarding message", topic);
-    fprintln_and_log(stderr, log_buffer);
-    return 0;
-  }
+/**
+ * Open addressing hash index with linear probing that maps the addresses of
+ * Unix domain socket clients to their entries, unused buckets contain -1
+ */
+int *unix_endpoint_index;
+int unix_endpoint_index_length;
+int unix_fd = -1;
 
-  // forward message to subscribers of current topic
-  for (i = 0; i < SUB_ADDRESSES_LENGTH; i++) {
-    if (found_topic->sub_addresses[i].sin_addr.s_addr != empty_address) {
-      send_message(message, found_topic->sub_addresses[i], sock_fd);
-    }
-  }
+/**
+ * Number of subscribers with a non-empty egress queue and number of subscribers
+ * that are to be disconnected due to too many dropped messages
+ *
+ * The queued subscriber count is updated atomically, since workers check it
+ * without holding the broker lock before they publish from snapshots.
+ */
+int queued_subscriber_count;
+int disconnect_pending_count;
 
-  return 0;
-}
+/**
+ * Set by the SIGUSR1 handler to request logging of subscriber statistics, and
+ * reset atomically by the worker that logs them
+ */
+volatile sig_atomic_t stats_requested;
 
 /**
- * Handles a subscribe request
+ * Kinds of filter expressions, messages are matched as a whole by prefix and
+ * substring filters, and as a list of comma separated key=value fields by the
+ * field filters
+ */
+typedef enum filter_type_enum {
+  // prefix:TEXT
+  FILTER_PREFIX,
+  // contains:TEXT
+  FILTER_CONTAINS,
+  // KEY=VALUE
+  FILTER_EQUALS,
+  // KEY>NUMBER
+  FILTER_GREATER,
+  // KEY<NUMBER
+  FILTER_LESS
+} filter_type;
+
+/**
+ * A compiled filter expression, which is shared by all subscriptions with the
+ * same expression
  *
- * Registers subscriber address data as recipient for the specified topic
+ * The result of the filter is cached for the message that it was last
+ * evaluated for, so that a filter is only evaluated once per message regardless
+ * of how many subscribers use it.
+ */
+typedef struct filter_struct {
+  // number of subscriptions that use the filter, the entry is unused if 0
+  int refcount;
+  filter_type type;
+  char expression[FILTER_LENGTH];
+  // prefix or substring, or the key of a field filter followed by '='
+  char needle[FILTER_LENGTH + 1];
+  int needle_length;
+  // value of an equality filter
+  char value[FILTER_LENGTH];
+  int value_length;
+  // threshold of a comparison filter
+  double threshold;
+  unsigned long evaluated_message;
+  bool matched;
+} filter;
+
+filter *filters;
+
+/**
+ * Sequence number of the message that was published last, starting at 1, which
+ * is incremented atomically since messages are also published without holding
+ * the broker lock
+ */
+unsigned long message_sequence;
+
+/**
+ * An immutable copy of the destinations of a topic, from which messages are
+ * published and large fan-outs are sent without holding the broker lock
  *
- * Returns 0 if topic subscription could be stored without issues, otherwise
- * returns 1 on errors
+ * The destinations are grouped by the fan-out lane of their subscriber, so
+ * that a chunk is a range of a lane. Subscribers with a filter, a ring or an
+ * address of the Unix domain socket are only listed by their index in the
+ * arrays of the topic, since they are not sent a plain datagram.
+ * A snapshot is replaced whenever the subscribers of its topic change, and
+ * freed once neither a worker that publishes from it nor a fan-out job that
+ * was scheduled before its replacement is left.
  */
-int handle_subscribe(char *request, const struct sockaddr_in *sub_address) {
-  char *topic;
-  topic_subs *topic_struct;
-  int i;
+typedef struct topic_snapshot_struct {
+  // name and hash of the topic, which lookups without the broker lock compare
+  // since the topic may be removed in the meantime
+  char topic[TOPIC_LENGTH];
+  uint32_t hash;
+  // size of the allocation, which counts against snapshot_memory_limit
+  size_t size;
+  // destinations of lane i are entries lane_offsets[i] to lane_offsets[i + 1]
+  int lane_offsets[FANOUT_LANES + 1];
+  struct sockaddr_in *dest_addrs;
+  // subscriber of each destination
+  int *sub_ids;
+  // whether each destination receives the message in a delivery frame
+  bool *framed;
+  bool has_framed;
+  int excluded_count;
+  int *excluded;
+  // whether the snapshot holds every destination of the topic, which is the
+  // case if it excludes no subscriber and the topic has no groups
+  bool complete;
+  // value of snapshot_epoch when the snapshot was replaced
+  unsigned long retired_epoch;
+  struct topic_snapshot_struct *next_retired;
+} topic_snapshot;
 
-  // isolate topic from subscriber message
-  // first jump over method, then get the remaining substring after the first
-  // delimiter
-  strtok(request, "!");
-  topic = strtok(NULL, "");
+/**
+ * Subscribers of a topic are stored as a structure of arrays: IP addresses and
+ * ports are kept in separate packed arrays, both in network byte order.
+ * The first sub_count entries of both arrays are occupied, so forwarding a
+ * message only has to read that many addresses and ports instead of checking
+ * every slot for emptiness.
+ * A third array holds the index of each subscriber in the subscribers list,
+ * which is only needed for subscribers that have messages queued.
+ */
+typedef struct topic_subs_struct {
+  int sub_count;
+  in_addr_t *sub_addresses;
+  in_port_t *sub_ports;
+  int *sub_ids;
+  // filter of each subscription, or empty_filter_id
+  int *sub_filter_ids;
+  // first group on the topic, the others are linked through the groups
+  int first_group_id;
+  // snapshot of the subscribers, which is loaded and replaced atomically, or
+  // NULL if none could be built
+  topic_snapshot *snapshot;
+  // whether the subscribers changed since the snapshot was built
+  bool snapshot_stale;
+} topic_subs;
 
-  // validate topic
-  if (validate_topic(topic, true) != 0) {
-    return 1;
-  }
+/**
+ * A named group of subscribers on a topic, each message of the topic is sent to
+ * a single member of the group.
+ *
+ * Members are packed at the start of the member array like the subscribers of a
+ * topic. The least recent policy additionally keeps them in a list that is
+ * ordered by when they were last sent a message, and the hash policy in a
+ * lookup table that maps key hashes to members, so that choosing a member
+ * takes constant time with every policy.
+ */
+typedef struct group_struct {
+  // topic of the group, the entry is unused if this is empty_topic_id
+  int topic_id;
+  char name[GROUP_LENGTH];
+  int next_group_id;
+  int member_count;
+  int *member_ids;
+  // hash of the address of each member, which determines its lookup slots
+  uint32_t *member_hashes;
+  // index of the next member of the round robin policy
+  int next_member;
+  // list of the least recent policy, the first member was sent to least
+  // recently
+  int *lru_prev;
+  int *lru_next;
+  int lru_first;
+  int lru_last;
+  // member index of every slot of the lookup table of the hash policy
+  int *lookup;
+} group;
 
-  // get instance that stores subscribers for requested topic
-  topic_struct = find_or_insert_topic_sub(topic);
-  if (topic_struct == NULL) {
-    return 1;
-  }
+group *groups;
 
-  // check via IP address and port if subscriber is already subscribed to
-  // requested topic
-  for (i = 0; i < SUB_ADDRESSES_LENGTH; i++) {
-    if (is_same_address(&topic_struct->sub_addresses[i], sub_address)) {
-      snprintf(log_buffer, LOG_BUFFER_SIZE,
-               "Host %s:%d is already subscribed to topic '%s'",
-               inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
-               topic);
-      fprintln_and_log(stderr, log_buffer);
-      return 0;
-    }
-  }
+/**
+ * Number of slots of the lookup table of a group, which is a prime that is
+ * several times larger than the number of members per group, so that keys are
+ * spread evenly across the members
+ */
+int group_lookup_length;
 
-  // attempt to add new subscriber to list for requested topic,
-  // do so by finding an unused address entry
-  for (i = 0; i < SUB_ADDRESSES_LENGTH; i++) {
-    if (topic_struct->sub_addresses[i].sin_addr.s_addr == empty_address) {
-      // copy address data of subscribing client to unused entry in map
-      (*topic_struct).sub_addresses[i] = *sub_address;
-      snprintf(log_buffer, LOG_BUFFER_SIZE,
-               "Host %s:%d is now subscribed to topic '%s'",
-               inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
-               topic);
-      fprintln_and_log(stderr, log_buffer);
-      return 0;
-    }
-  }
+/**
+ * Position in its slot permutation of every member while a lookup table is
+ * populated
+ */
+int *group_lookup_positions;
 
-  snprintf(log_buffer, LOG_BUFFER_SIZE,
-           "No more free slots to subscribe host %s:%d to topic '%s'",
-           inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
-           topic);
-  fprintln_and_log(stderr, log_buffer);
-  return 1;
-}
+/**
+ * Symbol table that interns every known topic under a dense numeric ID, which
+ * is the index of the topic in the following arrays. Apart from request
+ * parsing, the broker only refers to topics through these IDs.
+ *
+ * Topics that have been resolved by a client are pinned, so that their ID
+ * remains valid for the lifetime of the broker.
+ */
+char (*topic_names)[TOPIC_LENGTH];
+uint32_t *topic_hashes;
+bool *topic_pinned;
 
 /**
- * Handles an unsubscribe request
+ * Open addressing hash index with linear probing that maps topic names to their
+ * IDs, unused buckets contain empty_topic_id
+ *
+ * Buckets are written atomically, since publishers also probe the index
+ * without holding the broker lock. The change counter is odd while entries are
+ * shifted back, so that such a lookup can tell whether it missed a topic that
+ * was moved past it.
+ */
+int *topic_index;
+unsigned long topic_index_changes;
+
+/**
+ * A map where each entry maps a single topic ID to multiple subscriber
+ * addresses
+ */
+topic_subs *topic_subs_map;
+
+/**
+ * An io_uring instance with its submission and completion queues mapped into
+ * the address space of the broker
+ *
+ * Prepared submissions are only made visible to the kernel once the ring is
+ * entered, the number of such submissions is kept in pending.
+ */
+typedef struct uring_struct {
+  int fd;
+  unsigned *sq_head;
+  unsigned *sq_tail;
+  unsigned sq_mask;
+  unsigned *sq_array;
+  struct io_uring_sqe *sqes;
+  unsigned pending;
+  unsigned *cq_head;
+  unsigned *cq_tail;
+  unsigned cq_mask;
+  struct io_uring_cqe *cqes;
+} uring;
+
+/**
+ * Identifiers of the operations that are submitted to the receive ring of a
+ * worker
+ */
+typedef enum uring_operation_enum {
+  URING_RECEIVE,
+  URING_WRITABLE
+} uring_operation;
+
+/**
+ * A ring that an AF_XDP socket shares with the kernel, its entries are either
+ * frame descriptors (receive and transmit rings) or UMEM addresses (fill and
+ * completion rings)
+ */
+typedef struct xsk_ring_struct {
+  uint32_t *producer;
+  uint32_t *consumer;
+  uint32_t *flags;
+  void *entries;
+  uint32_t mask;
+} xsk_ring;
+
+/**
+ * State of the AF_XDP fast path: the XDP program that redirects publish
+ * requests to the socket, the socket with its UMEM and rings, and the address
+ * of the interface that outgoing frames are sent from
+ */
+typedef struct xdp_path_struct {
+  int ifindex;
+  unsigned char mac[ETH_ALEN];
+  in_addr_t address;
+  in_addr_t netmask;
+  int map_fd;
+  int prog_fd;
+  int link_fd;
+  int xsk_fd;
+  char *umem;
+  xsk_ring rx;
+  xsk_ring tx;
+  xsk_ring fill;
+  xsk_ring completion;
+  // transmit frames that are currently not in use by the kernel
+  uint64_t *free_frames;
+  int free_frame_count;
+  // number of transmit descriptors that are not yet visible to the kernel
+  uint32_t tx_pending;
+  // frame of the message that is currently sent, which is copied for every
+  // subscriber before its destination is rewritten
+  char frame[XDP_FRAME_SIZE];
+  int frame_length;
+} xdp_path;
+
+/**
+ * A worker thread together with its socket and its arena of buffers.
+ *
+ * The arena is allocated by the worker thread itself after it has been pinned
+ * to its CPU, so that the kernel places the memory on the NUMA node of that CPU
+ * when it is first touched.
+ */
+typedef struct worker_struct {
+  int index;
+  // CPU the worker is pinned to, or -1 if it is not pinned
+  int cpu;
+  int sock_fd;
+  pthread_t thread;
+  // cumulative number of requests that the kernel dropped on the socket, as
+  // last reported with a received request, which is updated atomically
+  uint32_t kernel_drop_count;
+  // value of snapshot_epoch that the worker announced before it loaded the
+  // snapshots of a publish without holding the broker lock, 0 while it reads
+  // none
+  unsigned long snapshot_epoch;
+
+  // buffers for receiving a batch of requests with recvmmsg
+  struct sockaddr_in *client_addrs;
+  struct mmsghdr *request_msgs;
+  struct iovec *request_iovs;
+  // request_buffer_size bytes per request
+  char *buffers;
+  char (*controls)[RECEIVE_CONTROL_SIZE];
+
+  // buffers for assembling a batch of messages that are sent with sendmmsg,
+  // they are large enough for all subscribers of a topic and one member of
+  // every group
+  struct sockaddr_in *dest_addrs;
+  struct mmsghdr *dest_msgs;
+  int *dest_ids;
+
+  // io_uring state, only used if the io_uring backend is active for the worker
+  bool use_uring;
+  uring recv_ring;
+  uring send_ring;
+  struct io_uring_buf_ring *buf_ring;
+  unsigned buf_ring_mask;
+  unsigned short buf_ring_tail;
+  // RECEIVE_RING_HEADER_SIZE + request_buffer_size bytes per buffer
+  char *ring_buffers;
+  // layout of the client address and control message in a provided buffer
+  struct msghdr recv_layout;
+  bool receive_armed;
+  bool writable_armed;
+
+  // AF_XDP fast path, only set for the worker that serves it
+  xdp_path *xdp;
+
+  // client addresses of a batch received on the Unix domain socket, only set
+  // for the worker that serves it
+  struct sockaddr_un *unix_addrs;
+
+  // message headers for sending a chunk of a large fan-out, only set if large
+  // fan-outs are split
+  struct mmsghdr *chunk_msgs;
+} worker;
+
+worker *workers;
+
+/**
+ * Worker that receives publish requests through the AF_XDP fast path, it shares
+ * the socket of the first worker for everything else
+ */
+worker xdp_worker;
+
+/**
+ * Worker that receives requests through the Unix domain socket, it sends
+ * datagrams through the socket of the first worker
+ */
+worker unix_worker;
+
+/**
+ * Lock that serializes access to all topic and subscriber data, counters and
+ * the log across workers. Workers only hold it while handling a batch of
+ * received requests or draining egress queues, not while waiting for requests,
+ * and not while they publish from the snapshots of topics, see
+ * publish_unlocked(). It is released with release_broker_lock().
+ */
+pthread_mutex_t broker_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * A message whose fan-out is split into chunks, with a copy of the message and
+ * of its delivery header that outlives the request it was received in
+ *
+ * The job returns to its pool once all of its chunks have been sent.
+ */
+typedef struct fanout_job_struct {
+  // the header followed by the message, as in a delivery
+  struct iovec iovs[2];
+  char data[DELIVERY_HEADER_SIZE + MESSAGE_BUFFER_SIZE];
+  int chunk_count;
+  // snapshot that the chunks are ranges of, or NULL if they hold copies, and
+  // value of snapshot_epoch when the job was scheduled
+  const topic_snapshot *snapshot;
+  unsigned long epoch;
+  struct fanout_job_struct *next;
+} fanout_job;
+
+/**
+ * Up to fanout_chunk_size destinations of a fan-out job, which are sent by a
+ * single worker with as few sendmmsg calls as possible
+ *
+ * The destinations are either a range of the snapshot of the job, or copied
+ * into the buffers of the chunk.
+ */
+typedef struct fanout_chunk_struct {
+  fanout_job *job;
+  int count;
+  const struct sockaddr_in *dest_addrs;
+  // whether each destination receives the message in a delivery frame
+  const bool *framed;
+  struct sockaddr_in *copied_addrs;
+  bool *copied_framed;
+  struct fanout_chunk_struct *next;
+} fanout_chunk;
+
+/**
+ * A FIFO of chunks, which is sent by at most one worker at a time
+ *
+ * The destinations of a subscriber always take the lane of its index, so the
+ * messages to a subscriber leave the broker in the order in which they were
+ * published, no matter which workers send the chunks.
+ */
+typedef struct fanout_lane_struct {
+  fanout_chunk *head;
+  fanout_chunk *tail;
+  bool busy;
+  // number of chunks that were appended but not sent yet, which is updated
+  // atomically so that it can be read without the fan-out lock
+  int pending;
+} fanout_lane;
+
+/**
+ * Scheduler of large fan-outs, split into chunks that all workers take from the
+ * lanes and send through their own socket without holding the broker lock
+ *
+ * The lanes and the pools are protected by the fan-out lock, which may be
+ * taken while holding the broker lock but not the other way around. Workers
+ * that wait for requests are woken through the event file descriptor once
+ * chunks are scheduled, which is -1 if fan-outs are not split.
+ */
+fanout_lane fanout_lanes[FANOUT_LANES];
+fanout_chunk *fanout_chunk_pool;
+fanout_job *fanout_job_pool;
+fanout_job *fanout_jobs;
+int fanout_job_count;
+int next_fanout_lane;
+int fanout_event_fd = -1;
+pthread_mutex_t fanout_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t fanout_chunk_sent = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Reclamation of topic snapshots, which are read outside of the broker lock by
+ * workers that publish from them and by the chunks of fan-out jobs
+ *
+ * Every replacement of a snapshot starts a new epoch, and replaced snapshots
+ * wait in the retired list until every worker that announced an earlier epoch
+ * is done publishing and every job that was scheduled in an earlier epoch is
+ * done. The epoch is incremented atomically while holding the fan-out lock,
+ * which protects the list. Epoch 0 stands for workers that read no snapshot.
+ */
+unsigned long snapshot_epoch = 1;
+topic_snapshot *retired_snapshots;
+
+/**
+ * Topics whose snapshot is stale, which are rebuilt before the broker lock is
+ * released, see release_broker_lock()
+ */
+int *stale_topic_ids;
+int stale_topic_count;
+
+/**
+ * Memory of all current and retired snapshots, which is updated atomically as
+ * snapshots are freed without holding the broker lock, and the part of the
+ * memory limit that the tables leave to them
+ */
+size_t snapshot_memory;
+size_t snapshot_memory_limit = SIZE_MAX;
+
+/**
+ * Writes the provided string to the log file, preceeded by the current date and
+ * time
+ */
+void write_to_log(const char *log_str) {
+  time_t current_time = time(NULL);
+  struct tm *time_struct = localtime(&current_time);
+
+  // the log file is optional, the broker proceeds without it if it could not
+  // be opened
+  if (log_file == NULL) {
+    return;
+  }
+
+  fprintf(log_file, "[%d-%02d-%02d %02d:%02d:%02d] %s\n",
+          time_struct->tm_year + 1900, time_struct->tm_mon + 1,
+          time_struct->tm_mday, time_struct->tm_hour, time_struct->tm_min,
+          time_struct->tm_sec, log_str);
+  fflush(log_file);
+}
+
+/**
+ * Prints the provided string to the provided stream and also the log file.
+ * Automatically appends a newline character when printing to the provided
+ * stream.
+ */
+void fprintln_and_log(FILE *stream, const char *str) {
+  fprintf(stream, "%s\n", str);
+  write_to_log(str);
+}
+
+/**
+ * Prints the provided string to stderr and also the log file, if the provided
+ * level does not exceed the configured log level
+ */
+void log_line(log_level level, const char *str) {
+  if (level <= max_log_level) {
+    fprintln_and_log(stderr, str);
+  }
+}
+
+/**
+ * Compiles the provided filter expression into the provided filter entry
+ *
+ * Returns 0 if the expression is valid, otherwise returns 1
+ */
+int compile_filter(filter *f, const char *expression) {
+  const char *prefix = "prefix:";
+  const char *contains = "contains:";
+  const char *op, *text;
+  char *end;
+
+  memset((void *)f, 0, sizeof(*f));
+  strcpy(f->expression, expression);
+
+  if (strncmp(expression, prefix, strlen(prefix)) == 0 ||
+      strncmp(expression, contains, strlen(contains)) == 0) {
+    f->type = expression[0] == 'p' ? FILTER_PREFIX : FILTER_CONTAINS;
+    text = strchr(expression, ':') + 1;
+    strcpy(f->needle, text);
+    f->needle_length = strlen(text);
+    return f->needle_length > 0 ? 0 : 1;
+  }
+
+  // the key of a field filter must neither be empty nor span multiple fields
+  op = strpbrk(expression, "=<>");
+  if (op == NULL || op == expression ||
+      memchr(expression, ',', op - expression) != NULL) {
+    return 1;
+  }
+  f->needle_length = op - expression + 1;
+  memcpy(f->needle, expression, f->needle_length - 1);
+  f->needle[f->needle_length - 1] = '=';
+
+  if (*op == '=') {
+    f->type = FILTER_EQUALS;
+    strcpy(f->value, op + 1);
+    f->value_length = strlen(f->value);
+    return strchr(f->value, ',') != NULL ? 1 : 0;
+  }
+  f->type = *op == '>' ? FILTER_GREATER : FILTER_LESS;
+  f->threshold = strtod(op + 1, &end);
+  return end == op + 1 || *end != '\0' ? 1 : 0;
+}
+
+/**
+ * Returns the ID of the filter with the provided expression, after compiling it
+ * into a free filter entry if no subscription uses the same expression yet.
+ * The caller holds a reference to the filter.
+ *
+ * Returns empty_filter_id if the expression is invalid or there is no free
+ * filter entry
+ */
+int acquire_filter_id(const char *expression) {
+  int filter_id, free_id;
+
+  free_id = empty_filter_id;
+  for (filter_id = 0; filter_id < filters_length; filter_id++) {
+    if (filters[filter_id].refcount == 0) {
+      if (free_id == empty_filter_id) {
+        free_id = filter_id;
+      }
+    } else if (strcmp(filters[filter_id].expression, expression) == 0) {
+      filters[filter_id].refcount++;
+      return filter_id;
+    }
+  }
+
+  if (free_id == empty_filter_id) {
+    log_line(LOG_LEVEL_WARNING, "No more free slots for filters");
+    return empty_filter_id;
+  }
+  if (compile_filter(&filters[free_id], expression) != 0) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE, "Filter '%s' is invalid",
+             expression);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    filters[free_id].refcount = 0;
+    return empty_filter_id;
+  }
+  filters[free_id].refcount = 1;
+  return free_id;
+}
+
+/**
+ * Releases one reference to the filter with the provided ID, which may be
+ * empty_filter_id
+ */
+void release_filter_id(int filter_id) {
+  if (filter_id != empty_filter_id) {
+    filters[filter_id].refcount--;
+  }
+}
+
+/**
+ * Returns the value of the field in the provided message whose key is the
+ * provided needle, which consists of the key followed by '=', or NULL if the
+ * message does not contain the field
+ */
+const char *find_field(const char *message, const char *needle,
+                       int needle_length) {
+  const char *field = message;
+
+  while ((field = strstr(field, needle)) != NULL) {
+    if (field == message || field[-1] == ',') {
+      return field + needle_length;
+    }
+    field++;
+  }
+  return NULL;
+}
+
+/**
+ * Determines whether the message of the provided delivery matches the filter
+ * with the provided ID
+ */
+bool match_filter(int filter_id, const delivery *d) {
+  filter *f = &filters[filter_id];
+  const char *message = d->message;
+  int length = d->iovs[1].iov_len;
+  const char *value;
+  char *end;
+  double number;
+
+  if (f->evaluated_message == d->sequence) {
+    return f->matched;
+  }
+
+  switch (f->type) {
+  case FILTER_PREFIX:
+    f->matched = length >= f->needle_length &&
+                 memcmp(message, f->needle, f->needle_length) == 0;
+    break;
+  case FILTER_CONTAINS:
+    f->matched = memmem(message, length, f->needle, f->needle_length) != NULL;
+    break;
+  case FILTER_EQUALS:
+    value = find_field(message, f->needle, f->needle_length);
+    f->matched = value != NULL &&
+                 strncmp(value, f->value, f->value_length) == 0 &&
+                 (value[f->value_length] == ',' ||
+                  value[f->value_length] == '\0');
+    break;
+  default:
+    value = find_field(message, f->needle, f->needle_length);
+    f->matched = false;
+    if (value != NULL) {
+      number = strtod(value, &end);
+      f->matched = end != value && (f->type == FILTER_GREATER
+                                        ? number > f->threshold
+                                        : number < f->threshold);
+    }
+  }
+
+  f->evaluated_message = d->sequence;
+  return f->matched;
+}
+
+/**
+ * Attempts to find the provided address in the subscribers list, or to set up
+ * an unused entry for it
+ *
+ * Returns the index of the entry or empty_subscriber_id if the list is full
+ */
+int find_or_insert_subscriber_id(const struct sockaddr_in *sub_address) {
+  int sub_id, free_id;
+
+  free_id = empty_subscriber_id;
+  for (sub_id = 0; sub_id < subscribers_length; sub_id++) {
+    if (subscribers[sub_id].topic_count == 0) {
+      if (free_id == empty_subscriber_id) {
+        free_id = sub_id;
+      }
+    } else if (subscribers[sub_id].address == sub_address->sin_addr.s_addr &&
+               subscribers[sub_id].port == sub_address->sin_port) {
+      return sub_id;
+    }
+  }
+
+  if (free_id != empty_subscriber_id) {
+    subscribers[free_id].address = sub_address->sin_addr.s_addr;
+    subscribers[free_id].port = sub_address->sin_port;
+    subscribers[free_id].disconnect_pending = false;
+    subscribers[free_id].drop_count = 0;
+    subscribers[free_id].queue_head = 0;
+    subscribers[free_id].queue_length = 0;
+    subscribers[free_id].route = XDP_ROUTE_UNKNOWN;
+    subscribers[free_id].framed = false;
+    subscribers[free_id].ring = NULL;
+  }
+  return free_id;
+}
+
+/**
+ * Returns the entry of the Unix domain socket client that the provided address
+ * and port stand for, or NULL if they belong to an IPv4 client
+ */
+unix_endpoint *get_unix_endpoint(in_addr_t address, in_port_t port) {
+  if (address != htonl(INADDR_ANY) || port == 0 || unix_endpoints == NULL) {
+    return NULL;
+  }
+  return &unix_endpoints[ntohs(port) - 1];
+}
+
+/**
+ * Returns the key of the provided client in the per-client limits, which is its
+ * address in network byte order
+ *
+ * Clients of the Unix domain socket all share the address 0.0.0.0, so they are
+ * keyed by the number of their endpoint entry as an address in 0.0.0.0/8
+ * instead, which no IPv4 client can send from. Clients without an entry, which
+ * can only publish, share the key of 0.0.0.0.
+ */
+uint32_t get_client_key(in_addr_t address, in_port_t port) {
+  if (address == htonl(INADDR_ANY)) {
+    return htonl(ntohs(port));
+  }
+  return address;
+}
+
+/**
+ * Removes the Unix domain socket endpoint entry with the provided index from
+ * the list of entries without subscriber
+ */
+void unlink_free_unix_endpoint(int index) {
+  unix_endpoint *endpoint = &unix_endpoints[index];
+
+  if (endpoint->prev_free >= 0) {
+    unix_endpoints[endpoint->prev_free].next_free = endpoint->next_free;
+  } else {
+    first_free_unix_endpoint = endpoint->next_free;
+  }
+  if (endpoint->next_free >= 0) {
+    unix_endpoints[endpoint->next_free].prev_free = endpoint->prev_free;
+  } else {
+    last_free_unix_endpoint = endpoint->prev_free;
+  }
+  endpoint->prev_free = -1;
+  endpoint->next_free = -1;
+}
+
+/**
+ * Appends the Unix domain socket endpoint entry with the provided index to the
+ * list of entries without subscriber, as the most recently used one
+ */
+void append_free_unix_endpoint(int index) {
+  unix_endpoint *endpoint = &unix_endpoints[index];
+
+  endpoint->prev_free = last_free_unix_endpoint;
+  endpoint->next_free = -1;
+  if (last_free_unix_endpoint >= 0) {
+    unix_endpoints[last_free_unix_endpoint].next_free = index;
+  } else {
+    first_free_unix_endpoint = index;
+  }
+  last_free_unix_endpoint = index;
+}
+
+/**
+ * Determines whether the provided client address belongs to a client of the
+ * Unix domain socket
+ */
+bool is_unix_client(const struct sockaddr_in *client_addr) {
+  return client_addr->sin_addr.s_addr == htonl(INADDR_ANY);
+}
+
+/**
+ * Takes a buffer from the message buffer pool and copies the provided message
+ * into it, preceded by the provided header of the provided length which may be
+ * 0, the caller holds the only reference to the buffer
+ *
+ * Returns the buffer, or NULL if the pool is exhausted
+ */
+message_buffer *acquire_message_buffer(const char *header, int header_length,
+                                       const char *message, int length) {
+  message_buffer *buffer;
+  int i;
+
+  // refill an empty cache of this thread with half of its capacity at once
+  if (message_cache == NULL) {
+    for (i = 0; i < MESSAGE_CACHE_SIZE / 2 && message_pool != NULL; i++) {
+      buffer = message_pool;
+      message_pool = buffer->next_free;
+      buffer->next_free = message_cache;
+      message_cache = buffer;
+      message_cache_count++;
+    }
+    if (message_cache == NULL) {
+      return NULL;
+    }
+  }
+
+  buffer = message_cache;
+  message_cache = buffer->next_free;
+  message_cache_count--;
+  buffer->refcount = 1;
+  buffer->length = header_length + length;
+  memcpy(buffer->data, header, header_length);
+  memcpy(buffer->data + header_length, message, length + 1);
+  return buffer;
+}
+
+/**
+ * Releases one reference to the provided message buffer, which returns to the
+ * cache of this thread once it is no longer referenced
+ */
+void release_message_buffer(message_buffer *buffer) {
+  int i;
+
+  if (buffer == NULL || --buffer->refcount > 0) {
+    return;
+  }
+
+  buffer->next_free = message_cache;
+  message_cache = buffer;
+  message_cache_count++;
+
+  // return half of an overfull cache to the pool, so that other threads can
+  // use the buffers
+  if (message_cache_count > MESSAGE_CACHE_SIZE) {
+    for (i = 0; i < MESSAGE_CACHE_SIZE / 2; i++) {
+      buffer = message_cache;
+      message_cache = buffer->next_free;
+      message_cache_count--;
+      buffer->next_free = message_pool;
+      message_pool = buffer;
+    }
+  }
+}
+
+/**
+ * Discards all queued messages of the provided subscriber
+ */
+void clear_egress_queue(subscriber *sub) {
+  if (sub->queue_length > 0) {
+    __atomic_sub_fetch(&queued_subscriber_count, 1, __ATOMIC_RELAXED);
+  }
+  for (; sub->queue_length > 0; sub->queue_length--) {
+    release_message_buffer(sub->messages[sub->queue_head]);
+    sub->queue_head = (sub->queue_head + 1) % egress_queue_length;
+  }
+  sub->queue_head = 0;
+}
+
+/**
+ * Returns the subscription counter of the client with the provided address and
+ * port, see get_client_key()
+ */
+int *get_source_counter(in_addr_t address, in_port_t port) {
+  return &source_subscription_counts[(get_client_key(address, port) *
+                                      2654435761u) >>
+                                     (32 - SOURCE_COUNTER_BITS)];
+}
+
+/**
+ * Checks whether the provided client address has reached its subscription
+ * limit
+ *
+ * Returns 0 if the address may add another subscription, otherwise returns 1
+ */
+int check_source_limit(const struct sockaddr_in *sub_address) {
+  if (source_subscription_limit == 0 ||
+      *get_source_counter(sub_address->sin_addr.s_addr,
+                          sub_address->sin_port) <
+          source_subscription_limit) {
+    return 0;
+  }
+
+  if (is_unix_client(sub_address)) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d has reached its limit of %d subscriptions",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             source_subscription_limit);
+  } else {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s has reached its limit of %d subscriptions",
+             inet_ntoa(sub_address->sin_addr), source_subscription_limit);
+  }
+  log_line(LOG_LEVEL_WARNING, log_buffer);
+  return 1;
+}
+
+/**
+ * Adds one topic subscription to the subscriber with the provided index
+ */
+void acquire_subscriber(int sub_id) {
+  subscriber *sub = &subscribers[sub_id];
+  unix_endpoint *endpoint;
+
+  // the entry of a client of the Unix domain socket is kept while it is
+  // subscribed
+  if (sub->topic_count++ == 0 &&
+      (endpoint = get_unix_endpoint(sub->address, sub->port)) != NULL) {
+    endpoint->subscribed = true;
+    unlink_free_unix_endpoint(endpoint - unix_endpoints);
+  }
+  (*get_source_counter(sub->address, sub->port))++;
+}
+
+/**
+ * Releases one topic subscription of the subscriber with the provided index,
+ * the entry becomes unused once the subscriber has no subscriptions left
+ */
+void release_subscriber(int sub_id) {
+  subscriber *sub = &subscribers[sub_id];
+  unix_endpoint *endpoint;
+
+  (*get_source_counter(sub->address, sub->port))--;
+  if (--sub->topic_count > 0) {
+    return;
+  }
+
+  clear_egress_queue(sub);
+  if (sub->disconnect_pending) {
+    sub->disconnect_pending = false;
+    disconnect_pending_count--;
+  }
+  if (sub->ring != NULL) {
+    munmap(sub->ring->header, sub->ring->size);
+    free(sub->ring);
+    sub->ring = NULL;
+  }
+  if ((endpoint = get_unix_endpoint(sub->address, sub->port)) != NULL) {
+    endpoint->subscribed = false;
+    append_free_unix_endpoint(endpoint - unix_endpoints);
+  }
+  sub->address = empty_address;
+  sub->port = 0;
+}
+
+/**
+ * Frees the retired topic snapshots that neither a publishing worker nor a
+ * fan-out job can still read, the fan-out lock is held when called
+ */
+void reclaim_topic_snapshots() {
+  topic_snapshot **link = &retired_snapshots;
+  topic_snapshot *snapshot;
+  unsigned long oldest_epoch = ULONG_MAX;
+  unsigned long epoch;
+  int i;
+
+  if (retired_snapshots == NULL) {
+    return;
+  }
+
+  // a worker that announced an epoch may have loaded any snapshot that was
+  // not yet retired in it
+  for (i = 0; i < worker_count; i++) {
+    epoch = __atomic_load_n(&workers[i].snapshot_epoch, __ATOMIC_SEQ_CST);
+    if (epoch != 0 && epoch < oldest_epoch) {
+      oldest_epoch = epoch;
+    }
+  }
+  // jobs that are not in the pool still have chunks to send
+  for (i = 0; i < fanout_job_count; i++) {
+    if (fanout_jobs[i].chunk_count > 0 && fanout_jobs[i].snapshot != NULL &&
+        fanout_jobs[i].epoch < oldest_epoch) {
+      oldest_epoch = fanout_jobs[i].epoch;
+    }
+  }
+  while ((snapshot = *link) != NULL) {
+    if (snapshot->retired_epoch <= oldest_epoch) {
+      *link = snapshot->next_retired;
+      __atomic_sub_fetch(&snapshot_memory, snapshot->size, __ATOMIC_RELAXED);
+      free(snapshot);
+    } else {
+      link = &snapshot->next_retired;
+    }
+  }
+}
+
+/**
+ * Retires the provided snapshot, which has already been replaced in its topic,
+ * until it is no longer read
+ *
+ * The epoch is only incremented after the replacement, so that every worker
+ * that announces the new epoch loads the replacement.
+ */
+void retire_topic_snapshot(topic_snapshot *snapshot) {
+  pthread_mutex_lock(&fanout_lock);
+  snapshot->retired_epoch =
+      __atomic_add_fetch(&snapshot_epoch, 1, __ATOMIC_SEQ_CST);
+  snapshot->next_retired = retired_snapshots;
+  retired_snapshots = snapshot;
+  reclaim_topic_snapshots();
+  pthread_mutex_unlock(&fanout_lock);
+}
+
+/**
+ * Marks the snapshot of the provided topic structure as stale, so that it is
+ * replaced before the broker lock is released
+ */
+void mark_topic_snapshot_stale(topic_subs *topic_struct) {
+  if (topic_struct->snapshot_stale) {
+    return;
+  }
+  topic_struct->snapshot_stale = true;
+  stale_topic_ids[stale_topic_count++] = topic_struct - topic_subs_map;
+}
+
+/**
+ * Sets whether messages are sent to the subscriber with the provided index in
+ * delivery frames
+ *
+ * The format applies to all topics of a subscriber, so it can only change while
+ * the subscriber has no subscriptions, which also keeps it out of all
+ * snapshots. A request for the other format of a subscriber that is still
+ * subscribed is rejected instead of changing the format of its other topics.
+ *
+ * Returns 0 if messages are sent to the subscriber in the requested format,
+ * otherwise returns 1
+ */
+int set_framed(int sub_id, bool framed) {
+  subscriber *sub = &subscribers[sub_id];
+
+  if (sub->framed == framed) {
+    return 0;
+  }
+  if (sub->topic_count > 0) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d receives %s messages on its other subscriptions, "
+             "rejecting request for %s messages",
+             inet_ntoa((struct in_addr){sub->address}), ntohs(sub->port),
+             sub->framed ? "framed" : "bare", framed ? "framed" : "bare");
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+  sub->framed = framed;
+  return 0;
+}
+
+/**
+ * Searches the subscribers of the provided topic structure for the provided
+ * address, based on its IP address and port.
+ *
+ * Returns the index of the subscriber if found, otherwise returns -1
+ */
+int find_subscriber(const topic_subs *topic_struct,
+                    const struct sockaddr_in *sub_address) {
+  int i;
+
+  for (i = 0; i < topic_struct->sub_count; i++) {
+    if (topic_struct->sub_addresses[i] == sub_address->sin_addr.s_addr &&
+        topic_struct->sub_ports[i] == sub_address->sin_port) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * Removes the subscriber at the provided index from the provided topic
+ * structure.
+ *
+ * The last subscriber is moved into the freed slot, so that occupied entries
+ * remain packed at the start of the arrays
+ */
+void remove_subscriber(topic_subs *topic_struct, int index) {
+  int last;
+
+  interest_changed = true;
+  mark_topic_snapshot_stale(topic_struct);
+  release_subscriber(topic_struct->sub_ids[index]);
+  release_filter_id(topic_struct->sub_filter_ids[index]);
+
+  last = --topic_struct->sub_count;
+  topic_struct->sub_addresses[index] = topic_struct->sub_addresses[last];
+  topic_struct->sub_ports[index] = topic_struct->sub_ports[last];
+  topic_struct->sub_ids[index] = topic_struct->sub_ids[last];
+  topic_struct->sub_filter_ids[index] = topic_struct->sub_filter_ids[last];
+  topic_struct->sub_addresses[last] = empty_address;
+  topic_struct->sub_ports[last] = 0;
+  topic_struct->sub_ids[last] = empty_subscriber_id;
+  topic_struct->sub_filter_ids[last] = empty_filter_id;
+}
+
+/**
+ * Calculates the FNV-1a hash of the provided bytes
+ */
+uint32_t hash_bytes(const void *data, size_t length) {
+  const unsigned char *bytes = data;
+  uint32_t hash = 2166136261u;
+
+  while (length-- > 0) {
+    hash ^= *bytes++;
+    hash *= 16777619u;
+  }
+
+  return hash;
+}
+
+/**
+ * Calculates the FNV-1a hash of the provided topic string
+ */
+uint32_t hash_topic(const char *topic) {
+  return hash_bytes(topic, strlen(topic));
+}
+
+/**
+ * Removes the Unix domain socket endpoint entry with the provided index from
+ * the endpoint index
+ *
+ * Entries that follow the removed one in the same probe sequence are shifted
+ * back into the freed bucket, like in remove_topic_index()
+ */
+void remove_unix_endpoint_index(int index) {
+  uint32_t mask = unix_endpoint_index_length - 1;
+  uint32_t bucket, next, home;
+
+  bucket = unix_endpoints[index].hash & mask;
+  while (unix_endpoint_index[bucket] != index) {
+    bucket = (bucket + 1) & mask;
+  }
+  unix_endpoint_index[bucket] = -1;
+
+  for (next = (bucket + 1) & mask; unix_endpoint_index[next] != -1;
+       next = (next + 1) & mask) {
+    home = unix_endpoints[unix_endpoint_index[next]].hash & mask;
+    if ((next > bucket && (home <= bucket || home > next)) ||
+        (next < bucket && home <= bucket && home > next)) {
+      unix_endpoint_index[bucket] = unix_endpoint_index[next];
+      unix_endpoint_index[next] = -1;
+      bucket = next;
+    }
+  }
+}
+
+/**
+ * Attempts to find the provided Unix domain socket address in the endpoint
+ * index, or to store it in the least recently used entry that no subscriber
+ * uses
+ *
+ * Returns the index of the entry, or -1 if all entries are used by subscribers
+ */
+int find_or_insert_unix_endpoint(const struct sockaddr_un *address,
+                                 socklen_t length) {
+  uint32_t mask = unix_endpoint_index_length - 1;
+  unix_endpoint *endpoint;
+  uint32_t hash, bucket;
+  int index;
+
+  hash = hash_bytes(address, length);
+  for (bucket = hash & mask; (index = unix_endpoint_index[bucket]) != -1;
+       bucket = (bucket + 1) & mask) {
+    endpoint = &unix_endpoints[index];
+    if (endpoint->hash == hash && endpoint->length == length &&
+        memcmp(&endpoint->address, address, length) == 0) {
+      break;
+    }
+  }
+
+  if (index == -1) {
+    if ((index = first_free_unix_endpoint) == -1) {
+      return -1;
+    }
+    endpoint = &unix_endpoints[index];
+    if (endpoint->length > 0) {
+      remove_unix_endpoint_index(index);
+    }
+    memcpy(&endpoint->address, address, length);
+    endpoint->length = length;
+    endpoint->hash = hash;
+    // the bucket may have moved if the removal shifted entries back
+    for (bucket = hash & mask; unix_endpoint_index[bucket] != -1;
+         bucket = (bucket + 1) & mask) {
+    }
+    unix_endpoint_index[bucket] = index;
+  }
+
+  // the entry of a client that has just sent a request is reused last
+  if (!unix_endpoints[index].subscribed) {
+    unlink_free_unix_endpoint(index);
+    append_free_unix_endpoint(index);
+  }
+  return index;
+}
+
+/**
+ * Attempts to find the ID of the provided topic in the topic index
+ *
+ * Returns the ID of the topic or empty_topic_id if it is not known
+ */
+int find_topic_id(const char *topic) {
+  uint32_t hash, bucket;
+  int topic_id;
+
+  hash = hash_topic(topic);
+  for (bucket = hash % topic_index_length;
+       (topic_id = topic_index[bucket]) != empty_topic_id;
+       bucket = (bucket + 1) % topic_index_length) {
+    if (topic_hashes[topic_id] == hash &&
+        strncmp(topic_names[topic_id], topic, TOPIC_LENGTH) == 0) {
+      return topic_id;
+    }
+  }
+
+  return empty_topic_id;
+}
+
+/**
+ * Adds the provided topic ID to the topic index, based on the hash that is
+ * stored for it in the symbol table
+ */
+void insert_topic_index(int topic_id) {
+  uint32_t bucket;
+
+  bucket = topic_hashes[topic_id] % topic_index_length;
+  while (topic_index[bucket] != empty_topic_id) {
+    bucket = (bucket + 1) % topic_index_length;
+  }
+  __atomic_store_n(&topic_index[bucket], topic_id, __ATOMIC_RELEASE);
+}
+
+/**
+ * Removes the provided topic ID from the topic index
+ *
+ * Entries that follow the removed one in the same probe sequence are shifted
+ * back into the freed bucket, so that lookups never have to skip over deleted
+ * entries
+ */
+void remove_topic_index(int topic_id) {
+  uint32_t bucket, next, home;
+
+  __atomic_add_fetch(&topic_index_changes, 1, __ATOMIC_SEQ_CST);
+  bucket = topic_hashes[topic_id] % topic_index_length;
+  while (topic_index[bucket] != topic_id) {
+    bucket = (bucket + 1) % topic_index_length;
+  }
+  __atomic_store_n(&topic_index[bucket], empty_topic_id, __ATOMIC_SEQ_CST);
+
+  for (next = (bucket + 1) % topic_index_length;
+       topic_index[next] != empty_topic_id;
+       next = (next + 1) % topic_index_length) {
+    // an entry may only be moved back if its home bucket does not lie
+    // cyclically between the freed bucket and its current position
+    home = topic_hashes[topic_index[next]] % topic_index_length;
+    if ((next > bucket && (home <= bucket || home > next)) ||
+        (next < bucket && home <= bucket && home > next)) {
+      __atomic_store_n(&topic_index[bucket], topic_index[next],
+                       __ATOMIC_SEQ_CST);
+      __atomic_store_n(&topic_index[next], empty_topic_id, __ATOMIC_SEQ_CST);
+      bucket = next;
+    }
+  }
+  __atomic_add_fetch(&topic_index_changes, 1, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * If the topic with the provided ID has no subscribers, reset it so that the
+ * ID is free to be used for a new topic.
+ *
+ * If the ID is unused, the topic still has subscribers or groups, is pinned or
+ * is the wildcard topic, do nothing.
+ */
+void remove_unused_topic(int topic_id) {
+  // an unused ID is not in the topic index, so there is nothing to remove
+  if (strcmp(topic_names[topic_id], empty_topic) == 0) {
+    return;
+  }
+  // the wildcard topic must always remain available at its fixed ID
+  if (topic_subs_map[topic_id].sub_count > 0 ||
+      topic_subs_map[topic_id].first_group_id != empty_group_id ||
+      topic_pinned[topic_id] || topic_id == INDEX_WILDCARD_TOPIC) {
+    return;
+  }
+
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Last subscriber was unsubscribed from topic '%s', removing topic",
+           topic_names[topic_id]);
+  log_line(LOG_LEVEL_INFO, log_buffer);
+  remove_topic_index(topic_id);
+  strcpy(topic_names[topic_id], empty_topic);
+  interned_topic_count--;
+}
+
+/**
+ * Attempts to find the provided topic in the symbol table
+ *
+ * If it is found, the ID of the topic is returned
+ * If it is not found, the topic will be interned under an unused ID, which is
+ * then returned
+ * If the topic cannot be interned because the symbol table is full,
+ * empty_topic_id is returned
+ */
+int find_or_insert_topic_id(const char *topic) {
+  int topic_id;
+
+  // attempt to find topic in symbol table
+  if ((topic_id = find_topic_id(topic)) != empty_topic_id) {
+    return topic_id;
+  }
+
+  // could not find topic, so intern it under an unused ID
+  for (topic_id = 0; interned_topic_count < topic_subs_map_length &&
+                     topic_id < topic_subs_map_length;
+       topic_id++) {
+    if (strlen(topic_names[topic_id]) == 0) {
+      strcpy(topic_names[topic_id], topic);
+      topic_hashes[topic_id] = hash_topic(topic);
+      topic_pinned[topic_id] = false;
+      insert_topic_index(topic_id);
+      interned_topic_count++;
+      mark_topic_snapshot_stale(&topic_subs_map[topic_id]);
+      return topic_id;
+    }
+  }
+
+  // no unused ID remaining for the new topic
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "No more free slots to register new topic '%s'", topic);
+  log_line(LOG_LEVEL_WARNING, log_buffer);
+  return empty_topic_id;
+}
+
+/**
+ * Attempts to find the group with the provided name on the topic with the
+ * provided ID
+ *
+ * Returns the ID of the group or empty_group_id if it does not exist
+ */
+int find_group_id(int topic_id, const char *name) {
+  int group_id;
+
+  for (group_id = topic_subs_map[topic_id].first_group_id;
+       group_id != empty_group_id; group_id = groups[group_id].next_group_id) {
+    if (strncmp(groups[group_id].name, name, GROUP_LENGTH) == 0) {
+      return group_id;
+    }
+  }
+
+  return empty_group_id;
+}
+
+/**
+ * Attempts to find the group with the provided name on the topic with the
+ * provided ID, or to set up an unused entry for it
+ *
+ * Returns the ID of the group or empty_group_id if the group table is full
+ */
+int find_or_insert_group_id(int topic_id, const char *name) {
+  int group_id;
+
+  if ((group_id = find_group_id(topic_id, name)) != empty_group_id) {
+    return group_id;
+  }
+
+  for (group_id = 0; group_id < groups_length; group_id++) {
+    if (groups[group_id].topic_id == empty_topic_id) {
+      groups[group_id].topic_id = topic_id;
+      strcpy(groups[group_id].name, name);
+      groups[group_id].member_count = 0;
+      groups[group_id].next_member = 0;
+      groups[group_id].lru_first = -1;
+      groups[group_id].lru_last = -1;
+      groups[group_id].next_group_id = topic_subs_map[topic_id].first_group_id;
+      topic_subs_map[topic_id].first_group_id = group_id;
+      // messages of a topic with groups are not published from its snapshot
+      mark_topic_snapshot_stale(&topic_subs_map[topic_id]);
+      return group_id;
+    }
+  }
+
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "No more free slots to register new group '%s'", name);
+  log_line(LOG_LEVEL_WARNING, log_buffer);
+  return empty_group_id;
+}
+
+/**
+ * If the group with the provided ID has no members, removes it from its topic
+ * so that the entry is free to be used for a new group
+ */
+void remove_unused_group(int group_id) {
+  group *g = &groups[group_id];
+  int *link;
+
+  if (g->member_count > 0) {
+    return;
+  }
+
+  link = &topic_subs_map[g->topic_id].first_group_id;
+  while (*link != group_id) {
+    link = &groups[*link].next_group_id;
+  }
+  *link = g->next_group_id;
+  mark_topic_snapshot_stale(&topic_subs_map[g->topic_id]);
+  g->topic_id = empty_topic_id;
+}
+
+/**
+ * Removes the member at the provided index from the recency list of the
+ * provided group
+ */
+void unlink_group_member(group *g, int index) {
+  if (g->lru_prev[index] >= 0) {
+    g->lru_next[g->lru_prev[index]] = g->lru_next[index];
+  } else {
+    g->lru_first = g->lru_next[index];
+  }
+  if (g->lru_next[index] >= 0) {
+    g->lru_prev[g->lru_next[index]] = g->lru_prev[index];
+  } else {
+    g->lru_last = g->lru_prev[index];
+  }
+}
+
+/**
+ * Inserts the member at the provided index into the recency list of the
+ * provided group, either as the least or as the most recently sent member
+ */
+void link_group_member(group *g, int index, bool least_recent) {
+  if (least_recent) {
+    g->lru_prev[index] = -1;
+    g->lru_next[index] = g->lru_first;
+    if (g->lru_first >= 0) {
+      g->lru_prev[g->lru_first] = index;
+    } else {
+      g->lru_last = index;
+    }
+    g->lru_first = index;
+  } else {
+    g->lru_next[index] = -1;
+    g->lru_prev[index] = g->lru_last;
+    if (g->lru_last >= 0) {
+      g->lru_next[g->lru_last] = index;
+    } else {
+      g->lru_first = index;
+    }
+    g->lru_last = index;
+  }
+}
+
+/**
+ * Populates the lookup table of the provided group from its current members
+ *
+ * Every member walks its own permutation of the slots, which only depends on
+ * the hash of its address, and the members take turns in claiming the next
+ * free slot of their permutation until the table is full. A change of members
+ * therefore only moves a small share of the slots to other members.
+ */
+void rebuild_group_lookup(group *g) {
+  uint32_t offset, skip;
+  int filled, slot, i;
+
+  for (i = 0; i < group_lookup_length; i++) {
+    g->lookup[i] = -1;
+  }
+  if (g->member_count == 0) {
+    return;
+  }
+
+  for (i = 0; i < g->member_count; i++) {
+    group_lookup_positions[i] = 0;
+  }
+  for (filled = 0;;) {
+    for (i = 0; i < g->member_count; i++) {
+      // the table length is prime, so any skip between 1 and the length minus
+      // one visits every slot
+      offset = g->member_hashes[i] % group_lookup_length;
+      skip = (g->member_hashes[i] * 2654435761u >> 16) %
+                 (group_lookup_length - 1) +
+             1;
+      do {
+        slot = (offset + (uint64_t)group_lookup_positions[i]++ * skip) %
+               group_lookup_length;
+      } while (g->lookup[slot] >= 0);
+      g->lookup[slot] = i;
+      if (++filled == group_lookup_length) {
+        return;
+      }
+    }
+  }
+}
+
+/**
+ * Searches the members of the provided group for the subscriber with the
+ * provided index
+ *
+ * Returns the index of the member if found, otherwise returns -1
+ */
+int find_group_member(const group *g, int sub_id) {
+  int i;
+
+  for (i = 0; i < g->member_count; i++) {
+    if (g->member_ids[i] == sub_id) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * Adds the subscriber with the provided index to the provided group, the
+ * caller has to ensure that the group has room for another member
+ */
+void add_group_member(group *g, int sub_id) {
+  uint64_t address;
+  int index;
+
+  interest_changed = true;
+  index = g->member_count++;
+  g->member_ids[index] = sub_id;
+  address = (uint64_t)subscribers[sub_id].address << 16 |
+            subscribers[sub_id].port;
+  g->member_hashes[index] = hash_bytes(&address, sizeof(address));
+  link_group_member(g, index, true);
+  if (selected_group_policy == GROUP_HASH) {
+    rebuild_group_lookup(g);
+  }
+}
+
+/**
+ * Removes the member at the provided index from the provided group.
+ *
+ * The last member is moved into the freed slot, so that members remain packed
+ * at the start of the member array
+ */
+void remove_group_member(group *g, int index) {
+  int last;
+
+  interest_changed = true;
+  release_subscriber(g->member_ids[index]);
+  unlink_group_member(g, index);
+
+  last = --g->member_count;
+  if (index != last) {
+    g->member_ids[index] = g->member_ids[last];
+    g->member_hashes[index] = g->member_hashes[last];
+    // the moved member keeps its position in the recency list
+    g->lru_prev[index] = g->lru_prev[last];
+    g->lru_next[index] = g->lru_next[last];
+    if (g->lru_prev[index] >= 0) {
+      g->lru_next[g->lru_prev[index]] = index;
+    } else {
+      g->lru_first = index;
+    }
+    if (g->lru_next[index] >= 0) {
+      g->lru_prev[g->lru_next[index]] = index;
+    } else {
+      g->lru_last = index;
+    }
+  }
+  g->member_ids[last] = empty_subscriber_id;
+  if (selected_group_policy == GROUP_HASH) {
+    rebuild_group_lookup(g);
+  }
+}
+
+/**
+ * Chooses the member of the provided group that the provided message of the
+ * provided length is sent to, according to the configured group policy
+ *
+ * Returns the index of the subscriber in the subscribers list
+ */
+int select_group_member(group *g, const char *message, int length) {
+  const char *key;
+  int index, key_length;
+
+  switch (selected_group_policy) {
+  case GROUP_ROUND_ROBIN:
+    // members may have left since the last message
+    if (g->next_member >= g->member_count) {
+      g->next_member = 0;
+    }
+    index = g->next_member++;
+    break;
+  case GROUP_LEAST_RECENT:
+    index = g->lru_first;
+    unlink_group_member(g, index);
+    link_group_member(g, index, false);
+    break;
+  default:
+    key = NULL;
+    if (group_key_length > 0) {
+      key = find_field(message, group_key, group_key_length);
+    }
+    key_length = key != NULL ? (int)strcspn(key, ",") : length;
+    if (key == NULL) {
+      key = message;
+    }
+    index = g->lookup[hash_bytes(key, key_length) % group_lookup_length];
+    break;
+  }
+
+  return g->member_ids[index];
+}
+
+/**
+ * Creates an io_uring instance with the provided number of submission queue
+ * entries and maps its queues
+ *
+ * Returns 0 if the instance could be set up, otherwise returns 1 with errno
+ * set accordingly
+ */
+int setup_uring(uring *ring, unsigned entries) {
+  struct io_uring_params params;
+  size_t sq_size, cq_size;
+  char *sq_ptr, *cq_ptr;
+
+  memset((void *)&params, 0, sizeof(params));
+  ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+  if (ring->fd < 0) {
+    return 1;
+  }
+
+  // both queues share a single mapping on kernels that support it
+  sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  cq_size =
+      params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP) {
+    sq_size = cq_size = sq_size > cq_size ? sq_size : cq_size;
+  }
+  sq_ptr = mmap(NULL, sq_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (sq_ptr == MAP_FAILED) {
+    close(ring->fd);
+    return 1;
+  }
+  cq_ptr = sq_ptr;
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP)) {
+    cq_ptr = mmap(NULL, cq_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED) {
+      close(ring->fd);
+      return 1;
+    }
+  }
+  ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    close(ring->fd);
+    return 1;
+  }
+
+  ring->sq_head = (unsigned *)(sq_ptr + params.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq_ptr + params.sq_off.tail);
+  ring->sq_mask = *(unsigned *)(sq_ptr + params.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq_ptr + params.sq_off.array);
+  ring->pending = 0;
+  ring->cq_head = (unsigned *)(cq_ptr + params.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq_ptr + params.cq_off.tail);
+  ring->cq_mask = *(unsigned *)(cq_ptr + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+
+  return 0;
+}
+
+/**
+ * Returns a cleared submission queue entry of the provided ring, or NULL if the
+ * submission queue is full
+ */
+struct io_uring_sqe *get_uring_sqe(uring *ring) {
+  unsigned tail = *ring->sq_tail + ring->pending;
+  unsigned index;
+
+  if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >
+      ring->sq_mask) {
+    return NULL;
+  }
+  index = tail & ring->sq_mask;
+  ring->sq_array[index] = index;
+  ring->pending++;
+  memset((void *)&ring->sqes[index], 0, sizeof(ring->sqes[index]));
+  return &ring->sqes[index];
+}
+
+/**
+ * Submits all prepared entries of the provided ring and waits until at least
+ * the provided number of completions is available, with a single system call
+ *
+ * Returns 0 on success, otherwise returns 1 with errno set accordingly
+ */
+int submit_uring(uring *ring, unsigned wait_count) {
+  unsigned tail = *ring->sq_tail + ring->pending;
+
+  __atomic_store_n(ring->sq_tail, tail, __ATOMIC_RELEASE);
+  ring->pending = 0;
+  if (syscall(__NR_io_uring_enter, ring->fd,
+              tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE),
+              wait_count, wait_count > 0 ? IORING_ENTER_GETEVENTS : 0, NULL,
+              0) < 0) {
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Returns the oldest unprocessed completion of the provided ring, or NULL if
+ * there is none
+ */
+struct io_uring_cqe *peek_uring_cqe(uring *ring) {
+  unsigned head = *ring->cq_head;
+
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    return NULL;
+  }
+  return &ring->cqes[head & ring->cq_mask];
+}
+
+/**
+ * Marks the oldest unprocessed completion of the provided ring as processed
+ */
+void advance_uring_cq(uring *ring) {
+  __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Determines whether the provided send error only indicates that the socket
+ * send buffer is currently full
+ */
+bool is_send_buffer_full(int error) {
+  return error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS;
+}
+
+/**
+ * Formats the header of the delivery frames of the provided message, with the
+ * current time as its receive timestamp
+ */
+void build_delivery_header(delivery *d) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  d->iovs[0].iov_base = d->header;
+  d->iovs[0].iov_len = snprintf(
+      d->header, sizeof(d->header), "%s%s%c%lu%c%lld.%06ld%c", method_message,
+      d->topic, msg_delim, d->sequence, msg_delim, (long long)now.tv_sec,
+      now.tv_nsec / 1000, msg_delim);
+}
+
+/**
+ * Appends the provided message to the egress queue of the subscriber with the
+ * provided index
+ *
+ * The message is copied into a pooled buffer when it is queued in its format
+ * for the first time, which is stored in the delivery so that further queues
+ * can reference the same buffer. The caller has to release the buffers of the
+ * delivery once it is done with the message.
+ *
+ * If the queue is full, a message is dropped according to the configured
+ * overflow policy
+ */
+void enqueue_message(int sub_id, delivery *d) {
+  subscriber *sub = &subscribers[sub_id];
+  message_buffer **shared = &d->shared[sub->framed];
+  int tail;
+
+  if (sub->queue_length == egress_queue_length) {
+    sub->drop_count++;
+    dropped_message_count++;
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Egress queue of host %s:%d is full, dropped %s message "
+             "(%lu dropped in total)",
+             inet_ntoa((struct in_addr){sub->address}), ntohs(sub->port),
+             overflow_policy == EGRESS_DROP_OLDEST ? "oldest" : "newest",
+             sub->drop_count);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+
+    if (overflow_policy == EGRESS_DROP_OLDEST) {
+      release_message_buffer(sub->messages[sub->queue_head]);
+      sub->queue_head = (sub->queue_head + 1) % egress_queue_length;
+      sub->queue_length--;
+    } else {
+      if (overflow_policy == EGRESS_DISCONNECT && !sub->disconnect_pending &&
+          sub->drop_count >= disconnect_drops) {
+        sub->disconnect_pending = true;
+        disconnect_pending_count++;
+      }
+      return;
+    }
+  }
+
+  if (*shared == NULL) {
+    if (sub->framed && d->iovs[0].iov_len == 0) {
+      build_delivery_header(d);
+    }
+    *shared = acquire_message_buffer(
+        d->header, sub->framed ? d->iovs[0].iov_len : 0, d->message,
+        d->iovs[1].iov_len);
+    if (*shared == NULL) {
+      log_line(LOG_LEVEL_ERROR, "Message buffer pool is exhausted");
+      return;
+    }
+  }
+
+  if (sub->queue_length == 0) {
+    __atomic_add_fetch(&queued_subscriber_count, 1, __ATOMIC_RELAXED);
+  }
+  tail = (sub->queue_head + sub->queue_length) % egress_queue_length;
+  sub->messages[tail] = *shared;
+  (*shared)->refcount++;
+  sub->queue_length++;
+}
+
+/**
+ * Returns the checksum of the provided IPv4 header, whose checksum field has
+ * to be 0
+ */
+uint16_t checksum_ip_header(const struct iphdr *ip) {
+  const uint16_t *words = (const uint16_t *)ip;
+  uint32_t sum = 0;
+  size_t i;
+
+  for (i = 0; i < sizeof(*ip) / 2; i++) {
+    sum += words[i];
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return ~sum;
+}
+
+/**
+ * Assembles the frame of the provided message in the AF_XDP fast path, with
+ * the address of the interface as source and no destination yet
+ */
+void build_xdp_frame(xdp_path *xdp, const char *message, int length) {
+  struct ether_header *eth = (struct ether_header *)xdp->frame;
+  struct iphdr *ip = (struct iphdr *)(eth + 1);
+  struct udphdr *udp = (struct udphdr *)(ip + 1);
+
+  memcpy(eth->ether_shost, xdp->mac, ETH_ALEN);
+  eth->ether_type = htons(ETHERTYPE_IP);
+
+  memset((void *)ip, 0, sizeof(*ip));
+  ip->version = 4;
+  ip->ihl = sizeof(*ip) / 4;
+  ip->tos = type_of_service;
+  ip->tot_len = htons(sizeof(*ip) + sizeof(*udp) + length);
+  ip->frag_off = htons(IP_DF);
+  ip->ttl = 64;
+  ip->protocol = IPPROTO_UDP;
+  ip->saddr = xdp->address;
+
+  // the UDP checksum is optional for IPv4
+  udp->source = htons(listen_port);
+  udp->len = htons(sizeof(*udp) + length);
+  udp->check = 0;
+
+  memcpy(udp + 1, message, length);
+  xdp->frame_length = XDP_HEADERS_LENGTH + length;
+}
+
+/**
+ * Determines how the provided subscriber can be reached from the AF_XDP fast
+ * path: subscribers within the subnet of the interface are neighbors once the
+ * kernel has resolved their MAC address, all others are reached through the
+ * regular socket
+ */
+void resolve_xdp_route(subscriber *sub, worker *self) {
+  struct sockaddr_in *neighbor_addr;
+  struct arpreq request;
+
+  if ((sub->address & self->xdp->netmask) !=
+      (self->xdp->address & self->xdp->netmask)) {
+    sub->route = XDP_ROUTE_KERNEL;
+    return;
+  }
+
+  memset((void *)&request, 0, sizeof(request));
+  neighbor_addr = (struct sockaddr_in *)&request.arp_pa;
+  neighbor_addr->sin_family = AF_INET;
+  neighbor_addr->sin_addr.s_addr = sub->address;
+  memcpy(request.arp_dev, xdp_interface, sizeof(request.arp_dev));
+  if (ioctl(self->sock_fd, SIOCGARP, &request) == 0 &&
+      (request.arp_flags & ATF_COM)) {
+    memcpy(sub->mac, request.arp_ha.sa_data, ETH_ALEN);
+    sub->route = XDP_ROUTE_NEIGHBOR;
+  }
+}
+
+/**
+ * Returns the transmit frames that the kernel has finished sending to the free
+ * frames of the AF_XDP fast path
+ *
+ * Returns the number of free transmit frames
+ */
+int reclaim_xdp_frames(xdp_path *xdp) {
+  uint32_t consumer = *xdp->completion.consumer;
+  uint32_t producer =
+      __atomic_load_n(xdp->completion.producer, __ATOMIC_ACQUIRE);
+  uint64_t *addresses = (uint64_t *)xdp->completion.entries;
+
+  for (; consumer != producer; consumer++) {
+    xdp->free_frames[xdp->free_frame_count++] =
+        addresses[consumer & xdp->completion.mask];
+  }
+  __atomic_store_n(xdp->completion.consumer, consumer, __ATOMIC_RELEASE);
+  return xdp->free_frame_count;
+}
+
+/**
+ * Sends the frame of the current message to the provided subscriber through
+ * the AF_XDP fast path, by copying it into a free transmit frame and rewriting
+ * its destination
+ *
+ * The frame is only passed to the kernel once flush_xdp_frames() is called.
+ *
+ * Returns 0 if the frame was queued for transmission, otherwise returns 1 if
+ * the subscriber has to be reached through the regular socket
+ */
+int send_xdp_frame(int sub_id, worker *self) {
+  subscriber *sub = &subscribers[sub_id];
+  xdp_path *xdp = self->xdp;
+  struct xdp_desc *desc;
+  struct ether_header *eth;
+  struct udphdr *udp;
+  struct iphdr *ip;
+  uint32_t tail;
+  uint64_t addr;
+
+  if (sub->route == XDP_ROUTE_UNKNOWN) {
+    resolve_xdp_route(sub, self);
+  }
+  if (sub->route != XDP_ROUTE_NEIGHBOR) {
+    return 1;
+  }
+
+  tail = *xdp->tx.producer + xdp->tx_pending;
+  if (tail - __atomic_load_n(xdp->tx.consumer, __ATOMIC_ACQUIRE) >
+          xdp->tx.mask ||
+      (xdp->free_frame_count == 0 && reclaim_xdp_frames(xdp) == 0)) {
+    return 1;
+  }
+
+  addr = xdp->free_frames[--xdp->free_frame_count];
+  eth = (struct ether_header *)(xdp->umem + addr);
+  ip = (struct iphdr *)(eth + 1);
+  udp = (struct udphdr *)(ip + 1);
+  memcpy(eth, xdp->frame, xdp->frame_length);
+  memcpy(eth->ether_dhost, sub->mac, ETH_ALEN);
+  ip->daddr = sub->address;
+  ip->check = checksum_ip_header(ip);
+  udp->dest = sub->port;
+
+  desc = &((struct xdp_desc *)xdp->tx.entries)[tail & xdp->tx.mask];
+  desc->addr = addr;
+  desc->len = xdp->frame_length;
+  desc->options = 0;
+  xdp->tx_pending++;
+  return 0;
+}
+
+/**
+ * Passes all queued transmit frames of the AF_XDP fast path to the kernel
+ */
+void flush_xdp_frames(xdp_path *xdp) {
+  if (xdp->tx_pending == 0) {
+    return;
+  }
+
+  __atomic_store_n(xdp->tx.producer, *xdp->tx.producer + xdp->tx_pending,
+                   __ATOMIC_RELEASE);
+  xdp->tx_pending = 0;
+
+  // the kernel only has to be woken up if it is not already processing the
+  // transmit ring, a busy socket will pick up the frames on its own
+  if (__atomic_load_n(xdp->tx.flags, __ATOMIC_ACQUIRE) &
+      XDP_RING_NEED_WAKEUP) {
+    sendto(xdp->xsk_fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+  }
+}
+
+/**
+ * Sends the provided message to the destinations of the provided range of the
+ * send batch of the worker, by submitting one sendmsg operation per destination
+ * and waiting for all of them with as few system calls as possible
+ *
+ * Destinations whose message could not be sent because the socket send buffer
+ * is full receive the message through their egress queue instead, in which case
+ * buffer_full is set.
+ *
+ * Returns 0 if all messages were sent or queued without issues, otherwise
+ * returns 1
+ */
+int send_batch_uring(delivery *d, int first, int count, bool *buffer_full,
+                     worker *self) {
+  struct io_uring_sqe *sqe;
+  struct io_uring_cqe *cqe;
+  int completed, index, result, i;
+
+  // the send ring has room for a full batch, as all completions of the previous
+  // batch have been processed
+  for (i = first; i < first + count; i++) {
+    sqe = get_uring_sqe(&self->send_ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = self->sock_fd;
+    sqe->addr = (uintptr_t)&self->dest_msgs[i].msg_hdr;
+    sqe->len = 1;
+    sqe->user_data = i;
+  }
+
+  result = 0;
+  completed = 0;
+  while (completed < count) {
+    // the message must remain valid until all operations have completed, so
+    // waiting is only interrupted by failures of the ring itself
+    if (submit_uring(&self->send_ring, count - completed) != 0 &&
+        errno != EINTR) {
+      perror("io_uring_enter");
+      return 1;
+    }
+
+    while ((cqe = peek_uring_cqe(&self->send_ring)) != NULL) {
+      index = cqe->user_data;
+      if (cqe->res >= 0) {
+        __atomic_add_fetch(&sent_message_count, 1, __ATOMIC_RELAXED);
+        if (max_log_level >= LOG_LEVEL_DEBUG) {
+          snprintf(log_buffer, LOG_BUFFER_SIZE,
+                   "Sent message '%s' to host %s:%d", d->message,
+                   inet_ntoa(self->dest_addrs[index].sin_addr),
+                   ntohs(self->dest_addrs[index].sin_port));
+          log_line(LOG_LEVEL_DEBUG, log_buffer);
+        }
+      } else if (is_send_buffer_full(-cqe->res)) {
+        enqueue_message(self->dest_ids[index], d);
+        *buffer_full = true;
+      } else {
+        snprintf(log_buffer, LOG_BUFFER_SIZE,
+                 "Failed to send message '%s' to host %s:%d: %s", d->message,
+                 inet_ntoa(self->dest_addrs[index].sin_addr),
+                 ntohs(self->dest_addrs[index].sin_port),
+                 strerror(-cqe->res));
+        log_line(LOG_LEVEL_ERROR, log_buffer);
+        result = 1;
+      }
+      advance_uring_cq(&self->send_ring);
+      completed++;
+    }
+  }
+
+  return result;
+}
+
+/**
+ * Writes a record that consists of the provided header and message into the
+ * provided ring, and wakes the reader of the ring if it sleeps
+ *
+ * Returns 0 if the record could be written, otherwise returns 1 if the ring
+ * is full
+ */
+int write_ring(ring_writer *ring, const char *header, uint32_t header_length,
+               const char *message, uint32_t message_length) {
+  char *data = ring_data(ring->header);
+  uint32_t length = header_length + message_length;
+  uint64_t size = ring_record_size(length);
+  uint64_t tail, offset, wrap;
+
+  // records do not wrap around, the rest of the data area is skipped instead
+  offset = ring->head & (ring->capacity - 1);
+  wrap = offset + size > ring->capacity ? ring->capacity - offset : 0;
+  tail = __atomic_load_n(&ring->header->tail, __ATOMIC_ACQUIRE);
+  if (ring->head + wrap + size - tail > ring->capacity) {
+    return 1;
+  }
+  if (wrap > 0) {
+    *(uint32_t *)(data + offset) = RING_WRAP;
+    ring->head += wrap;
+    offset = 0;
+  }
+  memcpy(data + offset, &length, sizeof(length));
+  memcpy(data + offset + sizeof(length), header, header_length);
+  memcpy(data + offset + sizeof(length) + header_length, message,
+         message_length);
+  ring->head += size;
+
+  // the reader checks for new records after announcing that it sleeps, so
+  // publishing the record and checking whether it sleeps must not be reordered
+  __atomic_store_n(&ring->header->head, ring->head, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->header->sleeping, __ATOMIC_SEQ_CST)) {
+    __atomic_add_fetch(&ring->header->wakeup, 1, __ATOMIC_SEQ_CST);
+    ring_futex(ring->header, FUTEX_WAKE, 1, NULL);
+  }
+  return 0;
+}
+
+/**
+ * Writes the provided message into the ring of the subscriber with the
+ * provided index, in the format that the subscriber requested
+ *
+ * A message that does not fit into the ring is dropped like a message that
+ * does not fit into an egress queue, since the subscriber does not keep up
+ */
+void write_ring_message(int sub_id, delivery *d) {
+  subscriber *sub = &subscribers[sub_id];
+
+  if (sub->framed && d->iovs[0].iov_len == 0) {
+    build_delivery_header(d);
+  }
+  if (write_ring(sub->ring, d->header, sub->framed ? d->iovs[0].iov_len : 0,
+                 d->message, d->iovs[1].iov_len) != 0) {
+    sub->drop_count++;
+    dropped_message_count++;
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Ring of host %s:%d is full, dropped newest message (%lu dropped "
+             "in total)",
+             inet_ntoa((struct in_addr){sub->address}), ntohs(sub->port),
+             sub->drop_count);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    if (overflow_policy == EGRESS_DISCONNECT && !sub->disconnect_pending &&
+        sub->drop_count >= disconnect_drops) {
+      sub->disconnect_pending = true;
+      disconnect_pending_count++;
+    }
+    return;
+  }
+
+  __atomic_add_fetch(&sent_message_count, 1, __ATOMIC_RELAXED);
+  if (max_log_level >= LOG_LEVEL_DEBUG) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Sent message '%s' to host %s:%d through shared memory",
+             d->message, inet_ntoa((struct in_addr){sub->address}),
+             ntohs(sub->port));
+    log_line(LOG_LEVEL_DEBUG, log_buffer);
+  }
+}
+
+/**
+ * Sends the provided message to the subscriber with the provided index through
+ * the Unix domain socket, in the format that the subscriber requested
+ *
+ * A message that does not fit into the receive queue of the subscriber is
+ * dropped like a message that does not fit into an egress queue, a subscriber
+ * whose socket no longer exists is disconnected right away
+ */
+void send_unix_message(int sub_id, delivery *d) {
+  subscriber *sub = &subscribers[sub_id];
+  unix_endpoint *endpoint = get_unix_endpoint(sub->address, sub->port);
+  struct msghdr msg;
+
+  if (sub->framed && d->iovs[0].iov_len == 0) {
+    build_delivery_header(d);
+  }
+  memset((void *)&msg, 0, sizeof(msg));
+  msg.msg_name = &endpoint->address;
+  msg.msg_namelen = endpoint->length;
+  msg.msg_iov = sub->framed ? &d->iovs[0] : &d->iovs[1];
+  msg.msg_iovlen = sub->framed ? 2 : 1;
+  if (sendmsg(unix_fd, &msg, MSG_DONTWAIT) >= 0) {
+    __atomic_add_fetch(&sent_message_count, 1, __ATOMIC_RELAXED);
+    if (max_log_level >= LOG_LEVEL_DEBUG) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Sent message '%s' to host %s:%d through the Unix socket",
+               d->message, inet_ntoa((struct in_addr){sub->address}),
+               ntohs(sub->port));
+      log_line(LOG_LEVEL_DEBUG, log_buffer);
+    }
+    return;
+  }
+
+  sub->drop_count++;
+  dropped_message_count++;
+  if (errno == ECONNREFUSED || errno == ENOENT) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Socket of host %s:%d no longer exists, disconnecting it",
+             inet_ntoa((struct in_addr){sub->address}), ntohs(sub->port));
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    if (!sub->disconnect_pending) {
+      sub->disconnect_pending = true;
+      disconnect_pending_count++;
+    }
+    return;
+  }
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Failed to send message to host %s:%d, dropped newest message (%s, "
+           "%lu dropped in total)",
+           inet_ntoa((struct in_addr){sub->address}), ntohs(sub->port),
+           strerror(errno), sub->drop_count);
+  log_line(LOG_LEVEL_WARNING, log_buffer);
+  if (overflow_policy == EGRESS_DISCONNECT && !sub->disconnect_pending &&
+      sub->drop_count >= disconnect_drops) {
+    sub->disconnect_pending = true;
+    disconnect_pending_count++;
+  }
+}
+
+/**
+ * Returns whether chunks to the subscriber with the provided index are still
+ * pending in its lane, in which case further messages to the subscriber have
+ * to take the lane as well, so that they do not overtake them
+ */
+bool has_pending_chunks(int sub_id) {
+  return fanout_event_fd >= 0 &&
+         __atomic_load_n(&fanout_lanes[sub_id % FANOUT_LANES].pending,
+                         __ATOMIC_ACQUIRE) > 0;
+}
+
+/**
+ * Adds the subscriber with the provided index and address to the batch of
+ * destinations of the provided message, unless the message is queued for the
+ * subscriber or delivered to it through a ring, the Unix domain socket or the
+ * AF_XDP fast path instead
+ *
+ * Returns the number of destinations in the batch, which had count entries
+ */
+int add_destination(int sub_id, in_addr_t address, in_port_t port, int count,
+                    delivery *d, worker *self) {
+  subscriber *sub = &subscribers[sub_id];
+  struct msghdr *msg_hdr = &self->dest_msgs[count].msg_hdr;
+
+  if (sub->ring != NULL) {
+    write_ring_message(sub_id, d);
+    return count;
+  }
+  if (address == htonl(INADDR_ANY)) {
+    send_unix_message(sub_id, d);
+    return count;
+  }
+  if (sub->queue_length > 0) {
+    enqueue_message(sub_id, d);
+    return count;
+  }
+  // the frame of the fast path only holds the bare message, and must not
+  // overtake chunks to the subscriber
+  if (self->xdp != NULL && !sub->framed && !has_pending_chunks(sub_id) &&
+      send_xdp_frame(sub_id, self) == 0) {
+    __atomic_add_fetch(&sent_message_count, 1, __ATOMIC_RELAXED);
+    if (max_log_level >= LOG_LEVEL_DEBUG) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Sent message '%s' to host %s:%d through XDP", d->message,
+               inet_ntoa((struct in_addr){address}), ntohs(port));
+      log_line(LOG_LEVEL_DEBUG, log_buffer);
+    }
+    return count;
+  }
+  if (sub->framed && d->iovs[0].iov_len == 0) {
+    build_delivery_header(d);
+  }
+  self->dest_addrs[count].sin_family = AF_INET;
+  self->dest_addrs[count].sin_addr.s_addr = address;
+  self->dest_addrs[count].sin_port = port;
+  self->dest_ids[count] = sub_id;
+  msg_hdr->msg_iov = sub->framed ? &d->iovs[0] : &d->iovs[1];
+  msg_hdr->msg_iovlen = sub->framed ? 2 : 1;
+  return count + 1;
+}
+
+/**
+ * Sends the destinations of the provided chunk through the socket of the
+ * provided worker, waiting for the socket to become writable whenever its send
+ * buffer is full, so that the order of the lane is kept
+ *
+ * Called without holding the broker lock
+ */
+void send_fanout_chunk(const fanout_chunk *chunk, worker *self) {
+  struct mmsghdr *msgs = self->chunk_msgs;
+  struct timespec backoff = {0, 100 * 1000};
+  struct pollfd poll_fd;
+  int sent, nsent, i;
+
+  for (i = 0; i < chunk->count; i++) {
+    memset((void *)&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+    msgs[i].msg_hdr.msg_name = (void *)&chunk->dest_addrs[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(chunk->dest_addrs[i]);
+    msgs[i].msg_hdr.msg_iov =
+        chunk->framed[i] ? &chunk->job->iovs[0] : &chunk->job->iovs[1];
+    msgs[i].msg_hdr.msg_iovlen = chunk->framed[i] ? 2 : 1;
+  }
+
+  poll_fd.fd = self->sock_fd;
+  poll_fd.events = POLLOUT;
+  sent = 0;
+  while (sent < chunk->count) {
+    nsent = sendmmsg(self->sock_fd, &msgs[sent], chunk->count - sent, 0);
+    if (nsent < 0 && errno == ENOBUFS) {
+      nanosleep(&backoff, NULL);
+      continue;
+    }
+    if (nsent < 0 && is_send_buffer_full(errno)) {
+      poll(&poll_fd, 1, 10);
+      continue;
+    }
+    if (nsent <= 0) {
+      // the first message of the remaining chunk could not be sent, skip it
+      perror("sendmmsg");
+      sent++;
+      continue;
+    }
+    sent += nsent;
+    __atomic_add_fetch(&chunk_sent_message_count, nsent, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * Sends the next chunk of a lane that no other worker is sending, the fan-out
+ * lock is held when called and released while the chunk is sent
+ *
+ * Returns true if a chunk was sent, otherwise returns false if there is none
+ */
+bool send_next_fanout_chunk(worker *self) {
+  fanout_lane *lane;
+  fanout_chunk *chunk;
+  fanout_job *job;
+  int i;
+
+  // lanes are searched from a rotating start, so that all of them progress
+  for (i = 0; i < FANOUT_LANES; i++) {
+    lane = &fanout_lanes[(next_fanout_lane + i) % FANOUT_LANES];
+    if (!lane->busy && lane->head != NULL) {
+      break;
+    }
+  }
+  if (i == FANOUT_LANES) {
+    return false;
+  }
+  next_fanout_lane = (next_fanout_lane + i + 1) % FANOUT_LANES;
+
+  chunk = lane->head;
+  lane->head = chunk->next;
+  if (lane->head == NULL) {
+    lane->tail = NULL;
+  }
+  lane->busy = true;
+  pthread_mutex_unlock(&fanout_lock);
+  send_fanout_chunk(chunk, self);
+  pthread_mutex_lock(&fanout_lock);
+  lane->busy = false;
+
+  __atomic_sub_fetch(&lane->pending, 1, __ATOMIC_RELEASE);
+
+  // the job returns to its pool with its last chunk, which may free the
+  // snapshots that were retired while it was pending
+  job = chunk->job;
+  if (--job->chunk_count == 0) {
+    job->next = fanout_job_pool;
+    fanout_job_pool = job;
+    if (job->snapshot != NULL) {
+      reclaim_topic_snapshots();
+    }
+  }
+  chunk->next = fanout_chunk_pool;
+  fanout_chunk_pool = chunk;
+  pthread_cond_broadcast(&fanout_chunk_sent);
+  return true;
+}
+
+/**
+ * Sends chunks of large fan-outs until every lane is either empty or being
+ * sent by another worker
+ *
+ * Called without holding the broker lock
+ */
+void send_fanout_chunks(worker *self) {
+  pthread_mutex_lock(&fanout_lock);
+  while (send_next_fanout_chunk(self)) {
+  }
+  pthread_mutex_unlock(&fanout_lock);
+}
+
+/**
+ * Waits until the pools of the fan-out scheduler have a free chunk, the fan-out
+ * lock is held when called
+ *
+ * The caller may hold the broker lock, so the other workers may not be able to
+ * send chunks. The caller therefore sends chunks itself while the pool is
+ * empty, and only waits if all scheduled chunks are being sent by others.
+ */
+void wait_for_fanout_chunk(worker *self) {
+  while (fanout_chunk_pool == NULL || fanout_job_pool == NULL) {
+    if (!send_next_fanout_chunk(self)) {
+      pthread_cond_wait(&fanout_chunk_sent, &fanout_lock);
+    }
+  }
+}
+
+/**
+ * Appends the provided chunk to the provided lane
+ */
+void push_fanout_chunk(fanout_lane *lane, fanout_chunk *chunk) {
+  chunk->next = NULL;
+  if (lane->tail == NULL) {
+    lane->head = chunk;
+  } else {
+    lane->tail->next = chunk;
+  }
+  lane->tail = chunk;
+  __atomic_add_fetch(&lane->pending, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Takes a job for the provided message from the pool and copies the message
+ * into it, the fan-out lock is held when called
+ *
+ * The job is not returned to the pool before finish_fanout_job() is called,
+ * even if all of its chunks have been sent by then.
+ */
+fanout_job *start_fanout_job(const delivery *d, const topic_snapshot *snapshot,
+                             worker *self) {
+  fanout_job *job;
+  int header_length = d->iovs[0].iov_len;
+  int length = d->iovs[1].iov_len;
+
+  wait_for_fanout_chunk(self);
+  job = fanout_job_pool;
+  fanout_job_pool = job->next;
+  memcpy(job->data, d->header, header_length);
+  memcpy(job->data + header_length, d->message, length);
+  job->iovs[0].iov_base = job->data;
+  job->iovs[0].iov_len = header_length;
+  job->iovs[1].iov_base = job->data + header_length;
+  job->iovs[1].iov_len = length;
+  job->snapshot = snapshot;
+  // a worker that publishes without the broker lock may schedule a snapshot
+  // that has been replaced in the meantime, which the epoch that it announced
+  // still covers
+  job->epoch =
+      self->snapshot_epoch != 0 ? self->snapshot_epoch : snapshot_epoch;
+  job->chunk_count = 1;
+  return job;
+}
+
+/**
+ * Takes an empty chunk of the provided job from the pool, the fan-out lock is
+ * held when called
+ */
+fanout_chunk *take_fanout_chunk(fanout_job *job, worker *self) {
+  fanout_chunk *chunk;
+
+  wait_for_fanout_chunk(self);
+  chunk = fanout_chunk_pool;
+  fanout_chunk_pool = chunk->next;
+  chunk->job = job;
+  chunk->count = 0;
+  job->chunk_count++;
+  return chunk;
+}
+
+/**
+ * Releases the provided job once all of its chunks are appended to the lanes
+ * and wakes idle workers to send them, the fan-out lock is held when called
+ * and released before returning
+ */
+void finish_fanout_job(fanout_job *job, const delivery *d, int count,
+                       int chunk_count) {
+  uint64_t wakeup = 1;
+
+  if (--job->chunk_count == 0) {
+    job->next = fanout_job_pool;
+    fanout_job_pool = job;
+    if (job->snapshot != NULL) {
+      reclaim_topic_snapshots();
+    }
+  }
+  pthread_mutex_unlock(&fanout_lock);
+
+  if (write(fanout_event_fd, &wakeup, sizeof(wakeup)) < 0) {
+    perror("write");
+  }
+  if (max_log_level >= LOG_LEVEL_DEBUG) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Split fan-out of message '%s' to %d hosts into %d chunks",
+             d->message, count, chunk_count);
+    log_line(LOG_LEVEL_DEBUG, log_buffer);
+  }
+}
+
+/**
+ * Splits the batch of destinations that the provided worker assembled for the
+ * provided message into chunks, which are appended to the lanes of their
+ * subscribers and sent by whichever workers are free
+ *
+ * The message is copied once into a fan-out job that all chunks share, the
+ * destinations are copied into the chunks.
+ */
+void schedule_fanout(delivery *d, int count, worker *self) {
+  fanout_chunk *chunks[FANOUT_LANES] = {NULL};
+  fanout_chunk *chunk;
+  fanout_job *job;
+  int chunk_count, lane, i;
+
+  pthread_mutex_lock(&fanout_lock);
+  job = start_fanout_job(d, NULL, self);
+  chunk_count = 0;
+  for (i = 0; i < count; i++) {
+    lane = self->dest_ids[i] % FANOUT_LANES;
+    if (chunks[lane] == NULL) {
+      chunks[lane] = take_fanout_chunk(job, self);
+      chunks[lane]->dest_addrs = chunks[lane]->copied_addrs;
+      chunks[lane]->framed = chunks[lane]->copied_framed;
+      chunk_count++;
+    }
+    chunk = chunks[lane];
+    chunk->copied_addrs[chunk->count] = self->dest_addrs[i];
+    chunk->copied_framed[chunk->count] =
+        self->dest_msgs[i].msg_hdr.msg_iovlen == 2;
+    if (++chunk->count == fanout_chunk_size) {
+      push_fanout_chunk(&fanout_lanes[lane], chunk);
+      chunks[lane] = NULL;
+    }
+  }
+  for (lane = 0; lane < FANOUT_LANES; lane++) {
+    if (chunks[lane] != NULL) {
+      push_fanout_chunk(&fanout_lanes[lane], chunks[lane]);
+    }
+  }
+  finish_fanout_job(job, d, count, chunk_count);
+}
+
+/**
+ * Splits the fan-out of the provided message to the destinations of the
+ * provided snapshot into chunks, which are ranges of the lanes of the snapshot
+ *
+ * Only the message is copied into the fan-out job, so that scheduling takes
+ * constant time per chunk instead of per destination.
+ */
+void schedule_snapshot_fanout(delivery *d, const topic_snapshot *snapshot,
+                              worker *self) {
+  fanout_chunk *chunk;
+  fanout_job *job;
+  int chunk_count, lane, start, end, length;
+
+  if (snapshot->has_framed && d->iovs[0].iov_len == 0) {
+    build_delivery_header(d);
+  }
+
+  pthread_mutex_lock(&fanout_lock);
+  job = start_fanout_job(d, snapshot, self);
+  chunk_count = 0;
+  for (lane = 0; lane < FANOUT_LANES; lane++) {
+    end = snapshot->lane_offsets[lane + 1];
+    for (start = snapshot->lane_offsets[lane]; start < end; start += length) {
+      length = end - start;
+      if (length > fanout_chunk_size) {
+        length = fanout_chunk_size;
+      }
+      chunk = take_fanout_chunk(job, self);
+      chunk->dest_addrs = &snapshot->dest_addrs[start];
+      chunk->framed = &snapshot->framed[start];
+      chunk->count = length;
+      push_fanout_chunk(&fanout_lanes[lane], chunk);
+      chunk_count++;
+    }
+  }
+  finish_fanout_job(job, d, snapshot->lane_offsets[FANOUT_LANES], chunk_count);
+}
+
+/**
+ * Returns whether the subscriber at the provided index of the provided topic
+ * structure is sent plain datagrams from the snapshots of the topic
+ */
+bool is_snapshot_destination(const topic_subs *topic_struct, int index) {
+  return topic_struct->sub_filter_ids[index] == empty_filter_id &&
+         subscribers[topic_struct->sub_ids[index]].ring == NULL &&
+         topic_struct->sub_addresses[index] != htonl(INADDR_ANY);
+}
+
+/**
+ * Builds a snapshot of the current subscribers of the provided topic structure
+ *
+ * Returns the snapshot, otherwise returns NULL if it would exceed the memory
+ * limit or could not be allocated
+ */
+topic_snapshot *build_topic_snapshot(const topic_subs *topic_struct) {
+  topic_snapshot *snapshot;
+  int next[FANOUT_LANES];
+  int count = topic_struct->sub_count;
+  int lane, sub_id, i;
+  size_t size;
+
+  // the arrays follow the snapshot in the same allocation
+  size = sizeof(*snapshot) +
+         (size_t)count * (sizeof(*snapshot->dest_addrs) +
+                          sizeof(*snapshot->sub_ids) +
+                          sizeof(*snapshot->excluded) +
+                          sizeof(*snapshot->framed));
+  if (__atomic_load_n(&snapshot_memory, __ATOMIC_RELAXED) + size >
+      snapshot_memory_limit) {
+    if (max_log_level >= LOG_LEVEL_DEBUG) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Snapshot of topic '%s' would exceed the memory limit, "
+               "publishing to the topic while holding the broker lock",
+               topic_names[topic_struct - topic_subs_map]);
+      log_line(LOG_LEVEL_DEBUG, log_buffer);
+    }
+    return NULL;
+  }
+  if ((snapshot = malloc(size)) == NULL) {
+    perror("malloc");
+    return NULL;
+  }
+  __atomic_add_fetch(&snapshot_memory, size, __ATOMIC_RELAXED);
+  snapshot->size = size;
+  snapshot->dest_addrs = (struct sockaddr_in *)(snapshot + 1);
+  snapshot->sub_ids = (int *)(snapshot->dest_addrs + count);
+  snapshot->excluded = snapshot->sub_ids + count;
+  snapshot->framed = (bool *)(snapshot->excluded + count);
+  strcpy(snapshot->topic, topic_names[topic_struct - topic_subs_map]);
+  snapshot->hash = topic_hashes[topic_struct - topic_subs_map];
+  snapshot->has_framed = false;
+  snapshot->excluded_count = 0;
+
+  // count the destinations of every lane first, so that the lanes can be
+  // filled in place
+  memset(snapshot->lane_offsets, 0, sizeof(snapshot->lane_offsets));
+  for (i = 0; i < count; i++) {
+    if (is_snapshot_destination(topic_struct, i)) {
+      snapshot->lane_offsets[topic_struct->sub_ids[i] % FANOUT_LANES + 1]++;
+    } else {
+      snapshot->excluded[snapshot->excluded_count++] = i;
+    }
+  }
+  for (lane = 0; lane < FANOUT_LANES; lane++) {
+    snapshot->lane_offsets[lane + 1] += snapshot->lane_offsets[lane];
+    next[lane] = snapshot->lane_offsets[lane];
+  }
+  for (i = 0; i < count; i++) {
+    if (!is_snapshot_destination(topic_struct, i)) {
+      continue;
+    }
+    sub_id = topic_struct->sub_ids[i];
+    lane = sub_id % FANOUT_LANES;
+    snapshot->dest_addrs[next[lane]].sin_family = AF_INET;
+    snapshot->dest_addrs[next[lane]].sin_addr.s_addr =
+        topic_struct->sub_addresses[i];
+    snapshot->dest_addrs[next[lane]].sin_port = topic_struct->sub_ports[i];
+    snapshot->sub_ids[next[lane]] = sub_id;
+    snapshot->framed[next[lane]] = subscribers[sub_id].framed;
+    snapshot->has_framed |= subscribers[sub_id].framed;
+    next[lane]++;
+  }
+  snapshot->complete = snapshot->excluded_count == 0 &&
+                       topic_struct->first_group_id == empty_group_id;
+
+  if (max_log_level >= LOG_LEVEL_DEBUG) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Built snapshot of %d subscribers of topic '%s'", count,
+             topic_names[topic_struct - topic_subs_map]);
+    log_line(LOG_LEVEL_DEBUG, log_buffer);
+  }
+  return snapshot;
+}
+
+/**
+ * Replaces the snapshot of the provided topic structure with a snapshot of its
+ * current subscribers, which publishers load from then on, and retires the
+ * previous one
+ *
+ * A topic that has been removed is left without a snapshot.
+ */
+void replace_topic_snapshot(topic_subs *topic_struct) {
+  topic_snapshot *previous = topic_struct->snapshot;
+  topic_snapshot *snapshot = NULL;
+
+  if (strlen(topic_names[topic_struct - topic_subs_map]) > 0) {
+    snapshot = build_topic_snapshot(topic_struct);
+  }
+  topic_struct->snapshot_stale = false;
+  __atomic_store_n(&topic_struct->snapshot, snapshot, __ATOMIC_SEQ_CST);
+  if (previous != NULL) {
+    retire_topic_snapshot(previous);
+  }
+}
+
+/**
+ * Replaces the stale snapshots of all topics whose subscribers changed while
+ * the broker lock was held and releases the lock
+ *
+ * Publishers that do not hold the lock keep loading the previous snapshots
+ * until then, so they see the changes of a batch of requests all at once.
+ */
+void release_broker_lock() {
+  topic_subs *topic_struct;
+  int i;
+
+  for (i = 0; i < stale_topic_count; i++) {
+    topic_struct = &topic_subs_map[stale_topic_ids[i]];
+    if (topic_struct->snapshot_stale) {
+      replace_topic_snapshot(topic_struct);
+    }
+  }
+  stale_topic_count = 0;
+  pthread_mutex_unlock(&broker_lock);
+}
+
+/**
+ * Returns the snapshot of the current subscribers of the provided topic
+ * structure, which is replaced first if its subscribers or their delivery
+ * changed since it was built, the broker lock is held when called
+ *
+ * Returns NULL if the snapshot could not be built
+ */
+const topic_snapshot *get_topic_snapshot(topic_subs *topic_struct) {
+  if (topic_struct->snapshot_stale || topic_struct->snapshot == NULL) {
+    replace_topic_snapshot(topic_struct);
+  }
+  return topic_struct->snapshot;
+}
+
+/**
+ * Unpacks the destinations of the provided message from the packed arrays of
+ * the provided topic structure into the batch of the provided worker, along
+ * with the chosen member of every group on the topic
+ *
+ * If a snapshot is provided, only the subscribers that it excludes are
+ * unpacked, since the others are sent the message from the snapshot.
+ *
+ * Returns the number of destinations in the batch
+ */
+int unpack_destinations(delivery *d, const topic_subs *topic_struct,
+                        const topic_snapshot *snapshot, worker *self) {
+  const char *message = d->message;
+  int length = d->iovs[1].iov_len;
+  int count, unpacked, group_id, sub_id, i, j;
+
+  // unpack destinations of subscribers without queued messages from the packed
+  // arrays
+  count = 0;
+  unpacked = snapshot != NULL ? snapshot->excluded_count
+                              : topic_struct->sub_count;
+  for (j = 0; j < unpacked; j++) {
+    i = snapshot != NULL ? snapshot->excluded[j] : j;
+    if (topic_struct->sub_filter_ids[i] != empty_filter_id &&
+        !match_filter(topic_struct->sub_filter_ids[i], d)) {
+      continue;
+    }
+    count = add_destination(
+        topic_struct->sub_ids[i], topic_struct->sub_addresses[i],
+        topic_struct->sub_ports[i], count, d, self);
+  }
+
+  // add the chosen member of every group on the topic
+  for (group_id = topic_struct->first_group_id; group_id != empty_group_id;
+       group_id = groups[group_id].next_group_id) {
+    sub_id = select_group_member(&groups[group_id], message, length);
+    count = add_destination(sub_id, subscribers[sub_id].address,
+                            subscribers[sub_id].port, count, d, self);
+  }
+  return count;
+}
+
+/**
+ * Sends the provided message to all subscribers of the provided topic
+ * structure whose filter matches the message, and to one member of each group
+ * on the topic.
+ *
+ * Destination addresses are unpacked from the subscriber arrays into a batch of
+ * message headers that share a single payload, which is then passed to the
+ * kernel with as few sendmmsg calls or io_uring submissions as possible.
+ * A batch of more than fanout_chunk_size destinations is split into chunks
+ * that all workers send instead, see schedule_fanout(), and so is every batch
+ * with a destination that still has chunks pending in its lane, whatever their
+ * topic, so that messages to a subscriber do not overtake them. While no
+ * subscriber has queued messages, the chunks of a topic with more subscribers
+ * than that are taken from the snapshot of the topic instead, and only the
+ * subscribers that the snapshot excludes are unpacked.
+ * Subscribers that still have queued messages, as well as all remaining
+ * subscribers once the socket send buffer is full, receive the message through
+ * their egress queue instead, see enqueue_message(). If the worker serves the
+ * AF_XDP fast path, subscribers on the same link that receive bare messages are
+ * sent the message as raw frames.
+ *
+ * Returns 0 if message was sent or queued for all subscribers without issues,
+ * otherwise returns 1 on error.
+ */
+int send_message(delivery *d, topic_subs *topic_struct, worker *self) {
+  struct sockaddr_in *dest_addrs = self->dest_addrs;
+  struct mmsghdr *dest_msgs = self->dest_msgs;
+  int *dest_ids = self->dest_ids;
+  const char *message = d->message;
+  int length = d->iovs[1].iov_len;
+  const topic_snapshot *snapshot;
+  int count, sent, nsent, batch, i, result;
+  bool buffer_full, split;
+
+  if (self->xdp != NULL) {
+    build_xdp_frame(self->xdp, message, length);
+  }
+
+  // the snapshot bypasses egress queues and the fast path, so it is only used
+  // if neither is in play
+  snapshot = NULL;
+  if (fanout_event_fd >= 0 && self->xdp == NULL &&
+      queued_subscriber_count == 0 &&
+      topic_struct->sub_count > fanout_chunk_size &&
+      (snapshot = get_topic_snapshot(topic_struct)) != NULL &&
+      snapshot->lane_offsets[FANOUT_LANES] > 0) {
+    schedule_snapshot_fanout(d, snapshot, self);
+  }
+
+  count = unpack_destinations(d, topic_struct, snapshot, self);
+  if (self->xdp != NULL) {
+    flush_xdp_frames(self->xdp);
+  }
+
+  split = fanout_event_fd >= 0 && count > fanout_chunk_size;
+  for (i = 0; i < count && !split; i++) {
+    split = has_pending_chunks(dest_ids[i]);
+  }
+  if (split) {
+    schedule_fanout(d, count, self);
+    return 0;
+  }
+
+  // pass the batch to the kernel in chunks of the configured send batch size
+  result = 0;
+  sent = 0;
+  buffer_full = false;
+  while (sent < count) {
+    batch = count - sent < send_batch_size ? count - sent : send_batch_size;
+    if (self->use_uring) {
+      if (send_batch_uring(d, sent, batch, &buffer_full, self) != 0) {
+        result = 1;
+      }
+      sent += batch;
+      if (buffer_full) {
+        // queue the message for all remaining subscribers as well
+        for (i = sent; i < count; i++) {
+          enqueue_message(dest_ids[i], d);
+        }
+        break;
+      }
+      continue;
+    }
+    nsent = sendmmsg(self->sock_fd, &dest_msgs[sent], batch, 0);
+    if (nsent <= 0 && is_send_buffer_full(errno)) {
+      // the socket cannot take any more messages right now, queue the message
+      // for all remaining subscribers
+      for (i = sent; i < count; i++) {
+        enqueue_message(dest_ids[i], d);
+      }
+      break;
+    }
+    if (nsent <= 0) {
+      // the first message of the remaining batch could not be sent, skip it
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Failed to send message '%s' to host %s:%d", message,
+               inet_ntoa(dest_addrs[sent].sin_addr),
+               ntohs(dest_addrs[sent].sin_port));
+      log_line(LOG_LEVEL_ERROR, log_buffer);
+      perror("sendmmsg");
+      result = 1;
+      sent++;
+      continue;
+    }
+
+    for (i = sent; i < sent + nsent && max_log_level >= LOG_LEVEL_DEBUG; i++) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE, "Sent message '%s' to host %s:%d",
+               message, inet_ntoa(dest_addrs[i].sin_addr),
+               ntohs(dest_addrs[i].sin_port));
+      log_line(LOG_LEVEL_DEBUG, log_buffer);
+    }
+    sent += nsent;
+    __atomic_add_fetch(&sent_message_count, nsent, __ATOMIC_RELAXED);
+  }
+
+  return result;
+}
+
+/**
+ * Gathers the queued messages of the provided subscriber that are sent
+ * together into the provided vector, which are the messages of the same length
+ * from the head of the queue on, optionally followed by a shorter one, so that
+ * the kernel can segment them into one datagram per message (UDP GSO)
+ *
+ * 64 messages of the largest size still fit into a single datagram, which the
+ * kernel requires of a segmented send
+ *
+ * Returns the number of gathered messages
+ */
+int gather_queued_messages(const subscriber *sub, struct iovec *iovs) {
+  message_buffer *buffer;
+  int max_count, count;
+
+  max_count = udp_offload && segmented_sends ? GSO_MAX_SEGMENTS : 1;
+  for (count = 0; count < sub->queue_length && count < max_count; count++) {
+    buffer = sub->messages[(sub->queue_head + count) % egress_queue_length];
+    if (count > 0 && (buffer->length > (int)iovs[0].iov_len ||
+                      iovs[count - 1].iov_len < iovs[0].iov_len)) {
+      break;
+    }
+    iovs[count].iov_base = buffer->data;
+    iovs[count].iov_len = buffer->length;
+    // an empty message can not be the size of a segment
+    if (buffer->length == 0) {
+      return count + 1;
+    }
+  }
+
+  return count;
+}
+
+/**
+ * Sends queued messages to their subscribers until either all egress queues
+ * are empty or the socket send buffer is full again
+ *
+ * Subscribers are served in rounds of one message each, so that a subscriber
+ * with a long queue does not delay all others. With UDP offloads, a round
+ * sends all messages that gather_queued_messages() gathers for a subscriber
+ * with a single system call instead.
+ */
+void drain_egress_queues(worker *self) {
+  struct sockaddr_in dest_addr;
+  struct iovec iovs[GSO_MAX_SEGMENTS];
+  char control[CMSG_SPACE(sizeof(uint16_t))];
+  struct cmsghdr *cmsg;
+  struct msghdr msg;
+  message_buffer *buffer;
+  subscriber *sub;
+  bool progress;
+  int sub_id, count, nbytes, i;
+
+  memset((void *)&dest_addr, 0, sizeof(dest_addr));
+  dest_addr.sin_family = AF_INET;
+  memset((void *)&msg, 0, sizeof(msg));
+  msg.msg_name = &dest_addr;
+  msg.msg_namelen = sizeof(dest_addr);
+  msg.msg_iov = iovs;
+
+  do {
+    progress = false;
+    for (sub_id = 0; sub_id < subscribers_length; sub_id++) {
+      sub = &subscribers[sub_id];
+      if (sub->queue_length == 0) {
+        continue;
+      }
+
+      dest_addr.sin_addr.s_addr = sub->address;
+      dest_addr.sin_port = sub->port;
+      buffer = sub->messages[sub->queue_head];
+      count = gather_queued_messages(sub, iovs);
+      msg.msg_iovlen = count;
+      msg.msg_control = NULL;
+      msg.msg_controllen = 0;
+      if (count > 1) {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        *(uint16_t *)CMSG_DATA(cmsg) = iovs[0].iov_len;
+      }
+
+      nbytes = sendmsg(self->sock_fd, &msg, 0);
+      if (nbytes < 0 && is_send_buffer_full(errno)) {
+        return;
+      }
+      if (nbytes < 0 && errno == EIO && count > 1) {
+        log_line(LOG_LEVEL_WARNING,
+                 "Segmented sends are not supported, sending queued messages "
+                 "one at a time");
+        segmented_sends = false;
+        progress = true;
+        continue;
+      }
+      if (nbytes < 0) {
+        snprintf(log_buffer, LOG_BUFFER_SIZE,
+                 "Failed to send queued message '%s' to host %s:%d",
+                 buffer->data,
+                 inet_ntoa(dest_addr.sin_addr), ntohs(dest_addr.sin_port));
+        log_line(LOG_LEVEL_ERROR, log_buffer);
+        perror("sendmsg");
+      } else {
+        __atomic_add_fetch(&sent_message_count, count, __ATOMIC_RELAXED);
+        if (max_log_level >= LOG_LEVEL_DEBUG && count == 1) {
+          snprintf(log_buffer, LOG_BUFFER_SIZE,
+                   "Sent queued message '%s' to host %s:%d", buffer->data,
+                   inet_ntoa(dest_addr.sin_addr), ntohs(dest_addr.sin_port));
+          log_line(LOG_LEVEL_DEBUG, log_buffer);
+        } else if (max_log_level >= LOG_LEVEL_DEBUG) {
+          snprintf(log_buffer, LOG_BUFFER_SIZE,
+                   "Sent %d queued messages from '%s' on to host %s:%d",
+                   count, buffer->data, inet_ntoa(dest_addr.sin_addr),
+                   ntohs(dest_addr.sin_port));
+          log_line(LOG_LEVEL_DEBUG, log_buffer);
+        }
+      }
+
+      // remove messages from queue, regardless of whether they could be sent
+      for (i = 0; i < count; i++) {
+        release_message_buffer(sub->messages[sub->queue_head]);
+        sub->queue_head = (sub->queue_head + 1) % egress_queue_length;
+      }
+      sub->queue_length -= count;
+      if (sub->queue_length == 0) {
+        __atomic_sub_fetch(&queued_subscriber_count, 1, __ATOMIC_RELAXED);
+      }
+      progress = true;
+    }
+  } while (progress);
+}
+
+/**
+ * Validates the provided topic string
+ *
+ * Returns 0 if topic is valid, otherwise returns 1
+ */
+int validate_topic(const char *topic, bool wildcardAllowed) {
+  // assert that the request contained a topic at all
+  if (topic == NULL) {
+    log_line(LOG_LEVEL_WARNING, "Request does not contain a topic");
+    return 1;
+  }
+
+  // assert that topic is not an empty string, since that is reserved as an
+  // identifier for empty topics
+  if (strlen(topic) == 0) {
+    log_line(LOG_LEVEL_WARNING, "Topic is not allowed to be an empty string");
+    return 1;
+  }
+
+  // assert that topic is not too long to store
+  if (strlen(topic) >= TOPIC_LENGTH) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE, "Topic '%s' exceeds max length of %u",
+             topic, TOPIC_LENGTH);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // assert that topic does not contain the message delimiter character
+  if (strchr(topic, msg_delim) != NULL) {
+    snprintf(
+        log_buffer, LOG_BUFFER_SIZE,
+        "Topic '%s' is not allowed to contain message delimiter character '%c'",
+        topic, msg_delim);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // assert that topic does not contain the wildcard character
+  if (!wildcardAllowed && strchr(topic, topic_wildcard) != NULL) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Topic '%s' is not allowed to contain wildcard character '%c'",
+             topic, topic_wildcard);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Validates the provided message string
+ *
+ * Returns 0 if message is valid, otherwise returns 1
+ */
+int validate_message(const char *message) {
+  // assert that the request contained a message at all
+  if (message == NULL) {
+    log_line(LOG_LEVEL_WARNING, "Request does not contain a message");
+    return 1;
+  }
+
+  // assert that message does not contain the message delimiter character
+  if (strchr(message, msg_delim) != NULL) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Message is not allowed to contain message delimiter "
+             "character '%c'",
+             msg_delim);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Validates the provided filter expression string, which may be NULL if the
+ * request does not contain a filter
+ *
+ * Returns 0 if filter is absent or valid, otherwise returns 1
+ */
+int validate_filter(const char *expression) {
+  if (expression == NULL) {
+    return 0;
+  }
+
+  // assert that filter is not too long to store
+  if (strlen(expression) >= FILTER_LENGTH) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Filter '%s' exceeds max length of %u", expression, FILTER_LENGTH);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // assert that filter does not contain the message delimiter character, which
+  // no message can contain
+  if (strchr(expression, msg_delim) != NULL) {
+    snprintf(
+        log_buffer, LOG_BUFFER_SIZE,
+        "Filter '%s' is not allowed to contain message delimiter character '%c'",
+        expression, msg_delim);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Forwards the provided message of the provided topic to all subscribers of the
+ * topic with the provided ID and all subscribers of the wildcard topic
+ *
+ * The topic ID may be empty_topic_id if the topic is not known, in which case
+ * the message is only forwarded to subscribers of the wildcard topic and the
+ * caller is responsible for logging the discarded message
+ *
+ * Returns 0 if message could be forwarded without issues, otherwise returns 1
+ * on errors
+ */
+int publish_message(int topic_id, const char *topic, const char *message,
+                    worker *self) {
+  delivery d;
+
+  // invalidates the cached results of all filters and numbers the message
+  d.sequence = __atomic_add_fetch(&message_sequence, 1, __ATOMIC_RELAXED);
+  d.topic = topic;
+  d.message = message;
+  d.iovs[0].iov_len = 0;
+  d.iovs[1].iov_base = (void *)message;
+  d.iovs[1].iov_len = strlen(message);
+  d.shared[0] = NULL;
+  d.shared[1] = NULL;
+
+  // forward message to subscribers of wildcard topic
+  send_message(&d, &topic_subs_map[INDEX_WILDCARD_TOPIC], self);
+
+  if (topic_id != empty_topic_id && topic_subs_map[topic_id].sub_count == 0 &&
+      topic_subs_map[topic_id].first_group_id == empty_group_id) {
+    if (max_log_level >= LOG_LEVEL_DEBUG) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Topic '%s' has no subscribers, discarding message",
+               topic_names[topic_id]);
+      log_line(LOG_LEVEL_DEBUG, log_buffer);
+    }
+  } else if (topic_id != empty_topic_id) {
+    // forward message to subscribers of current topic
+    send_message(&d, &topic_subs_map[topic_id], self);
+  }
+
+  release_message_buffer(d.shared[0]);
+  release_message_buffer(d.shared[1]);
+  return 0;
+}
+
+/**
+ * Returns the current time of the monotonic clock in milliseconds
+ */
+long long get_time_ms() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (long long)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Takes a token from the bucket of the provided key in the provided rate limit,
+ * after refilling the bucket according to the time since it was last refilled
+ *
+ * Returns 0 if a token could be taken or the limit is disabled, otherwise
+ * returns 1 if the rate limit is exceeded
+ */
+int take_token(rate_limit *limit, uint32_t key, long long now_ms) {
+  rate_bucket *bucket, *oldest;
+  uint32_t now, elapsed;
+  int slot, i;
+
+  if (limit->rate == 0) {
+    return 0;
+  }
+
+  // 0 marks unused buckets
+  key = key == 0 ? 1 : key;
+  now = (uint32_t)now_ms;
+  slot = (int)((key * 2654435761u) >> (32 - RATE_BUCKET_BITS));
+  bucket = NULL;
+  oldest = &limit->buckets[slot];
+  for (i = 0; i < RATE_PROBE_LENGTH; i++) {
+    bucket = &limit->buckets[(slot + i) & (RATE_BUCKET_COUNT - 1)];
+    if (bucket->key == key) {
+      break;
+    }
+    if (bucket->key == 0) {
+      // start with a full bucket
+      bucket->key = key;
+      bucket->refilled_ms = now;
+      bucket->tokens = (float)limit->burst;
+      break;
+    }
+    if (now - bucket->refilled_ms > now - oldest->refilled_ms) {
+      oldest = bucket;
+    }
+    bucket = NULL;
+  }
+  if (bucket == NULL) {
+    bucket = oldest;
+    bucket->key = key;
+    bucket->refilled_ms = now;
+    bucket->tokens = (float)limit->burst;
+  }
+
+  elapsed = now - bucket->refilled_ms;
+  if (elapsed > 0) {
+    bucket->refilled_ms = now;
+    bucket->tokens += (float)elapsed * limit->rate / 1000;
+    if (bucket->tokens > limit->burst) {
+      bucket->tokens = (float)limit->burst;
+    }
+  }
+
+  if (bucket->tokens < 1) {
+    return 1;
+  }
+  bucket->tokens--;
+  return 0;
+}
+
+/**
+ * Attempts to find the peer with the provided address
+ *
+ * Returns the peer or NULL if the address is not a configured peer
+ */
+peer *find_peer(const struct sockaddr_in *address) {
+  int i;
+
+  for (i = 0; i < peer_count; i++) {
+    if (peers[i].address.sin_addr.s_addr == address->sin_addr.s_addr &&
+        peers[i].address.sin_port == address->sin_port) {
+      return &peers[i];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Sends the batch of forwarded publishes of every peer through the socket of
+ * the provided worker
+ */
+void flush_peer_batches(worker *self) {
+  peer *p;
+  int i;
+
+  for (i = 0; i < peer_count; i++) {
+    p = &peers[i];
+    if (p->batch_length == 0) {
+      continue;
+    }
+    if (sendto(self->sock_fd, p->batch, p->batch_length, 0,
+               (struct sockaddr *)&p->address, sizeof(p->address)) < 0) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Failed to forward publishes to peer %s:%d: %s",
+               inet_ntoa(p->address.sin_addr), ntohs(p->address.sin_port),
+               strerror(errno));
+      log_line(LOG_LEVEL_ERROR, log_buffer);
+    }
+    p->batch_length = 0;
+  }
+}
+
+/**
+ * Appends the provided message of the topic with the provided name and hash to
+ * the batches of all peers whose recent interest summary contains the topic
+ *
+ * A batch is sent once it cannot take another message, otherwise the batches
+ * are sent by flush_peer_batches() after the current batch of requests.
+ */
+void forward_to_peers(const char *topic, uint32_t hash, const char *message,
+                      worker *self) {
+  long long now_ms = 0;
+  uint32_t bit = hash % INTEREST_BITS;
+  int i, length;
+  peer *p;
+
+  length = strlen(topic) + strlen(message) + 2;
+  for (i = 0; i < peer_count; i++) {
+    p = &peers[i];
+    if (!p->wants_all && !(p->interest[bit / 64] & (1ull << (bit % 64)))) {
+      continue;
+    }
+    if (now_ms == 0) {
+      now_ms = get_time_ms();
+    }
+    if (p->announced_ms == 0 || now_ms - p->announced_ms > PEER_TIMEOUT_MS) {
+      continue;
+    }
+
+    // forward requests have the format FWD!topic!message[!topic!message...]
+    if (p->batch_length + length > MESSAGE_BUFFER_SIZE - 1) {
+      flush_peer_batches(self);
+    }
+    if (p->batch_length == 0) {
+      p->batch_length = strlen(method_forward) - 1;
+      memcpy(p->batch, method_forward, p->batch_length);
+    }
+    p->batch_length += snprintf(p->batch + p->batch_length,
+                                MESSAGE_BUFFER_SIZE - p->batch_length,
+                                "%c%s%c%s", msg_delim, topic, msg_delim,
+                                message);
+    p->forwarded_count++;
+  }
+}
+
+/**
+ * Announces the summary of the topics that have subscribers at this broker to
+ * all peers through the socket of the provided worker
+ *
+ * The summary has the format INT!all!bitmap, where all is 1 if the wildcard
+ * topic has subscribers and bitmap contains the bits of the topic hashes as
+ * hexadecimal 64 bit words.
+ */
+void announce_interest(worker *self) {
+  uint64_t interest[INTEREST_WORDS];
+  char summary[MESSAGE_BUFFER_SIZE];
+  bool wants_all;
+  uint32_t bit;
+  int topic_id, length, i;
+
+  memset((void *)interest, 0, sizeof(interest));
+  wants_all = false;
+  for (topic_id = 0; topic_id < topic_subs_map_length; topic_id++) {
+    if (topic_subs_map[topic_id].sub_count == 0 &&
+        topic_subs_map[topic_id].first_group_id == empty_group_id) {
+      continue;
+    }
+    if (topic_id == INDEX_WILDCARD_TOPIC) {
+      wants_all = true;
+      continue;
+    }
+    bit = topic_hashes[topic_id] % INTEREST_BITS;
+    interest[bit / 64] |= 1ull << (bit % 64);
+  }
+
+  length = sprintf(summary, "%s%d%c", method_interest, wants_all, msg_delim);
+  for (i = 0; i < INTEREST_WORDS; i++) {
+    length += sprintf(summary + length, "%016llx",
+                      (unsigned long long)interest[i]);
+  }
+  for (i = 0; i < peer_count; i++) {
+    if (sendto(self->sock_fd, summary, length, 0,
+               (struct sockaddr *)&peers[i].address,
+               sizeof(peers[i].address)) != length) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Failed to announce interest to peer %s:%d: %s",
+               inet_ntoa(peers[i].address.sin_addr),
+               ntohs(peers[i].address.sin_port), strerror(errno));
+      log_line(LOG_LEVEL_WARNING, log_buffer);
+    }
+  }
+}
+
+/**
+ * Handles an interest announcement of a peer
+ *
+ * Replaces the stored interest summary of the peer with the announced one
+ *
+ * Returns 0 if the announcement is valid and was sent by a peer, otherwise
+ * returns 1
+ */
+int handle_interest(char *request, const struct sockaddr_in *peer_address) {
+  char word[17];
+  char *all, *bitmap, *end;
+  peer *p;
+  int i;
+
+  if ((p = find_peer(peer_address)) == NULL) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d is not a peer, ignoring its interest",
+             inet_ntoa(peer_address->sin_addr), ntohs(peer_address->sin_port));
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // isolate request components
+  strtok(request, "!");
+  all = strtok(NULL, "!");
+  bitmap = strtok(NULL, "");
+  if (all == NULL || bitmap == NULL || strlen(bitmap) != INTEREST_WORDS * 16) {
+    log_line(LOG_LEVEL_WARNING, "Interest announcement is malformed");
+    return 1;
+  }
+
+  word[16] = '\0';
+  for (i = 0; i < INTEREST_WORDS; i++) {
+    memcpy(word, bitmap + i * 16, 16);
+    p->interest[i] = strtoull(word, &end, 16);
+    if (*end != '\0') {
+      log_line(LOG_LEVEL_WARNING, "Interest announcement is malformed");
+      return 1;
+    }
+  }
+  p->wants_all = strcmp(all, "1") == 0;
+  p->announced_ms = get_time_ms();
+  return 0;
+}
+
+/**
+ * Handles a forward request of a peer
+ *
+ * Forwards the contained messages to the local subscribers of their topics and
+ * of the wildcard topic, but not to any peers. Requests of hosts that are not
+ * peers are ignored, since the messages bypass the rate limits of publishes.
+ *
+ * Returns 0 if all messages could be forwarded without issues, otherwise
+ * returns 1 on errors
+ */
+int handle_forward(char *request, const struct sockaddr_in *peer_address,
+                   worker *self) {
+  char *topic, *message;
+  int result;
+
+  if (find_peer(peer_address) == NULL) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d is not a peer, ignoring its forwarded messages",
+             inet_ntoa(peer_address->sin_addr), ntohs(peer_address->sin_port));
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // isolate request components
+  // jump over method, then take the topics and messages in turns
+  strtok(request, "!");
+  result = 0;
+  while ((topic = strtok(NULL, "!")) != NULL) {
+    message = strtok(NULL, "!");
+    if (validate_topic(topic, false) != 0 || validate_message(message) != 0) {
+      return 1;
+    }
+    result |= publish_message(find_topic_id(topic), topic, message, self);
+  }
+
+  return result;
+}
+
+/**
+ * Discards a publish to the provided topic that exceeds the rate limit of the
+ * topic
+ *
+ * Returns 1 to be passed on as the result of the publish
+ */
+int discard_limited_publish(const char *topic) {
+  limited_request_count++;
+  if (max_log_level >= LOG_LEVEL_DEBUG) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Topic '%s' exceeds its rate limit, discarding message", topic);
+    log_line(LOG_LEVEL_DEBUG, log_buffer);
+  }
+  return 1;
+}
+
+/**
+ * Handles a publish request
+ *
+ * Forwards received message to all subscribers of the specified topic and
+ * all subscribers of the wildcard topic, as well as to interested peers
+ *
+ * Returns 0 if published message could be forwarded without issues, otherwise
+ * returns 1 on errors
+ */
+int handle_publish(char *request, worker *self) {
+  char *topic, *message;
+  int topic_id;
+
+  // isolate request components
+  // first jump over method, get the topic as the next token
+  // and then use the remaining substring as message contents
+  strtok(request, "!");
+  topic = strtok(NULL, "!");
+  message = strtok(NULL, "");
+
+  // validate topic and message
+  if (validate_topic(topic, false) != 0 || validate_message(message) != 0) {
+    return 1;
+  }
+
+  if (topic_limit.rate != 0 &&
+      take_token(&topic_limit, hash_topic(topic), get_time_ms()) != 0) {
+    return discard_limited_publish(topic);
+  }
+
+  topic_id = find_topic_id(topic);
+  if (topic_id == empty_topic_id && max_log_level >= LOG_LEVEL_DEBUG) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Topic '%s' has no subscribers, discarding message", topic);
+    log_line(LOG_LEVEL_DEBUG, log_buffer);
+  }
+
+  if (peer_count > 0) {
+    forward_to_peers(topic,
+                     topic_id != empty_topic_id ? topic_hashes[topic_id]
+                                                : hash_topic(topic),
+                     message, self);
+  }
+  return publish_message(topic_id, topic, message, self);
+}
+
+/**
+ * Handles a publish request that addresses the topic by an ID which was
+ * previously obtained through a resolve request
+ *
+ * Forwards received message to all subscribers of the specified topic and
+ * all subscribers of the wildcard topic, as well as to interested peers
+ *
+ * Returns 0 if published message could be forwarded without issues, otherwise
+ * returns 1 on errors
+ */
+int handle_publish_id(char *request, worker *self) {
+  char *topic_id_str, *message, *end;
+  unsigned long topic_id;
+
+  // isolate request components
+  // first jump over method, get the topic ID as the next token
+  // and then use the remaining substring as message contents
+  strtok(request, "!");
+  topic_id_str = strtok(NULL, "!");
+  message = strtok(NULL, "");
+
+  // validate topic ID, it must refer to a topic that is currently interned
+  if (topic_id_str == NULL) {
+    log_line(LOG_LEVEL_WARNING, "Request does not contain a topic ID");
+    return 1;
+  }
+  topic_id = strtoul(topic_id_str, &end, 10);
+  if (end == topic_id_str || *end != '\0' ||
+      topic_id >= (unsigned long)topic_subs_map_length ||
+      topic_id == INDEX_WILDCARD_TOPIC ||
+      strlen(topic_names[topic_id]) == 0) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE, "Topic ID '%s' is not valid",
+             topic_id_str);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // validate message
+  if (validate_message(message) != 0) {
+    return 1;
+  }
+
+  if (topic_limit.rate != 0 && take_token(&topic_limit, topic_hashes[topic_id],
+                                          get_time_ms()) != 0) {
+    return discard_limited_publish(topic_names[topic_id]);
+  }
+
+  if (peer_count > 0) {
+    forward_to_peers(topic_names[topic_id], topic_hashes[topic_id], message,
+                     self);
+  }
+  return publish_message((int)topic_id, topic_names[topic_id], message, self);
+}
+
+/**
+ * Sends the provided reply to the provided client, through the Unix domain
+ * socket if the client sent its request through it
+ *
+ * Returns 0 if the reply was sent, otherwise returns 1
+ */
+int send_reply(const char *reply, int length,
+               const struct sockaddr_in *client_addr, worker *self) {
+  unix_endpoint *endpoint;
+  int nbytes;
+
+  endpoint =
+      get_unix_endpoint(client_addr->sin_addr.s_addr, client_addr->sin_port);
+  if (endpoint != NULL) {
+    nbytes = sendto(unix_fd, reply, length, MSG_DONTWAIT,
+                    (struct sockaddr *)&endpoint->address, endpoint->length);
+  } else {
+    nbytes = sendto(self->sock_fd, reply, length, 0,
+                    (struct sockaddr *)client_addr, sizeof(*client_addr));
+  }
+  if (nbytes != length) {
+    perror("sendto");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Handles a resolve request
+ *
+ * Interns the specified topic, pins it so that its ID remains valid and replies
+ * to the client with the ID in the format RES!topic!id
+ *
+ * Returns 0 if the topic could be resolved without issues, otherwise returns 1
+ * on errors
+ */
+int handle_resolve(char *request, const struct sockaddr_in *client_address,
+                   worker *self) {
+  char *topic;
+  char reply[TOPIC_LENGTH + 32];
+  int topic_id, length;
+
+  // isolate topic from request
+  // first jump over method, then get the remaining substring after the first
+  // delimiter
+  strtok(request, "!");
+  topic = strtok(NULL, "");
+
+  // validate topic, resolving the wildcard topic is not useful for publishing
+  if (validate_topic(topic, false) != 0) {
+    return 1;
+  }
+
+  topic_id = find_or_insert_topic_id(topic);
+  if (topic_id == empty_topic_id) {
+    return 1;
+  }
+  topic_pinned[topic_id] = true;
+
+  // reply with the ID of the topic
+  length = snprintf(reply, sizeof(reply), "%s%s%c%d", method_resolve, topic,
+                    msg_delim, topic_id);
+  if (send_reply(reply, length, client_address, self) != 0) {
+    return 1;
+  }
+
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Resolved topic '%s' to ID %d for host %s:%d", topic, topic_id,
+           inet_ntoa(client_address->sin_addr),
+           ntohs(client_address->sin_port));
+  log_line(LOG_LEVEL_INFO, log_buffer);
+  return 0;
+}
+
+/**
+ * Determines whether the provided request is a subscribe or join request, which
+ * may be prefixed by a request for delivery frames
+ */
+bool is_subscription(const char *request) {
+  const char *end;
+
+  if (strncmp(request, method_ring, strlen(method_ring)) == 0 &&
+      (end = strchr(request + strlen(method_ring), msg_delim)) != NULL &&
+      (end = strchr(end + 1, msg_delim)) != NULL) {
+    request = end + 1;
+  }
+  if (strncmp(request, method_framed, strlen(method_framed)) == 0) {
+    request += strlen(method_framed);
+  }
+  return strncmp(request, method_subscribe, strlen(method_subscribe)) == 0 ||
+         strncmp(request, method_subscribe_many,
+                 strlen(method_subscribe_many)) == 0 ||
+         strncmp(request, method_join, strlen(method_join)) == 0;
+}
+
+#define SIP_ROTATE(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define SIP_ROUND                                                              \
+  v0 += v1;                                                                    \
+  v1 = SIP_ROTATE(v1, 13) ^ v0;                                                \
+  v0 = SIP_ROTATE(v0, 32);                                                     \
+  v2 += v3;                                                                    \
+  v3 = SIP_ROTATE(v3, 16) ^ v2;                                                \
+  v0 += v3;                                                                    \
+  v3 = SIP_ROTATE(v3, 21) ^ v0;                                                \
+  v2 += v1;                                                                    \
+  v1 = SIP_ROTATE(v1, 17) ^ v2;                                                \
+  v2 = SIP_ROTATE(v2, 32)
+
+/**
+ * Calculates the cookie of the provided client address in the provided period,
+ * which is the SipHash-2-4 of the address and period under the cookie key, so
+ * that it cannot be guessed without receiving it
+ */
+uint64_t get_cookie(const struct sockaddr_in *client_addr, uint64_t period) {
+  uint64_t v0, v1, v2, v3, words[3];
+  int i;
+
+  v0 = cookie_key[0] ^ 0x736f6d6570736575ull;
+  v1 = cookie_key[1] ^ 0x646f72616e646f6dull;
+  v2 = cookie_key[0] ^ 0x6c7967656e657261ull;
+  v3 = cookie_key[1] ^ 0x7465646279746573ull;
+  words[0] = (uint64_t)client_addr->sin_addr.s_addr << 16 |
+             client_addr->sin_port;
+  words[1] = period;
+  // the last word holds the message length of 16 bytes
+  words[2] = 16ull << 56;
+  for (i = 0; i < 3; i++) {
+    v3 ^= words[i];
+    SIP_ROUND;
+    SIP_ROUND;
+    v0 ^= words[i];
+  }
+  v2 ^= 0xff;
+  SIP_ROUND;
+  SIP_ROUND;
+  SIP_ROUND;
+  SIP_ROUND;
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+/**
+ * Verifies that the provided subscribe or join request carries the cookie of
+ * the client in the format CHK!cookie!request, which proves that the client
+ * receives messages at its address. A request without a valid cookie is
+ * answered with the current cookie in the format CHK!cookie, so that the client
+ * can repeat it.
+ *
+ * Returns the request without the cookie if the cookie is valid, otherwise
+ * returns NULL
+ */
+char *verify_subscriber(char *request, const struct sockaddr_in *client_addr,
+                        worker *self) {
+  char reply[32];
+  char *cookie, *end;
+  uint64_t period, value;
+  int length;
+
+  period = get_time_ms() / COOKIE_PERIOD_MS;
+  if (strncmp(request, method_cookie, strlen(method_cookie)) == 0) {
+    cookie = request + strlen(method_cookie);
+    value = strtoull(cookie, &end, 16);
+    if (end - cookie == 16 && *end == msg_delim && is_subscription(end + 1) &&
+        (value == get_cookie(client_addr, period) ||
+         value == get_cookie(client_addr, period - 1))) {
+      return end + 1;
+    }
+  }
+
+  if (max_log_level >= LOG_LEVEL_DEBUG) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Request of host %s:%d has no valid cookie, sending cookie",
+             inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
+    log_line(LOG_LEVEL_DEBUG, log_buffer);
+  }
+  length = snprintf(reply, sizeof(reply), "%s%016llx", method_cookie,
+                    (unsigned long long)get_cookie(client_addr, period));
+  send_reply(reply, length, client_addr, self);
+  return NULL;
+}
+
+/**
+ * Registers subscriber address data as recipient for the provided topic, with
+ * the provided filter expression unless it is NULL, and sets whether messages
+ * are sent to the subscriber in delivery frames
+ *
+ * Returns 0 if topic subscription could be stored without issues, otherwise
+ * returns 1 on errors
+ */
+int subscribe_topic(const char *topic, const char *expression, bool framed,
+                    const struct sockaddr_in *sub_address) {
+  topic_subs *topic_struct;
+  int topic_id, sub_id, filter_id, index;
+
+  // validate topic and filter
+  if (validate_topic(topic, true) != 0 || validate_filter(expression) != 0) {
+    return 1;
+  }
+
+  // get instance that stores subscribers for requested topic
+  topic_id = find_or_insert_topic_id(topic);
+  if (topic_id == empty_topic_id) {
+    return 1;
+  }
+  topic_struct = &topic_subs_map[topic_id];
+
+  filter_id = empty_filter_id;
+  if (expression != NULL &&
+      (filter_id = acquire_filter_id(expression)) == empty_filter_id) {
+    remove_unused_topic(topic_id);
+    return 1;
+  }
+
+  // check via IP address and port if subscriber is already subscribed to
+  // requested topic, in which case only its filter is replaced
+  index = find_subscriber(topic_struct, sub_address);
+  if (index >= 0) {
+    if (set_framed(topic_struct->sub_ids[index], framed) != 0) {
+      release_filter_id(filter_id);
+      return 1;
+    }
+    mark_topic_snapshot_stale(topic_struct);
+    release_filter_id(topic_struct->sub_filter_ids[index]);
+    topic_struct->sub_filter_ids[index] = filter_id;
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d is already subscribed to topic '%s', filter is now "
+             "'%s'",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             topic, expression != NULL ? expression : "");
+    log_line(LOG_LEVEL_INFO, log_buffer);
+    return 0;
+  }
+
+  if (check_source_limit(sub_address) != 0) {
+    release_filter_id(filter_id);
+    remove_unused_topic(topic_id);
+    return 1;
+  }
+
+  // attempt to add new subscriber to the end of the list for requested topic
+  if (topic_struct->sub_count < sub_addresses_length &&
+      (sub_id = find_or_insert_subscriber_id(sub_address)) !=
+          empty_subscriber_id) {
+    if (set_framed(sub_id, framed) != 0) {
+      release_filter_id(filter_id);
+      remove_unused_topic(topic_id);
+      return 1;
+    }
+    acquire_subscriber(sub_id);
+    interest_changed = true;
+    mark_topic_snapshot_stale(topic_struct);
+    index = topic_struct->sub_count++;
+    topic_struct->sub_addresses[index] = sub_address->sin_addr.s_addr;
+    topic_struct->sub_ports[index] = sub_address->sin_port;
+    topic_struct->sub_ids[index] = sub_id;
+    topic_struct->sub_filter_ids[index] = filter_id;
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d is now subscribed to topic '%s'%s%s%s",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             topic, expression != NULL ? " with filter '" : "",
+             expression != NULL ? expression : "",
+             expression != NULL ? "'" : "");
+    log_line(LOG_LEVEL_INFO, log_buffer);
+    return 0;
+  }
+
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "No more free slots to subscribe host %s:%d to topic '%s'",
+           inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+           topic);
+  log_line(LOG_LEVEL_WARNING, log_buffer);
+  release_filter_id(filter_id);
+  remove_unused_topic(topic_id);
+  return 1;
+}
+
+/**
+ * Handles a subscribe request
+ *
+ * Registers subscriber address data as recipient for the specified topic
+ *
+ * Returns 0 if topic subscription could be stored without issues, otherwise
+ * returns 1 on errors
+ */
+int handle_subscribe(char *request, bool framed,
+                     const struct sockaddr_in *sub_address) {
+  char *topic, *expression;
+
+  // isolate topic and optional filter from subscriber message
+  // first jump over method, then get the remaining substring after the first
+  // delimiter, which may contain another delimiter followed by the filter
+  strtok(request, "!");
+  topic = strtok(NULL, "");
+  expression = topic != NULL ? strchr(topic, msg_delim) : NULL;
+  if (expression != NULL) {
+    *expression++ = '\0';
+  }
+
+  return subscribe_topic(topic, expression, framed, sub_address);
+}
+
+/**
+ * Handles a subscribe request for multiple topics in the format
+ * MSUB!topic[!topic...]
+ *
+ * Registers subscriber address data as recipient for every specified topic,
+ * without filters
+ *
+ * Returns 0 if all topic subscriptions could be stored without issues,
+ * otherwise returns 1 on errors
+ */
+int handle_subscribe_many(char *request, bool framed,
+                          const struct sockaddr_in *sub_address) {
+  char *topic;
+  int result;
+
+  // jump over method, then take the topics one by one
+  strtok(request, "!");
+  if ((topic = strtok(NULL, "!")) == NULL) {
+    return subscribe_topic(NULL, NULL, framed, sub_address);
+  }
+  result = 0;
+  do {
+    result |= subscribe_topic(topic, NULL, framed, sub_address);
+  } while ((topic = strtok(NULL, "!")) != NULL);
+
+  return result;
+}
+
+/**
+ * Searches for the subscriber in the subscriber list of the provided topic and
+ * removes its entry if found.
+ *
+ * Returns 0 if subscriber could be unsubscribed from topic without issues,
+ * otherwise returns 1 on errors
+ */
+int unsubscribe_topic(const char *topic,
+                      const struct sockaddr_in *sub_address) {
+  topic_subs *topic_struct;
+  int topic_id, index;
+
+  // validate topic
+  if (validate_topic(topic, true) != 0) {
+    return 1;
+  }
+
+  // get instance that stores subscribers for requested topic
+  topic_id = find_topic_id(topic);
+  if (topic_id == empty_topic_id) {
+    snprintf(
+        log_buffer, LOG_BUFFER_SIZE,
+        "Topic '%s' not found, nothing to unsubscribe host %s:%d to topic from",
+        topic, inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port));
+    log_line(LOG_LEVEL_INFO, log_buffer);
+    return 0;
+  }
+  topic_struct = &topic_subs_map[topic_id];
+
+  // search subscriber via IP address and port
+  index = find_subscriber(topic_struct, sub_address);
+  if (index >= 0) {
+    // matching address found, unregister it by removing its entry
+    remove_subscriber(topic_struct, index);
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d has been unsubscribed from topic '%s'",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             topic);
+    log_line(LOG_LEVEL_INFO, log_buffer);
+
+    // in addition, check if the topic now has no subscribers, in which case
+    // it can be removed to make space for other topics
+    remove_unused_topic(topic_id);
+
+    return 0;
+  }
+
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Host %s:%d was not subscribed to topic '%s', nothing to do",
+           inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+           topic);
+  log_line(LOG_LEVEL_INFO, log_buffer);
+  return 0;
+}
+
+/**
+ * Handles an unsubscribe request
  *
  * Searches for the subscriber in the list and removes its entry if found.
  *
- * Returns 0 if subscriber could be unsubscribed from topic without issues,
- * otherwise returns 1 on errors
+ * Returns 0 if subscriber could be unsubscribed from topic without issues,
+ * otherwise returns 1 on errors
+ */
+int handle_unsubscribe(char *request, const struct sockaddr_in *sub_address) {
+  char *topic;
+
+  // isolate topic from subscriber message
+  // first jump over method, then get the remaining substring after the first
+  // delimiter
+  strtok(request, "!");
+  topic = strtok(NULL, "");
+
+  return unsubscribe_topic(topic, sub_address);
+}
+
+/**
+ * Handles an unsubscribe request for multiple topics in the format
+ * MUNSUB!topic[!topic...]
+ *
+ * Returns 0 if subscriber could be unsubscribed from all topics without
+ * issues, otherwise returns 1 on errors
+ */
+int handle_unsubscribe_many(char *request,
+                            const struct sockaddr_in *sub_address) {
+  char *topic;
+  int result;
+
+  // jump over method, then take the topics one by one
+  strtok(request, "!");
+  if ((topic = strtok(NULL, "!")) == NULL) {
+    return unsubscribe_topic(NULL, sub_address);
+  }
+  result = 0;
+  do {
+    result |= unsubscribe_topic(topic, sub_address);
+  } while ((topic = strtok(NULL, "!")) != NULL);
+
+  return result;
+}
+
+/**
+ * Validates the provided group name string
+ *
+ * Returns 0 if group name is valid, otherwise returns 1
+ */
+int validate_group(const char *name) {
+  // assert that the request contained a group name at all
+  if (name == NULL || strlen(name) == 0) {
+    log_line(LOG_LEVEL_WARNING, "Request does not contain a group");
+    return 1;
+  }
+
+  // assert that group name is not too long to store
+  if (strlen(name) >= GROUP_LENGTH) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Group '%s' exceeds max length of %u", name, GROUP_LENGTH);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // assert that group name does not contain the message delimiter character
+  if (strchr(name, msg_delim) != NULL) {
+    snprintf(
+        log_buffer, LOG_BUFFER_SIZE,
+        "Group '%s' is not allowed to contain message delimiter character '%c'",
+        name, msg_delim);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Handles a join request
+ *
+ * Registers subscriber address data as member of the specified group on the
+ * specified topic, the group is created if it does not exist yet, and sets
+ * whether messages are sent to the subscriber in delivery frames
+ *
+ * Returns 0 if group membership could be stored without issues, otherwise
+ * returns 1 on errors
+ */
+int handle_join(char *request, bool framed,
+                const struct sockaddr_in *sub_address) {
+  char *topic, *name;
+  group *g;
+  int topic_id, group_id, sub_id;
+
+  // isolate topic and group from subscriber message
+  // first jump over method, get the topic as the next token and then use the
+  // remaining substring as group name
+  strtok(request, "!");
+  topic = strtok(NULL, "!");
+  name = strtok(NULL, "");
+
+  // validate topic and group
+  if (validate_topic(topic, true) != 0 || validate_group(name) != 0) {
+    return 1;
+  }
+
+  // get instances that store the requested topic and group
+  topic_id = find_or_insert_topic_id(topic);
+  if (topic_id == empty_topic_id) {
+    return 1;
+  }
+  group_id = find_or_insert_group_id(topic_id, name);
+  if (group_id == empty_group_id) {
+    remove_unused_topic(topic_id);
+    return 1;
+  }
+  g = &groups[group_id];
+
+  sub_id = find_or_insert_subscriber_id(sub_address);
+  if (sub_id != empty_subscriber_id && find_group_member(g, sub_id) >= 0) {
+    if (set_framed(sub_id, framed) != 0) {
+      return 1;
+    }
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d is already a member of group '%s' on topic '%s'",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             name, topic);
+    log_line(LOG_LEVEL_INFO, log_buffer);
+    return 0;
+  }
+
+  if (check_source_limit(sub_address) != 0) {
+    remove_unused_group(group_id);
+    remove_unused_topic(topic_id);
+    return 1;
+  }
+
+  // attempt to add new member to the end of the group
+  if (sub_id != empty_subscriber_id && g->member_count < sub_addresses_length) {
+    if (set_framed(sub_id, framed) != 0) {
+      remove_unused_group(group_id);
+      remove_unused_topic(topic_id);
+      return 1;
+    }
+    acquire_subscriber(sub_id);
+    add_group_member(g, sub_id);
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d is now a member of group '%s' on topic '%s'",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             name, topic);
+    log_line(LOG_LEVEL_INFO, log_buffer);
+    return 0;
+  }
+
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "No more free slots to add host %s:%d to group '%s' on topic '%s'",
+           inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+           name, topic);
+  log_line(LOG_LEVEL_WARNING, log_buffer);
+  remove_unused_group(group_id);
+  remove_unused_topic(topic_id);
+  return 1;
+}
+
+/**
+ * Handles a leave request
+ *
+ * Searches for the subscriber in the members of the group and removes it if
+ * found. Groups without members are removed.
+ *
+ * Returns 0 if subscriber could leave the group without issues, otherwise
+ * returns 1 on errors
+ */
+int handle_leave(char *request, const struct sockaddr_in *sub_address) {
+  char *topic, *name;
+  group *g;
+  int topic_id, group_id, index;
+
+  // isolate topic and group from subscriber message
+  strtok(request, "!");
+  topic = strtok(NULL, "!");
+  name = strtok(NULL, "");
+
+  // validate topic and group
+  if (validate_topic(topic, true) != 0 || validate_group(name) != 0) {
+    return 1;
+  }
+
+  // get instance that stores the members of the requested group
+  topic_id = find_topic_id(topic);
+  group_id = topic_id != empty_topic_id ? find_group_id(topic_id, name)
+                                        : empty_group_id;
+  if (group_id == empty_group_id) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Group '%s' on topic '%s' not found, nothing for host %s:%d to "
+             "leave",
+             name, topic, inet_ntoa(sub_address->sin_addr),
+             ntohs(sub_address->sin_port));
+    log_line(LOG_LEVEL_INFO, log_buffer);
+    return 0;
+  }
+  g = &groups[group_id];
+
+  // search member via IP address and port
+  for (index = 0; index < g->member_count; index++) {
+    if (subscribers[g->member_ids[index]].address ==
+            sub_address->sin_addr.s_addr &&
+        subscribers[g->member_ids[index]].port == sub_address->sin_port) {
+      break;
+    }
+  }
+  if (index == g->member_count) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d was not a member of group '%s' on topic '%s', nothing "
+             "to do",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             name, topic);
+    log_line(LOG_LEVEL_INFO, log_buffer);
+    return 0;
+  }
+
+  remove_group_member(g, index);
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Host %s:%d has left group '%s' on topic '%s'",
+           inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+           name, topic);
+  log_line(LOG_LEVEL_INFO, log_buffer);
+
+  // in addition, check if the group and then the topic are now unused
+  remove_unused_group(group_id);
+  remove_unused_topic(topic_id);
+  return 0;
+}
+
+/**
+ * Unsubscribes all subscribers that were marked for disconnection from all of
+ * their topics and groups
+ */
+void disconnect_slow_subscribers() {
+  int topic_id, group_id, index;
+  group *g;
+
+  for (group_id = 0; group_id < groups_length; group_id++) {
+    g = &groups[group_id];
+    if (g->topic_id == empty_topic_id) {
+      continue;
+    }
+    for (index = 0; index < g->member_count;) {
+      if (!subscribers[g->member_ids[index]].disconnect_pending) {
+        index++;
+        continue;
+      }
+
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Host %s:%d has dropped too many messages, removing it from "
+               "group '%s' on topic '%s'",
+               inet_ntoa((struct in_addr){
+                   subscribers[g->member_ids[index]].address}),
+               ntohs(subscribers[g->member_ids[index]].port), g->name,
+               topic_names[g->topic_id]);
+      log_line(LOG_LEVEL_WARNING, log_buffer);
+
+      // the last member is moved into the current slot, so the index is not
+      // advanced
+      remove_group_member(g, index);
+    }
+    // the topic is removed by the loop below if it is unused as well
+    remove_unused_group(group_id);
+  }
+
+  for (topic_id = 0; topic_id < topic_subs_map_length; topic_id++) {
+    for (index = 0; index < topic_subs_map[topic_id].sub_count;) {
+      if (!subscribers[topic_subs_map[topic_id].sub_ids[index]]
+               .disconnect_pending) {
+        index++;
+        continue;
+      }
+
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Host %s:%d has dropped too many messages, unsubscribing it "
+               "from topic '%s'",
+               inet_ntoa((struct in_addr){
+                   topic_subs_map[topic_id].sub_addresses[index]}),
+               ntohs(topic_subs_map[topic_id].sub_ports[index]),
+               topic_names[topic_id]);
+      log_line(LOG_LEVEL_WARNING, log_buffer);
+
+      // the last subscriber is moved into the current slot, so the index is
+      // not advanced
+      remove_subscriber(&topic_subs_map[topic_id], index);
+    }
+    remove_unused_topic(topic_id);
+  }
+}
+
+/**
+ * Logs the request and message counters of the broker, followed by the number
+ * of subscriptions, queued messages and dropped messages of every subscriber
+ */
+void log_stats() {
+  struct xdp_statistics xdp_stats;
+  socklen_t optlen;
+  subscriber *sub;
+  unsigned long kernel_drop_count;
+  long long now_ms;
+  int sub_id, i;
+
+  // every socket of the workers counts its own drops
+  kernel_drop_count = 0;
+  for (i = 0; i < worker_count; i++) {
+    kernel_drop_count +=
+        __atomic_load_n(&workers[i].kernel_drop_count, __ATOMIC_RELAXED);
+  }
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Broker: %lu received requests, %lu requests dropped by kernel, %lu "
+           "requests rate limited, %lu sent messages, %lu dropped messages",
+           __atomic_load_n(&received_request_count, __ATOMIC_RELAXED),
+           kernel_drop_count, limited_request_count,
+           __atomic_load_n(&sent_message_count, __ATOMIC_RELAXED) +
+               __atomic_load_n(&chunk_sent_message_count, __ATOMIC_RELAXED),
+           dropped_message_count);
+  fprintln_and_log(stderr, log_buffer);
+
+  // requests that arrive while the receive ring of the AF_XDP fast path is
+  // full are dropped without reaching the kernel drop count
+  optlen = sizeof(xdp_stats);
+  if (xdp_worker.xdp != NULL &&
+      getsockopt(xdp_worker.xdp->xsk_fd, SOL_XDP, XDP_STATISTICS, &xdp_stats,
+                 &optlen) == 0) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "XDP: %llu requests dropped, %llu requests dropped due to full "
+             "receive ring",
+             (unsigned long long)xdp_stats.rx_dropped,
+             (unsigned long long)xdp_stats.rx_ring_full);
+    fprintln_and_log(stderr, log_buffer);
+  }
+
+  now_ms = get_time_ms();
+  for (i = 0; i < peer_count; i++) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Peer %s:%d: %lu forwarded messages, interest %s",
+             inet_ntoa(peers[i].address.sin_addr),
+             ntohs(peers[i].address.sin_port), peers[i].forwarded_count,
+             peers[i].announced_ms == 0 ? "never announced"
+             : now_ms - peers[i].announced_ms > PEER_TIMEOUT_MS ? "stale"
+                                                                 : "current");
+    fprintln_and_log(stderr, log_buffer);
+  }
+
+  for (sub_id = 0; sub_id < subscribers_length; sub_id++) {
+    sub = &subscribers[sub_id];
+    if (sub->topic_count == 0) {
+      continue;
+    }
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d: %d subscribed topics, %d queued messages, %lu "
+             "dropped messages",
+             inet_ntoa((struct in_addr){sub->address}), ntohs(sub->port),
+             sub->topic_count, sub->queue_length, sub->drop_count);
+    fprintln_and_log(stderr, log_buffer);
+  }
+}
+
+/**
+ * Signal handler that requests subscriber statistics to be logged by the main
+ * loop
+ */
+void handle_stats_signal(int signal) { stats_requested = 1; }
+
+/**
+ * Sets the provided socket option to the provided value, if the value is not 0
+ *
+ * If a privileged option is provided, it is attempted first and the regular
+ * option is used as fallback if the broker lacks the necessary permissions.
+ *
+ * Returns 0 if the option could be set without issues, otherwise returns 1
+ */
+int set_socket_option(int sock_fd, int level, int privileged_option,
+                      int option, const char *option_name, int value) {
+  char option_str[64];
+
+  if (value == 0) {
+    return 0;
+  }
+
+  if (privileged_option != 0 &&
+      setsockopt(sock_fd, level, privileged_option, &value, sizeof(value)) ==
+          0) {
+    return 0;
+  }
+
+  if (setsockopt(sock_fd, level, option, &value, sizeof(value)) != 0) {
+    snprintf(option_str, sizeof(option_str), "setsockopt %s", option_name);
+    perror(option_str);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Applies the configured settings to the provided broker socket and enables
+ * reporting of requests that were dropped by the kernel
+ *
+ * Returns 0 if all settings could be applied without issues, otherwise
+ * returns 1
+ */
+int configure_socket(int sock_fd) {
+  socklen_t value_size;
+  int enable, rcvbuf, sndbuf;
+
+  if (set_socket_option(sock_fd, SOL_SOCKET, SO_RCVBUFFORCE, SO_RCVBUF,
+                        "SO_RCVBUF", receive_buffer_size) != 0 ||
+      set_socket_option(sock_fd, SOL_SOCKET, SO_SNDBUFFORCE, SO_SNDBUF,
+                        "SO_SNDBUF", send_buffer_size) != 0 ||
+      set_socket_option(sock_fd, SOL_SOCKET, 0, SO_BUSY_POLL, "SO_BUSY_POLL",
+                        busy_poll_usecs) != 0 ||
+      set_socket_option(sock_fd, IPPROTO_IP, 0, IP_TOS, "IP_TOS",
+                        type_of_service) != 0) {
+    return 1;
+  }
+
+  enable = 1;
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable)) !=
+      0) {
+    perror("setsockopt SO_RXQ_OVFL");
+    return 1;
+  }
+
+  // log the effective buffer sizes, the kernel may double or cap the
+  // requested values
+  value_size = sizeof(rcvbuf);
+  getsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, &value_size);
+  value_size = sizeof(sndbuf);
+  getsockopt(sock_fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, &value_size);
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Socket receive buffer is %d bytes, send buffer is %d bytes", rcvbuf,
+           sndbuf);
+  log_line(LOG_LEVEL_INFO, log_buffer);
+
+  return 0;
+}
+
+/**
+ * Updates the kernel drop count of the provided worker from the ancillary data
+ * of the provided received message, if it is contained
+ */
+void update_kernel_drop_count(struct msghdr *msg, worker *self) {
+  struct cmsghdr *cmsg;
+  uint32_t count;
+
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+      memcpy(&count, CMSG_DATA(cmsg), sizeof(count));
+      __atomic_store_n(&self->kernel_drop_count, count, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+/**
+ * Returns the size of the requests that the kernel coalesced into the provided
+ * received message (UDP GRO), or 0 if it contains a single request
+ */
+int get_segment_size(struct msghdr *msg) {
+  struct cmsghdr *cmsg;
+  int segment_size = 0;
+
+  for (cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+      memcpy(&segment_size, CMSG_DATA(cmsg), sizeof(segment_size));
+    }
+  }
+
+  return segment_size;
+}
+
+/**
+ * Parses the provided string as a non-negative integer that must not exceed
+ * the provided maximum
+ *
+ * Returns the parsed value, or -1 if the string is not a valid value
+ */
+int parse_int_argument(const char *str, long max) {
+  char *end;
+  long value;
+
+  value = strtol(str, &end, 10);
+  if (end == str || *end != '\0' || value < 0 || value > max) {
+    return -1;
+  }
+  return (int)value;
+}
+
+/**
+ * Parses the provided rate limit in the format RATE[:BURST] into the provided
+ * rate limit, where the burst defaults to the rate
+ *
+ * Returns 0 if the rate limit is valid, otherwise returns 1
+ */
+int parse_rate_limit(const char *str, rate_limit *limit) {
+  char rate[CONFIG_LINE_LENGTH];
+  char *burst;
+
+  snprintf(rate, sizeof(rate), "%s", str);
+  if ((burst = strchr(rate, ':')) != NULL) {
+    *burst++ = '\0';
+  }
+  if ((limit->rate = parse_int_argument(rate, INT32_MAX)) < 0) {
+    return 1;
+  }
+  limit->burst = limit->rate;
+  if (burst != NULL &&
+      (limit->burst = parse_int_argument(burst, INT32_MAX)) < 1) {
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Parses the provided list of CPUs, which consists of comma separated CPU
+ * numbers or ranges such as 0,2-3, into the provided CPU set
+ *
+ * Returns 0 if the list is valid, otherwise returns 1
+ */
+int parse_cpu_list(const char *str, cpu_set_t *cpus) {
+  char *end;
+  long first, last;
+
+  CPU_ZERO(cpus);
+  do {
+    first = strtol(str, &end, 10);
+    if (end == str || first < 0 || first >= CPU_SETSIZE) {
+      return 1;
+    }
+    last = first;
+    if (*end == '-') {
+      str = end + 1;
+      last = strtol(str, &end, 10);
+      if (end == str || last < first || last >= CPU_SETSIZE) {
+        return 1;
+      }
+    }
+    for (; first <= last; first++) {
+      CPU_SET(first, cpus);
+    }
+    str = end + 1;
+  } while (*end == ',');
+
+  return *end == '\0' ? 0 : 1;
+}
+
+/**
+ * Program call arguments, the long names are also used as setting names in the
+ * configuration file
+ */
+const struct option setting_options[] = {
+    {"config", required_argument, NULL, 'c'},
+    {"listen", required_argument, NULL, 'l'},
+    {"port", required_argument, NULL, 'P'},
+    {"topics", required_argument, NULL, 'T'},
+    {"topic-subscribers", required_argument, NULL, 'S'},
+    {"subscribers", required_argument, NULL, 'N'},
+    {"filters", required_argument, NULL, 'F'},
+    {"groups", required_argument, NULL, 'G'},
+    {"group-policy", required_argument, NULL, 'g'},
+    {"group-key", required_argument, NULL, 'k'},
+    {"queue-length", required_argument, NULL, 'Q'},
+    {"policy", required_argument, NULL, 'p'},
+    {"disconnect-drops", required_argument, NULL, 'n'},
+    {"rcvbuf", required_argument, NULL, 'r'},
+    {"sndbuf", required_argument, NULL, 's'},
+    {"busy-poll", required_argument, NULL, 'b'},
+    {"tos", required_argument, NULL, 't'},
+    {"receive-batch", required_argument, NULL, 'R'},
+    {"send-batch", required_argument, NULL, 'B'},
+    {"log-level", required_argument, NULL, 'L'},
+    {"log-file", required_argument, NULL, 'f'},
+    {"workers", required_argument, NULL, 'w'},
+    {"cpus", required_argument, NULL, 'a'},
+    {"incoming-cpu", required_argument, NULL, 'i'},
+    {"io-backend", required_argument, NULL, 'u'},
+    {"xdp", required_argument, NULL, 'X'},
+    {"xdp-queue", required_argument, NULL, 'q'},
+    {"peers", required_argument, NULL, 'C'},
+    {"client-rate", required_argument, NULL, 'e'},
+    {"topic-rate", required_argument, NULL, 'E'},
+    {"source-subscriptions", required_argument, NULL, 'm'},
+    {"max-memory", required_argument, NULL, 'M'},
+    {"verify-subscribers", required_argument, NULL, 'V'},
+    {"udp-offload", required_argument, NULL, 'O'},
+    {"shared-memory", required_argument, NULL, 'H'},
+    {"unix-socket", required_argument, NULL, 'U'},
+    {"fanout-chunk", required_argument, NULL, 'K'},
+    {NULL, 0, NULL, 0}};
+const char *setting_short_options =
+    "c:l:P:T:S:N:F:G:g:k:Q:p:n:r:s:b:t:R:B:L:f:w:a:i:u:X:q:C:e:E:m:M:V:O:H:U:"
+    "K:";
+
+/**
+ * Parses the provided comma separated list of peers in the format
+ * address[:port], where the port defaults to the broker port, into the peer
+ * table
+ *
+ * Returns 0 if the list is valid, otherwise returns 1
+ */
+int parse_peer_list(const char *str) {
+  char entry[INET_ADDRSTRLEN + 8];
+  const char *end;
+  char *port;
+  int length, port_number;
+  peer *p;
+
+  peer_count = 0;
+  do {
+    end = strchr(str, ',');
+    length = end != NULL ? end - str : (int)strlen(str);
+    if (length == 0 || length >= (int)sizeof(entry) ||
+        peer_count == MAX_PEERS) {
+      return 1;
+    }
+    memcpy(entry, str, length);
+    entry[length] = '\0';
+
+    p = &peers[peer_count++];
+    memset((void *)p, 0, sizeof(*p));
+    p->address.sin_family = AF_INET;
+    port_number = broker_port;
+    if ((port = strchr(entry, ':')) != NULL) {
+      *port++ = '\0';
+      if ((port_number = parse_int_argument(port, UINT16_MAX)) < 1) {
+        return 1;
+      }
+    }
+    p->address.sin_port = htons(port_number);
+    if (inet_pton(AF_INET, entry, &p->address.sin_addr) != 1) {
+      return 1;
+    }
+    str = end + 1;
+  } while (end != NULL);
+
+  return 0;
+}
+
+/**
+ * Determines whether the provided number is a prime number
+ */
+bool is_prime(int number) {
+  int divisor;
+
+  if (number < 2) {
+    return false;
+  }
+  for (divisor = 2; divisor * divisor <= number; divisor++) {
+    if (number % divisor == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Prints the call pattern of the program with all available settings
+ */
+void print_usage(const char *program) {
+  fprintf(
+      stderr,
+      "Invalid call pattern. Expected pattern is:\n%s [options]\n"
+      "  -c, --config FILE            read settings from FILE\n"
+      "  -l, --listen ADDRESS         IPv4 address to listen on (0.0.0.0)\n"
+      "  -P, --port PORT              port to listen on (%d)\n"
+      "  -T, --topics N               maximum number of topics (10)\n"
+      "  -S, --topic-subscribers N    maximum subscribers per topic (10)\n"
+      "  -N, --subscribers N          maximum distinct subscribers (topics * "
+      "topic-subscribers)\n"
+      "  -F, --filters N              maximum distinct filters (64)\n"
+      "  -G, --groups N               maximum subscriber groups (16)\n"
+      "  -g, --group-policy POLICY    round-robin, least-recent or hash\n"
+      "  -k, --group-key KEY          message field hashed by the hash policy\n"
+      "  -Q, --queue-length N         egress queue length per subscriber (8)\n"
+      "  -p, --policy POLICY          drop-oldest, drop-newest or disconnect\n"
+      "  -n, --disconnect-drops N     drops before disconnecting (100)\n"
+      "  -r, --rcvbuf BYTES           socket receive buffer size\n"
+      "  -s, --sndbuf BYTES           socket send buffer size\n"
+      "  -b, --busy-poll USECS        busy poll time for requests\n"
+      "  -t, --tos TOS                IP type of service byte\n"
+      "  -R, --receive-batch N        requests received per system call (32)\n"
+      "  -B, --send-batch N           messages sent per system call (64)\n"
+      "  -L, --log-level LEVEL        error, warning, info or debug (debug)\n"
+      "  -f, --log-file FILE          log file or none (smbbroker.log)\n"
+      "  -w, --workers N              number of worker threads (1)\n"
+      "  -a, --cpus LIST              CPUs to pin the workers to, e.g. 0,2-3\n"
+      "  -i, --incoming-cpu yes|no    steer requests to the worker on the CPU\n"
+      "                               that processed them in the kernel (no)\n"
+      "  -u, --io-backend BACKEND     poll or io_uring (poll)\n"
+      "  -X, --xdp INTERFACE          receive publishes on INTERFACE through\n"
+      "                               AF_XDP (experimental)\n"
+      "  -q, --xdp-queue N            queue of INTERFACE to use for AF_XDP (0)\n"
+      "  -C, --peers LIST             other brokers of the cluster, e.g.\n"
+      "                               10.0.0.2:8080,10.0.0.3\n"
+      "  -e, --client-rate N[:BURST]  requests per second per client address\n"
+      "                               (0, unlimited)\n"
+      "  -E, --topic-rate N[:BURST]   publishes per second per topic (0)\n"
+      "  -m, --source-subscriptions N subscriptions per client address\n"
+      "                               (0, unlimited)\n"
+      "  -M, --max-memory MIB         maximum memory of all tables (0)\n"
+      "  -V, --verify-subscribers yes|no\n"
+      "                               require subscribers to return a cookie\n"
+      "                               (no)\n"
+      "  -O, --udp-offload yes|no     coalesce received requests (UDP GRO)\n"
+      "                               and queued messages (UDP GSO) (no)\n"
+      "  -H, --shared-memory yes|no   deliver messages to local subscribers\n"
+      "                               through shared memory rings (no)\n"
+      "  -U, --unix-socket PATH       also receive requests of local clients\n"
+      "                               on a Unix domain socket at PATH\n"
+      "  -K, --fanout-chunk N         split fan-outs to more than N hosts\n"
+      "                               into chunks that all workers send\n"
+      "                               (1024, 0 keeps them on one worker)\n",
+      program, broker_port);
+}
+
+/**
+ * Applies the provided value to the setting that corresponds to the provided
+ * short option character
+ *
+ * Returns 0 if the value is valid, otherwise returns 1
+ */
+int apply_setting(int option, const char *value) {
+  struct in_addr address;
+  int i;
+
+  switch (option) {
+  case 'l':
+    if (inet_pton(AF_INET, value, &address) != 1) {
+      fprintf(stderr, "Invalid listen address '%s'\n", value);
+      return 1;
+    }
+    strcpy(listen_address, value);
+    return 0;
+  case 'P':
+    if ((listen_port = parse_int_argument(value, UINT16_MAX)) < 0) {
+      fprintf(stderr, "Invalid port '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'T':
+    // the wildcard topic always occupies one entry
+    if ((topic_subs_map_length = parse_int_argument(value, 1 << 20)) < 2) {
+      fprintf(stderr, "Invalid number of topics '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'S':
+    if ((sub_addresses_length = parse_int_argument(value, 1 << 20)) < 1) {
+      fprintf(stderr, "Invalid number of subscribers per topic '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'N':
+    if ((subscribers_length = parse_int_argument(value, 1 << 24)) < 1) {
+      fprintf(stderr, "Invalid number of subscribers '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'F':
+    if ((filters_length = parse_int_argument(value, 1 << 20)) < 1) {
+      fprintf(stderr, "Invalid number of filters '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'G':
+    if ((groups_length = parse_int_argument(value, 1 << 20)) < 1) {
+      fprintf(stderr, "Invalid number of groups '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'g':
+    for (i = 0; i <= GROUP_HASH; i++) {
+      if (strcmp(value, group_policy_names[i]) == 0) {
+        selected_group_policy = (group_policy)i;
+        return 0;
+      }
+    }
+    fprintf(stderr, "Unknown group policy '%s'\n", value);
+    return 1;
+  case 'k':
+    // the key must be usable as the key of a field filter
+    if (strlen(value) == 0 || strlen(value) >= FILTER_LENGTH ||
+        strpbrk(value, "=<>,!") != NULL) {
+      fprintf(stderr, "Invalid group key '%s'\n", value);
+      return 1;
+    }
+    group_key_length = sprintf(group_key, "%s=", value);
+    return 0;
+  case 'Q':
+    if ((egress_queue_length = parse_int_argument(value, 1 << 16)) < 1) {
+      fprintf(stderr, "Invalid egress queue length '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'p':
+    for (i = 0; i <= EGRESS_DISCONNECT; i++) {
+      if (strcmp(value, egress_policy_names[i]) == 0) {
+        overflow_policy = (egress_policy)i;
+        return 0;
+      }
+    }
+    fprintf(stderr, "Unknown egress policy '%s'\n", value);
+    return 1;
+  case 'n':
+    if ((i = parse_int_argument(value, INT32_MAX)) < 1) {
+      fprintf(stderr, "Invalid number of drops '%s'\n", value);
+      return 1;
+    }
+    disconnect_drops = i;
+    return 0;
+  case 'r':
+    if ((receive_buffer_size = parse_int_argument(value, INT32_MAX)) < 0) {
+      fprintf(stderr, "Invalid receive buffer size '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 's':
+    if ((send_buffer_size = parse_int_argument(value, INT32_MAX)) < 0) {
+      fprintf(stderr, "Invalid send buffer size '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'b':
+    if ((busy_poll_usecs = parse_int_argument(value, INT32_MAX)) < 0) {
+      fprintf(stderr, "Invalid busy poll time '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 't':
+    if ((type_of_service = parse_int_argument(value, UINT8_MAX)) < 0) {
+      fprintf(stderr, "Invalid type of service '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'R':
+    if ((receive_batch_size = parse_int_argument(value, 1024)) < 1) {
+      fprintf(stderr, "Invalid receive batch size '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'B':
+    if ((send_batch_size = parse_int_argument(value, 1024)) < 1) {
+      fprintf(stderr, "Invalid send batch size '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'L':
+    for (i = 0; i <= LOG_LEVEL_DEBUG; i++) {
+      if (strcmp(value, log_level_names[i]) == 0) {
+        max_log_level = (log_level)i;
+        return 0;
+      }
+    }
+    fprintf(stderr, "Unknown log level '%s'\n", value);
+    return 1;
+  case 'f':
+    log_file_name = strdup(value);
+    return 0;
+  case 'w':
+    if ((worker_count = parse_int_argument(value, CPU_SETSIZE)) < 1) {
+      fprintf(stderr, "Invalid number of workers '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'K':
+    if ((fanout_chunk_size = parse_int_argument(value, 1 << 16)) < 0) {
+      fprintf(stderr, "Invalid fan-out chunk size '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'a':
+    if (parse_cpu_list(value, &cpu_affinity) != 0) {
+      fprintf(stderr, "Invalid CPU list '%s'\n", value);
+      return 1;
+    }
+    cpu_affinity_set = true;
+    return 0;
+  case 'i':
+    if (strcmp(value, "yes") != 0 && strcmp(value, "no") != 0) {
+      fprintf(stderr, "Invalid incoming CPU setting '%s'\n", value);
+      return 1;
+    }
+    incoming_cpu = strcmp(value, "yes") == 0;
+    return 0;
+  case 'u':
+    for (i = 0; i <= IO_BACKEND_IO_URING; i++) {
+      if (strcmp(value, io_backend_names[i]) == 0) {
+        selected_io_backend = (io_backend)i;
+        return 0;
+      }
+    }
+    fprintf(stderr, "Unknown I/O backend '%s'\n", value);
+    return 1;
+  case 'X':
+    if (strlen(value) >= IF_NAMESIZE) {
+      fprintf(stderr, "Invalid interface name '%s'\n", value);
+      return 1;
+    }
+    strcpy(xdp_interface, value);
+    return 0;
+  case 'q':
+    if ((xdp_queue = parse_int_argument(value, 1 << 16)) < 0) {
+      fprintf(stderr, "Invalid interface queue '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'C':
+    if (parse_peer_list(value) != 0) {
+      fprintf(stderr, "Invalid peer list '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'm':
+    if ((source_subscription_limit = parse_int_argument(value, INT_MAX)) < 0) {
+      fprintf(stderr, "Invalid subscription limit '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'M':
+    if ((max_table_memory = parse_int_argument(value, INT_MAX)) < 0) {
+      fprintf(stderr, "Invalid memory limit '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  case 'V':
+    if (strcmp(value, "yes") != 0 && strcmp(value, "no") != 0) {
+      fprintf(stderr, "Invalid subscriber verification setting '%s'\n",
+              value);
+      return 1;
+    }
+    verify_subscribers = strcmp(value, "yes") == 0;
+    return 0;
+  case 'O':
+    if (strcmp(value, "yes") != 0 && strcmp(value, "no") != 0) {
+      fprintf(stderr, "Invalid UDP offload setting '%s'\n", value);
+      return 1;
+    }
+    udp_offload = strcmp(value, "yes") == 0;
+    request_buffer_size = udp_offload ? GRO_BUFFER_SIZE : MESSAGE_BUFFER_SIZE;
+    return 0;
+  case 'H':
+    if (strcmp(value, "yes") != 0 && strcmp(value, "no") != 0) {
+      fprintf(stderr, "Invalid shared memory setting '%s'\n", value);
+      return 1;
+    }
+    shared_memory = strcmp(value, "yes") == 0;
+    return 0;
+  case 'U':
+    if (strlen(value) == 0 || strlen(value) >= UNIX_PATH_LENGTH) {
+      fprintf(stderr, "Invalid Unix socket path '%s'\n", value);
+      return 1;
+    }
+    strcpy(unix_socket_path, value);
+    return 0;
+  case 'e':
+  case 'E':
+    if (parse_rate_limit(value, option == 'e' ? &client_limit
+                                              : &topic_limit) != 0) {
+      fprintf(stderr, "Invalid rate limit '%s'\n", value);
+      return 1;
+    }
+    return 0;
+  default:
+    return 1;
+  }
+}
+
+/**
+ * Removes leading and trailing whitespace from the provided string in place
+ *
+ * Returns a pointer to the first non-whitespace character
+ */
+char *trim(char *str) {
+  char *end;
+
+  while (isspace((unsigned char)*str)) {
+    str++;
+  }
+  end = str + strlen(str);
+  while (end > str && isspace((unsigned char)end[-1])) {
+    end--;
+  }
+  *end = '\0';
+  return str;
+}
+
+/**
+ * Reads settings from the configuration file with the provided name
+ *
+ * Returns 0 if all settings in the file are valid, otherwise returns 1
+ */
+int read_config_file(const char *file_name) {
+  FILE *config_file;
+  char line[CONFIG_LINE_LENGTH];
+  char *name, *value, *delim;
+  int line_number, i, result;
+
+  config_file = fopen(file_name, "r");
+  if (config_file == NULL) {
+    perror(file_name);
+    return 1;
+  }
+
+  result = 0;
+  for (line_number = 1; fgets(line, sizeof(line), config_file) != NULL;
+       line_number++) {
+    name = trim(line);
+    if (*name == '\0' || *name == '#') {
+      continue;
+    }
+
+    // split line into setting name and value
+    delim = strchr(name, '=');
+    if (delim == NULL) {
+      fprintf(stderr, "%s:%d: expected 'name = value'\n", file_name,
+              line_number);
+      result = 1;
+      continue;
+    }
+    *delim = '\0';
+    value = trim(delim + 1);
+    name = trim(name);
+
+    // look up setting by the long name of its program call argument, the
+    // configuration file itself can not be set from within it
+    for (i = 1; setting_options[i].name != NULL; i++) {
+      if (strcmp(name, setting_options[i].name) == 0) {
+        break;
+      }
+    }
+    if (setting_options[i].name == NULL) {
+      fprintf(stderr, "%s:%d: unknown setting '%s'\n", file_name, line_number,
+              name);
+      result = 1;
+    } else if (apply_setting(setting_options[i].val, value) != 0) {
+      fprintf(stderr, "%s:%d: invalid value for setting '%s'\n", file_name,
+              line_number, name);
+      result = 1;
+    }
+  }
+
+  fclose(config_file);
+  return result;
+}
+
+/**
+ * Parses the program call arguments and the configuration file into the
+ * corresponding settings
+ *
+ * The configuration file is read first, so that program call arguments take
+ * precedence over it.
+ *
+ * Returns 0 if all settings are valid, otherwise returns 1
+ */
+int parse_arguments(int argc, char **argv) {
+  int option;
+
+  listen_port = broker_port;
+
+  // first only look for a configuration file
+  while ((option = getopt_long(argc, argv, setting_short_options,
+                               setting_options, NULL)) != -1) {
+    if (option == '?') {
+      return 1;
+    }
+    if (option == 'c' && read_config_file(optarg) != 0) {
+      return 1;
+    }
+  }
+  if (optind != argc) {
+    return 1;
+  }
+
+  // then apply all other arguments
+  optind = 1;
+  while ((option = getopt_long(argc, argv, setting_short_options,
+                               setting_options, NULL)) != -1) {
+    if (option != 'c' && apply_setting(option, optarg) != 0) {
+      return 1;
+    }
+  }
+
+  if (subscribers_length == 0) {
+    subscribers_length = topic_subs_map_length * sub_addresses_length;
+  }
+
+  // keep the topic index at most half full, so that probe sequences stay short
+  for (topic_index_length = 1; topic_index_length < 2 * topic_subs_map_length;
+       topic_index_length *= 2) {
+  }
+
+  // give every member of a group about eight lookup slots, groups with more
+  // than 8192 members share a table of fewer slots than eight per member
+  group_lookup_length = 8 * (sub_addresses_length < 8192 ? sub_addresses_length
+                                                         : 8192) +
+                        1;
+  while (!is_prime(group_lookup_length)) {
+    group_lookup_length += 2;
+  }
+
+  return 0;
+}
+
+/**
+ * Allocates all tables according to the configured capacities and initializes
+ * them to be recognizably empty
+ *
+ * Returns 0 if all tables could be allocated, otherwise returns 1
+ */
+int allocate_tables() {
+  fanout_chunk *chunks;
+  fanout_job *jobs;
+  struct sockaddr_in *chunk_addrs;
+  bool *chunk_framed;
+  in_addr_t *sub_addresses;
+  in_port_t *sub_ports;
+  int *sub_ids, *sub_filter_ids;
+  int *member_ids, *lru_prev, *lru_next, *lookup;
+  uint32_t *member_hashes;
+  message_buffer **messages, *buffers;
+  rate_bucket *buckets;
+  size_t topic_entries, queue_entries, buffer_count, member_entries;
+  size_t lookup_entries, chunk_entries, table_memory;
+  int chunk_count, i;
+
+  topic_entries = (size_t)topic_subs_map_length * sub_addresses_length;
+  queue_entries = (size_t)subscribers_length * egress_queue_length;
+  member_entries = (size_t)groups_length * sub_addresses_length;
+  // only the hash policy uses lookup tables
+  lookup_entries = selected_group_policy == GROUP_HASH
+                       ? (size_t)groups_length * group_lookup_length
+                       : 0;
+  // besides the buffers in egress queues, every thread may cache buffers and
+  // hold one buffer per format of the message it is currently forwarding
+  buffer_count = queue_entries + (size_t)(worker_count + 2) *
+                                     (MESSAGE_CACHE_SIZE + 2);
+  // fan-outs are only split if there are other workers to send the chunks
+  chunk_count = worker_count > 1 && fanout_chunk_size > 0
+                    ? FANOUT_LANES * FANOUT_CHUNKS_PER_LANE
+                    : 0;
+  chunk_entries = (size_t)chunk_count * fanout_chunk_size;
+  // clients of the Unix domain socket are numbered by port, twice as many
+  // entries as subscribers leave room for clients that only publish
+  unix_endpoints_length = 0;
+  unix_endpoint_index_length = 0;
+  if (unix_socket_path[0] != '\0') {
+    unix_endpoints_length = subscribers_length < UINT16_MAX / 2
+                                ? 2 * subscribers_length
+                                : UINT16_MAX;
+    // keep the endpoint index at most half full, like the topic index
+    for (unix_endpoint_index_length = 1;
+         unix_endpoint_index_length < 2 * unix_endpoints_length;
+         unix_endpoint_index_length *= 2) {
+    }
+  }
+
+  // refuse capacities whose tables would exceed the memory limit
+  table_memory =
+      topic_subs_map_length *
+          (sizeof(*topic_names) + sizeof(*topic_hashes) +
+           sizeof(*topic_pinned) + sizeof(*topic_subs_map) +
+           sizeof(*stale_topic_ids)) +
+      topic_index_length * sizeof(*topic_index) +
+      topic_entries * (sizeof(*sub_addresses) + sizeof(*sub_ports) +
+                       sizeof(*sub_ids) + sizeof(*sub_filter_ids)) +
+      filters_length * sizeof(*filters) + groups_length * sizeof(*groups) +
+      member_entries * (sizeof(*member_ids) + sizeof(*member_hashes) +
+                        sizeof(*lru_prev) + sizeof(*lru_next)) +
+      lookup_entries * sizeof(*lookup) +
+      subscribers_length * sizeof(*subscribers) +
+      unix_endpoints_length * sizeof(*unix_endpoints) +
+      unix_endpoint_index_length * sizeof(*unix_endpoint_index) +
+      chunk_count * (sizeof(*chunks) + sizeof(*jobs)) +
+      chunk_entries * (sizeof(*chunk_addrs) + sizeof(*chunk_framed)) +
+      queue_entries * sizeof(*messages) + buffer_count * sizeof(*buffers);
+  if (max_table_memory > 0 && table_memory > (size_t)max_table_memory << 20) {
+    fprintf(stderr,
+            "Tables require %zu MiB, which exceeds the memory limit of %d "
+            "MiB\n",
+            (table_memory >> 20) + 1, max_table_memory);
+    return 1;
+  }
+  // snapshots of topics are allocated as needed within the rest
+  if (max_table_memory > 0) {
+    snapshot_memory_limit = ((size_t)max_table_memory << 20) - table_memory;
+  }
+
+  topic_names = calloc(topic_subs_map_length, sizeof(*topic_names));
+  topic_hashes = calloc(topic_subs_map_length, sizeof(*topic_hashes));
+  topic_pinned = calloc(topic_subs_map_length, sizeof(*topic_pinned));
+  topic_index = malloc(topic_index_length * sizeof(*topic_index));
+  topic_subs_map = calloc(topic_subs_map_length, sizeof(*topic_subs_map));
+  stale_topic_ids = malloc(topic_subs_map_length * sizeof(*stale_topic_ids));
+  sub_addresses = malloc(topic_entries * sizeof(*sub_addresses));
+  sub_ports = calloc(topic_entries, sizeof(*sub_ports));
+  sub_ids = malloc(topic_entries * sizeof(*sub_ids));
+  sub_filter_ids = malloc(topic_entries * sizeof(*sub_filter_ids));
+  filters = calloc(filters_length, sizeof(*filters));
+  groups = calloc(groups_length, sizeof(*groups));
+  member_ids = malloc(member_entries * sizeof(*member_ids));
+  member_hashes = malloc(member_entries * sizeof(*member_hashes));
+  lru_prev = malloc(member_entries * sizeof(*lru_prev));
+  lru_next = malloc(member_entries * sizeof(*lru_next));
+  lookup = malloc((lookup_entries + 1) * sizeof(*lookup));
+  group_lookup_positions =
+      malloc(sub_addresses_length * sizeof(*group_lookup_positions));
+  subscribers = calloc(subscribers_length, sizeof(*subscribers));
+  messages = calloc(queue_entries, sizeof(*messages));
+  buffers = malloc(buffer_count * sizeof(*buffers));
+  workers = calloc(worker_count, sizeof(*workers));
+  buckets = calloc(2 * RATE_BUCKET_COUNT, sizeof(*buckets));
+  if (unix_endpoints_length > 0) {
+    unix_endpoints = calloc(unix_endpoints_length, sizeof(*unix_endpoints));
+    unix_endpoint_index =
+        malloc(unix_endpoint_index_length * sizeof(*unix_endpoint_index));
+  }
+  chunks = calloc(chunk_count, sizeof(*chunks));
+  jobs = calloc(chunk_count, sizeof(*jobs));
+  chunk_addrs = calloc(chunk_entries, sizeof(*chunk_addrs));
+  chunk_framed = calloc(chunk_entries, sizeof(*chunk_framed));
+  if (topic_names == NULL || topic_hashes == NULL || topic_pinned == NULL ||
+      topic_index == NULL || topic_subs_map == NULL ||
+      stale_topic_ids == NULL || sub_addresses == NULL || sub_ports == NULL ||
+      sub_ids == NULL || sub_filter_ids == NULL || filters == NULL ||
+      groups == NULL || member_ids == NULL ||
+      member_hashes == NULL || lru_prev == NULL || lru_next == NULL ||
+      lookup == NULL || group_lookup_positions == NULL ||
+      subscribers == NULL || messages == NULL || buffers == NULL ||
+      workers == NULL || buckets == NULL ||
+      (unix_endpoints_length > 0 &&
+       (unix_endpoints == NULL || unix_endpoint_index == NULL)) ||
+      (chunk_count > 0 && (chunks == NULL || jobs == NULL ||
+                           chunk_addrs == NULL || chunk_framed == NULL))) {
+    perror("malloc");
+    return 1;
+  }
+
+  // the subscriber arrays of all topics are slices of the same allocations
+  for (i = 0; i < topic_index_length; i++) {
+    topic_index[i] = empty_topic_id;
+  }
+  for (i = 0; i < unix_endpoint_index_length; i++) {
+    unix_endpoint_index[i] = -1;
+  }
+  for (i = 0; i < unix_endpoints_length; i++) {
+    append_free_unix_endpoint(i);
+  }
+  for (i = 0; i < (int)topic_entries; i++) {
+    sub_addresses[i] = empty_address;
+    sub_ids[i] = empty_subscriber_id;
+    sub_filter_ids[i] = empty_filter_id;
+  }
+  for (i = 0; i < topic_subs_map_length; i++) {
+    topic_subs_map[i].sub_addresses = &sub_addresses[i * sub_addresses_length];
+    topic_subs_map[i].sub_ports = &sub_ports[i * sub_addresses_length];
+    topic_subs_map[i].sub_ids = &sub_ids[i * sub_addresses_length];
+    topic_subs_map[i].sub_filter_ids =
+        &sub_filter_ids[i * sub_addresses_length];
+    topic_subs_map[i].first_group_id = empty_group_id;
+  }
+
+  // the same applies to the member arrays and lookup tables of all groups
+  for (i = 0; i < groups_length; i++) {
+    groups[i].topic_id = empty_topic_id;
+    groups[i].member_ids = &member_ids[i * sub_addresses_length];
+    groups[i].member_hashes = &member_hashes[i * sub_addresses_length];
+    groups[i].lru_prev = &lru_prev[i * sub_addresses_length];
+    groups[i].lru_next = &lru_next[i * sub_addresses_length];
+    groups[i].lookup = lookup_entries > 0
+                           ? &lookup[(size_t)i * group_lookup_length]
+                           : NULL;
+  }
+
+  // the same applies to the egress queues of all subscribers
+  for (i = 0; i < subscribers_length; i++) {
+    subscribers[i].address = empty_address;
+    subscribers[i].messages = &messages[i * egress_queue_length];
+  }
+  for (i = 0; i < (int)buffer_count; i++) {
+    buffers[i].next_free = message_pool;
+    message_pool = &buffers[i];
+  }
+  // the same applies to the destinations of the fan-out chunks, every chunk
+  // comes with a job since a job has at least one chunk
+  for (i = 0; i < chunk_count; i++) {
+    chunks[i].copied_addrs = &chunk_addrs[(size_t)i * fanout_chunk_size];
+    chunks[i].copied_framed = &chunk_framed[(size_t)i * fanout_chunk_size];
+    chunks[i].next = fanout_chunk_pool;
+    fanout_chunk_pool = &chunks[i];
+    jobs[i].next = fanout_job_pool;
+    fanout_job_pool = &jobs[i];
+  }
+  // reclamation of snapshots scans all jobs
+  fanout_jobs = jobs;
+  fanout_job_count = chunk_count;
+  client_limit.buckets = buckets;
+  topic_limit.buckets = &buckets[RATE_BUCKET_COUNT];
+
+  // already configure wildcard topic to ensure that it is always available
+  strcpy(topic_names[INDEX_WILDCARD_TOPIC], "#");
+  topic_hashes[INDEX_WILDCARD_TOPIC] = hash_topic("#");
+  insert_topic_index(INDEX_WILDCARD_TOPIC);
+  interned_topic_count = 1;
+  // messages are only published from snapshots once the wildcard topic has one
+  mark_topic_snapshot_stale(&topic_subs_map[INDEX_WILDCARD_TOPIC]);
+
+  return 0;
+}
+
+/**
+ * Maps the shared memory ring with the provided name and attaches it to the
+ * subscriber with the provided address, so that messages to the subscriber
+ * are written into the ring from now on
+ *
+ * The provided key has to match the key in the header of the ring, which only
+ * processes that can read the ring know, and a ring that is attached to
+ * another subscriber is refused, since two writers would overwrite each
+ * other's records.
+ *
+ * Returns 0 if the ring is attached, otherwise returns 1
+ */
+int attach_ring(const char *name, uint64_t key,
+                const struct sockaddr_in *sub_address) {
+  char path[RING_NAME_LENGTH + 2];
+  struct stat ring_stat;
+  ring_header *header;
+  subscriber *sub;
+  int sub_id, other_id, topic_id, ring_fd;
+  size_t i;
+
+  // only clients on the same host can share memory with the broker, and only
+  // processes of the same user can create rings that the broker maps
+  if (!shared_memory ||
+      ((ntohl(sub_address->sin_addr.s_addr) >> 24) != IN_LOOPBACKNET &&
+       !is_unix_client(sub_address))) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d requested a shared memory ring, which is only "
+             "available to local clients with -H yes",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port));
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+  for (i = 0; name[i] != '\0'; i++) {
+    if (!isalnum((unsigned char)name[i]) && name[i] != '-' && name[i] != '_') {
+      break;
+    }
+  }
+  if (name[i] != '\0' || i >= RING_NAME_LENGTH ||
+      strncmp(name, RING_NAME_PREFIX, strlen(RING_NAME_PREFIX)) != 0) {
+    log_line(LOG_LEVEL_WARNING, "Request contains invalid ring name");
+    return 1;
+  }
+
+  for (sub_id = 0; sub_id < subscribers_length; sub_id++) {
+    if (subscribers[sub_id].topic_count > 0 &&
+        subscribers[sub_id].address == sub_address->sin_addr.s_addr &&
+        subscribers[sub_id].port == sub_address->sin_port) {
+      break;
+    }
+  }
+  if (sub_id == subscribers_length) {
+    return 1;
+  }
+  sub = &subscribers[sub_id];
+  if (sub->ring != NULL) {
+    return 0;
+  }
+
+  snprintf(path, sizeof(path), "/%s", name);
+  if ((ring_fd = shm_open(path, O_RDWR, 0)) < 0) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE, "Failed to open ring '%s': %s",
+             name, strerror(errno));
+    log_line(LOG_LEVEL_ERROR, log_buffer);
+    return 1;
+  }
+  header = MAP_FAILED;
+  if (fstat(ring_fd, &ring_stat) == 0 && ring_stat.st_uid == geteuid() &&
+      (size_t)ring_stat.st_size > sizeof(*header)) {
+    header = mmap(NULL, ring_stat.st_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  ring_fd, 0);
+  }
+  close(ring_fd);
+  if (header == MAP_FAILED || header->magic != RING_MAGIC ||
+      header->capacity < RING_ALIGNMENT ||
+      (header->capacity & (header->capacity - 1)) != 0 ||
+      sizeof(*header) + header->capacity != (size_t)ring_stat.st_size ||
+      (sub->ring = malloc(sizeof(*sub->ring))) == NULL) {
+    if (header != MAP_FAILED) {
+      munmap(header, ring_stat.st_size);
+    }
+    snprintf(log_buffer, LOG_BUFFER_SIZE, "Ring '%s' is not a valid ring",
+             name);
+    log_line(LOG_LEVEL_ERROR, log_buffer);
+    return 1;
+  }
+  for (other_id = 0; other_id < subscribers_length; other_id++) {
+    if (other_id != sub_id && subscribers[other_id].ring != NULL &&
+        subscribers[other_id].ring->device == ring_stat.st_dev &&
+        subscribers[other_id].ring->inode == ring_stat.st_ino) {
+      break;
+    }
+  }
+  if (header->key != key || other_id < subscribers_length) {
+    munmap(header, ring_stat.st_size);
+    free(sub->ring);
+    sub->ring = NULL;
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Host %s:%d requested ring '%s' with a wrong key or while it is "
+             "attached to another subscriber",
+             inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+             name);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    return 1;
+  }
+
+  // continue after the records that a previous broker wrote
+  sub->ring->header = header;
+  sub->ring->size = ring_stat.st_size;
+  sub->ring->capacity = header->capacity;
+  sub->ring->head = __atomic_load_n(&header->head, __ATOMIC_ACQUIRE) &
+                    ~(uint64_t)(RING_ALIGNMENT - 1);
+  sub->ring->device = ring_stat.st_dev;
+  sub->ring->inode = ring_stat.st_ino;
+  // the subscriber is no longer sent datagrams from the snapshots of its topics
+  for (topic_id = 0; topic_id < topic_subs_map_length; topic_id++) {
+    if (find_subscriber(&topic_subs_map[topic_id], sub_address) >= 0) {
+      mark_topic_snapshot_stale(&topic_subs_map[topic_id]);
+    }
+  }
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Host %s:%d receives messages through shared memory ring '%s'",
+           inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
+           name);
+  log_line(LOG_LEVEL_INFO, log_buffer);
+  return 0;
+}
+
+/**
+ * Attempts to find the snapshot of the provided topic without holding the
+ * broker lock, by probing the topic index like find_topic_id() and comparing
+ * the name in the snapshot of every probed topic
+ *
+ * The result is not conclusive if a probed topic has no snapshot, or if the
+ * index changed during the lookup so that the topic may have been moved past
+ * it.
+ *
+ * Returns 0 if the lookup is conclusive, in which case the snapshot is set or
+ * NULL if the topic is not known, otherwise returns 1
+ */
+int find_topic_snapshot(const char *topic, const topic_snapshot **found) {
+  const topic_snapshot *snapshot;
+  unsigned long changes;
+  uint32_t hash, bucket;
+  int topic_id, result;
+
+  changes = __atomic_load_n(&topic_index_changes, __ATOMIC_SEQ_CST);
+  if (changes % 2 != 0) {
+    return 1;
+  }
+
+  result = 0;
+  hash = hash_topic(topic);
+  for (bucket = hash % topic_index_length;
+       (topic_id = __atomic_load_n(&topic_index[bucket], __ATOMIC_SEQ_CST)) !=
+       empty_topic_id;
+       bucket = (bucket + 1) % topic_index_length) {
+    snapshot =
+        __atomic_load_n(&topic_subs_map[topic_id].snapshot, __ATOMIC_SEQ_CST);
+    if (snapshot == NULL) {
+      result = 1;
+    } else if (snapshot->hash == hash &&
+               strncmp(snapshot->topic, topic, TOPIC_LENGTH) == 0) {
+      *found = snapshot;
+      return 0;
+    }
+  }
+
+  *found = NULL;
+  if (__atomic_load_n(&topic_index_changes, __ATOMIC_SEQ_CST) != changes) {
+    return 1;
+  }
+  return result;
+}
+
+/**
+ * Sends the provided message to the destinations of the provided snapshot
+ * without holding the broker lock
+ *
+ * Like in send_message(), more than fanout_chunk_size destinations, or
+ * destinations with chunks pending in their lane, are split into chunks, which
+ * are ranges of the snapshot. All others are passed to the kernel with
+ * sendmmsg, also by workers of the io_uring backend. Once the socket send
+ * buffer is full, the message is queued for all remaining destinations while
+ * holding the broker lock, unless their subscriber left since the snapshot was
+ * loaded.
+ */
+void send_snapshot_message(delivery *d, const topic_snapshot *snapshot,
+                           worker *self) {
+  struct sockaddr_in *dest_addrs = self->dest_addrs;
+  struct mmsghdr *dest_msgs = self->dest_msgs;
+  int count = snapshot->lane_offsets[FANOUT_LANES];
+  int sent, nsent, batch, lane, i;
+  subscriber *sub;
+  bool split;
+
+  split = fanout_event_fd >= 0 && count > fanout_chunk_size;
+  for (lane = 0; lane < FANOUT_LANES && fanout_event_fd >= 0 && !split;
+       lane++) {
+    split = snapshot->lane_offsets[lane + 1] > snapshot->lane_offsets[lane] &&
+            __atomic_load_n(&fanout_lanes[lane].pending, __ATOMIC_ACQUIRE) > 0;
+  }
+  if (split) {
+    schedule_snapshot_fanout(d, snapshot, self);
+    return;
+  }
+
+  if (snapshot->has_framed && d->iovs[0].iov_len == 0) {
+    build_delivery_header(d);
+  }
+  for (i = 0; i < count; i++) {
+    dest_addrs[i] = snapshot->dest_addrs[i];
+    dest_msgs[i].msg_hdr.msg_iov =
+        snapshot->framed[i] ? &d->iovs[0] : &d->iovs[1];
+    dest_msgs[i].msg_hdr.msg_iovlen = snapshot->framed[i] ? 2 : 1;
+  }
+
+  sent = 0;
+  while (sent < count) {
+    batch = count - sent < send_batch_size ? count - sent : send_batch_size;
+    nsent = sendmmsg(self->sock_fd, &dest_msgs[sent], batch, 0);
+    if (nsent <= 0 && is_send_buffer_full(errno)) {
+      pthread_mutex_lock(&broker_lock);
+      for (i = sent; i < count; i++) {
+        sub = &subscribers[snapshot->sub_ids[i]];
+        if (sub->topic_count > 0 &&
+            sub->address == dest_addrs[i].sin_addr.s_addr &&
+            sub->port == dest_addrs[i].sin_port) {
+          enqueue_message(snapshot->sub_ids[i], d);
+        }
+      }
+      if (disconnect_pending_count > 0) {
+        disconnect_slow_subscribers();
+      }
+      release_broker_lock();
+      return;
+    }
+    if (nsent <= 0) {
+      // the first message of the remaining batch could not be sent, skip it
+      perror("sendmmsg");
+      sent++;
+      continue;
+    }
+    sent += nsent;
+    __atomic_add_fetch(&sent_message_count, nsent, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * Attempts to publish the provided request without holding the broker lock,
+ * by sending it to the destinations of the snapshots of its topic and of the
+ * wildcard topic
+ *
+ * This only applies to valid publish requests whose delivery depends on
+ * nothing but the snapshots, which therefore have to hold every destination
+ * of their topic while no subscriber has queued messages. Rate limits, peers
+ * and debug logging also require the broker lock. The worker announces the
+ * current snapshot epoch while it reads the snapshots, so that they are not
+ * freed in the meantime.
+ *
+ * Returns true if the request was published, otherwise returns false if it
+ * has to be handled while holding the broker lock
+ */
+bool publish_unlocked(const char *request, worker *self) {
+  char topic[TOPIC_LENGTH];
+  const topic_snapshot *wildcard, *snapshot;
+  const char *start, *delim, *message;
+  unsigned long topic_id;
+  char *end;
+  delivery d;
+  bool by_id, found;
+
+  if (max_log_level >= LOG_LEVEL_DEBUG || client_limit.rate != 0 ||
+      topic_limit.rate != 0 || peer_count > 0 ||
+      __atomic_load_n(&queued_subscriber_count, __ATOMIC_RELAXED) > 0) {
+    return false;
+  }
+
+  // invalid requests are left to the handlers, which log them
+  by_id = strncmp(request, method_publish_id, strlen(method_publish_id)) == 0;
+  if (by_id) {
+    start = request + strlen(method_publish_id);
+  } else if (strncmp(request, method_publish, strlen(method_publish)) == 0) {
+    start = request + strlen(method_publish);
+  } else {
+    return false;
+  }
+  delim = strchr(start, msg_delim);
+  if (delim == NULL || delim == start || delim - start >= TOPIC_LENGTH) {
+    return false;
+  }
+  message = delim + 1;
+  if (*message == '\0' || strchr(message, msg_delim) != NULL) {
+    return false;
+  }
+  memcpy(topic, start, delim - start);
+  topic[delim - start] = '\0';
+  if (!by_id && strchr(topic, topic_wildcard) != NULL) {
+    return false;
+  }
+  topic_id = 0;
+  if (by_id) {
+    topic_id = strtoul(topic, &end, 10);
+    if (end == topic || *end != '\0' ||
+        topic_id >= (unsigned long)topic_subs_map_length ||
+        topic_id == INDEX_WILDCARD_TOPIC) {
+      return false;
+    }
+  }
+
+  // snapshots that are replaced after the epoch was announced are not freed
+  // before the worker announces another one
+  __atomic_store_n(&self->snapshot_epoch,
+                   __atomic_load_n(&snapshot_epoch, __ATOMIC_SEQ_CST),
+                   __ATOMIC_SEQ_CST);
+  wildcard = __atomic_load_n(&topic_subs_map[INDEX_WILDCARD_TOPIC].snapshot,
+                             __ATOMIC_SEQ_CST);
+  if (by_id) {
+    snapshot =
+        __atomic_load_n(&topic_subs_map[topic_id].snapshot, __ATOMIC_SEQ_CST);
+    found = snapshot != NULL;
+  } else {
+    found = find_topic_snapshot(topic, &snapshot) == 0;
+  }
+  if (!found || wildcard == NULL || !wildcard->complete ||
+      (snapshot != NULL && !snapshot->complete)) {
+    __atomic_store_n(&self->snapshot_epoch, 0, __ATOMIC_RELEASE);
+    return false;
+  }
+
+  d.sequence = __atomic_add_fetch(&message_sequence, 1, __ATOMIC_RELAXED);
+  d.topic = by_id ? snapshot->topic : topic;
+  d.message = message;
+  d.iovs[0].iov_len = 0;
+  d.iovs[1].iov_base = (void *)message;
+  d.iovs[1].iov_len = strlen(message);
+  d.shared[0] = NULL;
+  d.shared[1] = NULL;
+  send_snapshot_message(&d, wildcard, self);
+  if (snapshot != NULL) {
+    send_snapshot_message(&d, snapshot, self);
+  }
+  __atomic_store_n(&self->snapshot_epoch, 0, __ATOMIC_RELEASE);
+
+  // buffers are only acquired if the message was queued
+  if (d.shared[0] != NULL || d.shared[1] != NULL) {
+    pthread_mutex_lock(&broker_lock);
+    release_message_buffer(d.shared[0]);
+    release_message_buffer(d.shared[1]);
+    release_broker_lock();
+  }
+  return true;
+}
+
+/**
+ * Handles a single received request by passing it to the logic of its method
+ */
+void handle_request(char *request, const struct sockaddr_in *client_addr,
+                    worker *self) {
+  char reply[RING_NAME_LENGTH + 8];
+  char *ring_name, *key;
+  uint64_t ring_key;
+  bool framed;
+  int length;
+
+  // requests of clients that exceed their rate limit are discarded before
+  // they are parsed, peers are exempt since they forward on behalf of others
+  if (client_limit.rate != 0 &&
+      take_token(&client_limit,
+                 get_client_key(client_addr->sin_addr.s_addr,
+                                client_addr->sin_port),
+                 get_time_ms()) != 0 &&
+      find_peer(client_addr) == NULL) {
+    limited_request_count++;
+    if (max_log_level >= LOG_LEVEL_DEBUG) {
+      snprintf(log_buffer, LOG_BUFFER_SIZE,
+               "Host %s:%d exceeds its rate limit, discarding request",
+               inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
+      log_line(LOG_LEVEL_DEBUG, log_buffer);
+    }
+    return;
+  }
+
+  if (max_log_level >= LOG_LEVEL_DEBUG) {
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Received request '%s' from host %s:%d", request,
+             inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port));
+    log_line(LOG_LEVEL_DEBUG, log_buffer);
+  }
+
+  // subscriptions are only installed for clients that returned their cookie,
+  // the kernel already vouches for the address of a Unix domain socket client
+  if (verify_subscribers && !is_unix_client(client_addr) &&
+      (strncmp(request, method_cookie, strlen(method_cookie)) == 0 ||
+       is_subscription(request)) &&
+      (request = verify_subscriber(request, client_addr, self)) == NULL) {
+    return;
+  }
+
+  // subscribers on the same host request delivery through a ring by
+  // prefixing their subscription with its name and key
+  ring_name = NULL;
+  ring_key = 0;
+  if (strncmp(request, method_ring, strlen(method_ring)) == 0) {
+    ring_name = request + strlen(method_ring);
+    if ((key = strchr(ring_name, msg_delim)) != NULL) {
+      *key++ = '\0';
+      ring_key = strtoull(key, &request, 16);
+    }
+    if (key == NULL || request - key != 16 || *request != msg_delim ||
+        !is_subscription(request + 1)) {
+      log_line(LOG_LEVEL_WARNING, "Request contains invalid ring request");
+      return;
+    }
+    request++;
+  }
+
+  // subscribers request delivery frames by prefixing their subscription
+  framed = strncmp(request, method_framed, strlen(method_framed)) == 0;
+  if (framed) {
+    request += strlen(method_framed);
+  }
+
+  // identify method and proceed to appropriate logic
+  if (strncmp(request, method_publish, strlen(method_publish)) == 0) {
+    handle_publish(request, self);
+  } else if (strncmp(request, method_publish_id, strlen(method_publish_id)) ==
+             0) {
+    handle_publish_id(request, self);
+  } else if (strncmp(request, method_resolve, strlen(method_resolve)) == 0) {
+    handle_resolve(request, client_addr, self);
+  } else if (strncmp(request, method_subscribe, strlen(method_subscribe)) ==
+             0) {
+    handle_subscribe(request, framed, client_addr);
+  } else if (strncmp(request, method_unsubscribe,
+                     strlen(method_unsubscribe)) == 0) {
+    handle_unsubscribe(request, client_addr);
+  } else if (strncmp(request, method_subscribe_many,
+                     strlen(method_subscribe_many)) == 0) {
+    handle_subscribe_many(request, framed, client_addr);
+  } else if (strncmp(request, method_unsubscribe_many,
+                     strlen(method_unsubscribe_many)) == 0) {
+    handle_unsubscribe_many(request, client_addr);
+  } else if (strncmp(request, method_join, strlen(method_join)) == 0) {
+    handle_join(request, framed, client_addr);
+  } else if (strncmp(request, method_leave, strlen(method_leave)) == 0) {
+    handle_leave(request, client_addr);
+  } else if (strncmp(request, method_forward, strlen(method_forward)) == 0) {
+    handle_forward(request, client_addr, self);
+  } else if (strncmp(request, method_interest, strlen(method_interest)) ==
+             0) {
+    handle_interest(request, client_addr);
+  } else {
+    log_line(LOG_LEVEL_WARNING, "Request contains invalid method");
+  }
+
+  // the subscriber receives datagrams until the broker confirms its ring
+  if (ring_name != NULL && attach_ring(ring_name, ring_key, client_addr) == 0) {
+    length = snprintf(reply, sizeof(reply), "%s%s", method_ring, ring_name);
+    send_reply(reply, length, client_addr, self);
+  }
+}
+
+/**
+ * Handles the provided received buffer of the provided client from the request
+ * at the provided offset on, the buffer holds several requests of the same
+ * length if the kernel coalesced them (UDP GRO)
+ *
+ * Unless the broker lock is held, requests are only published from snapshots,
+ * see publish_unlocked(), until one has to be handled while holding the lock.
+ * Requests are terminated in place, so the buffer has to leave room for a
+ * null byte after the provided length
+ *
+ * Returns the offset of the first request that was not handled, or -1 if all
+ * requests were handled
+ */
+int handle_received(char *buffer, int length, int offset, struct msghdr *msg,
+                    const struct sockaddr_in *client_addr, bool locked,
+                    worker *self) {
+  int segment_size, end;
+  bool handled;
+  char next;
+
+  update_kernel_drop_count(msg, self);
+  // 0.0.0.0 stands for clients of the Unix domain socket
+  if (is_unix_client(client_addr)) {
+    return -1;
+  }
+  segment_size = get_segment_size(msg);
+  if (segment_size <= 0) {
+    segment_size = length;
+  }
+
+  do {
+    end = offset + segment_size < length ? offset + segment_size : length;
+    // requests that do not fit into a message buffer are truncated, the byte
+    // after a request belongs to the next one and is restored afterwards
+    if (end - offset > MESSAGE_BUFFER_SIZE - 1) {
+      end = offset + MESSAGE_BUFFER_SIZE - 1;
+    }
+    next = buffer[end];
+    buffer[end] = '\0';
+    handled = locked || publish_unlocked(buffer + offset, self);
+    if (locked) {
+      handle_request(buffer + offset, client_addr, self);
+    }
+    buffer[end] = next;
+    if (!handled) {
+      return offset;
+    }
+    __atomic_add_fetch(&received_request_count, 1, __ATOMIC_RELAXED);
+    offset += segment_size;
+  } while (offset < length);
+  return -1;
+}
+
+/**
+ * Returns the CPU that the worker with the provided index is to be pinned to,
+ * or -1 if no CPUs are configured
+ *
+ * Workers are assigned to the configured CPUs in ascending order, if there are
+ * more workers than CPUs the assignment starts over with the first CPU
+ */
+int get_worker_cpu(int index) {
+  int cpu, count;
+
+  if (!cpu_affinity_set) {
+    return -1;
+  }
+
+  index %= CPU_COUNT(&cpu_affinity);
+  for (cpu = 0, count = 0; cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &cpu_affinity) && count++ == index) {
+      return cpu;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Creates the socket of the provided worker and binds it to the listening
+ * address
+ *
+ * Returns 0 if the socket could be set up without issues, otherwise returns 1
+ */
+int create_worker_socket(worker *self, const struct sockaddr_in *broker_addr) {
+  int enable;
+
+  // create UPD socket, it is non-blocking so that a full send buffer results in
+  // messages being queued instead of stalling the broker
+  self->sock_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (self->sock_fd < 0) {
+    perror("socket");
+    return 1;
+  }
+
+  // all workers listen on the same address
+  enable = 1;
+  if (worker_count > 1 && setsockopt(self->sock_fd, SOL_SOCKET, SO_REUSEPORT,
+                                     &enable, sizeof(enable)) != 0) {
+    perror("setsockopt SO_REUSEPORT");
+    return 1;
+  }
+
+  // prefer the socket of this worker for requests that the kernel processed
+  // on the CPU of the worker
+  if (incoming_cpu && self->cpu >= 0 &&
+      setsockopt(self->sock_fd, SOL_SOCKET, SO_INCOMING_CPU, &self->cpu,
+                 sizeof(self->cpu)) != 0) {
+    perror("setsockopt SO_INCOMING_CPU");
+    return 1;
+  }
+
+  // let the kernel coalesce the datagrams of a client into a single receive
+  if (udp_offload && setsockopt(self->sock_fd, SOL_UDP, UDP_GRO, &enable,
+                                sizeof(enable)) != 0) {
+    perror("setsockopt UDP_GRO");
+    return 1;
+  }
+
+  // apply socket settings and bind address structure to socket
+  if (configure_socket(self->sock_fd) != 0) {
+    return 1;
+  }
+  if (bind(self->sock_fd, (struct sockaddr *)broker_addr,
+           sizeof(*broker_addr)) != 0) {
+    perror("bind");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Creates the Unix domain socket and binds it to the configured path, a socket
+ * that a previous broker left behind at the path is replaced
+ *
+ * Returns 0 if the socket could be set up without issues, otherwise returns 1
+ */
+int create_unix_socket() {
+  struct sockaddr_un unix_addr;
+  struct stat path_stat;
+
+  unix_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  if (unix_fd < 0) {
+    perror("socket");
+    return 1;
+  }
+  if (set_socket_option(unix_fd, SOL_SOCKET, SO_RCVBUFFORCE, SO_RCVBUF,
+                        "SO_RCVBUF", receive_buffer_size) != 0 ||
+      set_socket_option(unix_fd, SOL_SOCKET, SO_SNDBUFFORCE, SO_SNDBUF,
+                        "SO_SNDBUF", send_buffer_size) != 0) {
+    return 1;
+  }
+
+  // only remove sockets, a mistyped path must not delete a regular file
+  if (lstat(unix_socket_path, &path_stat) == 0 &&
+      S_ISSOCK(path_stat.st_mode)) {
+    unlink(unix_socket_path);
+  }
+  memset((void *)&unix_addr, 0, sizeof(unix_addr));
+  unix_addr.sun_family = AF_UNIX;
+  strcpy(unix_addr.sun_path, unix_socket_path);
+  if (bind(unix_fd, (struct sockaddr *)&unix_addr, sizeof(unix_addr)) != 0) {
+    perror("bind");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Allocates the arena of buffers of the provided worker
+ *
+ * Returns 0 if the arena could be allocated, otherwise returns 1
+ */
+int allocate_worker_arena(worker *self) {
+  int dest_length = sub_addresses_length + groups_length;
+  int i;
+
+  self->client_addrs = calloc(receive_batch_size, sizeof(*self->client_addrs));
+  self->request_msgs = calloc(receive_batch_size, sizeof(*self->request_msgs));
+  self->request_iovs = calloc(receive_batch_size, sizeof(*self->request_iovs));
+  self->buffers = calloc(receive_batch_size, request_buffer_size);
+  self->controls = calloc(receive_batch_size, sizeof(*self->controls));
+  self->dest_addrs = calloc(dest_length, sizeof(*self->dest_addrs));
+  self->dest_msgs = calloc(dest_length, sizeof(*self->dest_msgs));
+  self->dest_ids = calloc(dest_length, sizeof(*self->dest_ids));
+  if (fanout_event_fd >= 0) {
+    self->chunk_msgs = calloc(fanout_chunk_size, sizeof(*self->chunk_msgs));
+  }
+  if (self->client_addrs == NULL || self->request_msgs == NULL ||
+      self->request_iovs == NULL || self->buffers == NULL ||
+      self->controls == NULL || self->dest_addrs == NULL ||
+      self->dest_msgs == NULL || self->dest_ids == NULL ||
+      (fanout_event_fd >= 0 && self->chunk_msgs == NULL)) {
+    perror("malloc");
+    return 1;
+  }
+
+  // the message headers of a send batch only differ in their destination and
+  // in whether the message is framed, see add_destination()
+  for (i = 0; i < dest_length; i++) {
+    self->dest_msgs[i].msg_hdr.msg_name = &self->dest_addrs[i];
+    self->dest_msgs[i].msg_hdr.msg_namelen = sizeof(self->dest_addrs[i]);
+  }
+
+  return 0;
+}
+
+/**
+ * Receives a batch of requests on the socket of the provided worker, which
+ * are handled with handle_received()
+ *
+ * Returns the number of received buffers, which may be 0 if no request was
+ * waiting
+ */
+int receive_requests(worker *self) {
+  struct mmsghdr *msg;
+  int nrequests, i;
+
+  for (i = 0; i < receive_batch_size; i++) {
+    msg = &self->request_msgs[i];
+    // leave room for the terminating null byte of the last request
+    self->request_iovs[i].iov_base = self->buffers + i * request_buffer_size;
+    self->request_iovs[i].iov_len = request_buffer_size - 1;
+    memset((void *)&msg->msg_hdr, 0, sizeof(msg->msg_hdr));
+    msg->msg_hdr.msg_name = &self->client_addrs[i];
+    msg->msg_hdr.msg_namelen = sizeof(self->client_addrs[i]);
+    msg->msg_hdr.msg_iov = &self->request_iovs[i];
+    msg->msg_hdr.msg_iovlen = 1;
+    msg->msg_hdr.msg_control = self->controls[i];
+    msg->msg_hdr.msg_controllen = sizeof(self->controls[i]);
+  }
+
+  nrequests =
+      recvmmsg(self->sock_fd, self->request_msgs, receive_batch_size, 0, NULL);
+  if (nrequests < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      log_line(LOG_LEVEL_ERROR, "Failed to receive request");
+    }
+    return 0;
+  }
+
+  return nrequests;
+}
+
+/**
+ * Returns the provided buffer with the provided ID to the buffer ring of the
+ * worker, so that the kernel can receive another request into it
+ */
+void provide_receive_buffer(worker *self, unsigned short buffer_id) {
+  struct io_uring_buf *buf =
+      &self->buf_ring->bufs[self->buf_ring_tail & self->buf_ring_mask];
+
+  // leave room for the terminating null byte of the last request
+  buf->addr = (uintptr_t)(self->ring_buffers +
+                          buffer_id * (RECEIVE_RING_HEADER_SIZE +
+                                       request_buffer_size));
+  buf->len = RECEIVE_RING_HEADER_SIZE + request_buffer_size - 1;
+  buf->bid = buffer_id;
+  self->buf_ring_tail++;
+  __atomic_store_n(&self->buf_ring->tail, self->buf_ring_tail,
+                   __ATOMIC_RELEASE);
+}
+
+/**
+ * Sets up the receive and send rings of the provided worker, including the
+ * ring of provided buffers that requests are received into
+ *
+ * Returns 0 if the io_uring backend can be used, otherwise returns 1 with errno
+ * set accordingly
+ */
+int setup_worker_uring(worker *self) {
+  struct io_uring_buf_reg buf_reg;
+  unsigned buffer_count, i;
+
+  // the number of provided buffers has to be a power of two
+  for (buffer_count = 1; buffer_count < (unsigned)receive_batch_size;
+       buffer_count <<= 1) {
+  }
+
+  if (setup_uring(&self->recv_ring, buffer_count) != 0) {
+    return 1;
+  }
+  if (setup_uring(&self->send_ring, send_batch_size) != 0) {
+    return 1;
+  }
+
+  // the buffer ring has to be page aligned
+  self->buf_ring = mmap(NULL, buffer_count * sizeof(struct io_uring_buf),
+                        PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+  self->ring_buffers =
+      calloc(buffer_count, RECEIVE_RING_HEADER_SIZE + request_buffer_size);
+  if (self->buf_ring == MAP_FAILED || self->ring_buffers == NULL) {
+    return 1;
+  }
+  memset((void *)&buf_reg, 0, sizeof(buf_reg));
+  buf_reg.ring_addr = (uintptr_t)self->buf_ring;
+  buf_reg.ring_entries = buffer_count;
+  buf_reg.bgid = 0;
+  if (syscall(__NR_io_uring_register, self->recv_ring.fd,
+              IORING_REGISTER_PBUF_RING, &buf_reg, 1) != 0) {
+    return 1;
+  }
+  self->buf_ring_mask = buffer_count - 1;
+  self->buf_ring_tail = 0;
+  for (i = 0; i < buffer_count; i++) {
+    provide_receive_buffer(self, i);
+  }
+
+  // every provided buffer contains the client address and the control messages
+  // in front of the request
+  memset((void *)&self->recv_layout, 0, sizeof(self->recv_layout));
+  self->recv_layout.msg_namelen = sizeof(struct sockaddr_in);
+  self->recv_layout.msg_controllen = RECEIVE_CONTROL_SIZE;
+
+  self->use_uring = true;
+  self->receive_armed = false;
+  self->writable_armed = false;
+  return 0;
+}
+
+/**
+ * Prepares a multishot recvmsg operation on the receive ring of the worker,
+ * which keeps receiving requests into provided buffers until it is terminated
+ * by the kernel
+ */
+void arm_receive(worker *self) {
+  struct io_uring_sqe *sqe = get_uring_sqe(&self->recv_ring);
+
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = self->sock_fd;
+  sqe->addr = (uintptr_t)&self->recv_layout;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = URING_RECEIVE;
+  self->receive_armed = true;
+}
+
+/**
+ * Prepares a poll operation on the receive ring of the worker that completes
+ * once the socket is writable again
+ */
+void arm_writable(worker *self) {
+  struct io_uring_sqe *sqe = get_uring_sqe(&self->recv_ring);
+
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = self->sock_fd;
+  sqe->poll32_events = POLLOUT;
+  sqe->user_data = URING_WRITABLE;
+  self->writable_armed = true;
+}
+
+/**
+ * Handles a completion of the multishot recvmsg operation of the worker, which
+ * either carries a request in a provided buffer or an error
+ *
+ * The broker lock is taken once the completion has to be handled while
+ * holding it, unless the provided flag shows that it is already held, and the
+ * flag is set accordingly.
+ *
+ * Returns 0 if the completion could be handled, otherwise returns 1 if the
+ * kernel does not support receiving through io_uring
+ */
+int handle_receive_completion(const struct io_uring_cqe *cqe, bool *locked,
+                              worker *self) {
+  struct io_uring_recvmsg_out *out;
+  struct sockaddr_in *client_addr;
+  struct msghdr control_msg;
+  unsigned short buffer_id;
+  char *buffer, *request;
+  unsigned length;
+  int offset;
+
+  // the operation has to be submitted again once the kernel terminates it
+  if (!(cqe->flags & IORING_CQE_F_MORE)) {
+    self->receive_armed = false;
+  }
+  if (cqe->res == -EINVAL) {
+    return 1;
+  }
+  if (cqe->res < 0) {
+    // running out of provided buffers only terminates the operation
+    if (cqe->res != -ENOBUFS) {
+      if (!*locked) {
+        pthread_mutex_lock(&broker_lock);
+        *locked = true;
+      }
+      snprintf(log_buffer, LOG_BUFFER_SIZE, "Failed to receive request: %s",
+               strerror(-cqe->res));
+      log_line(LOG_LEVEL_ERROR, log_buffer);
+    }
+    return 0;
+  }
+
+  buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+  buffer = self->ring_buffers +
+           buffer_id * (RECEIVE_RING_HEADER_SIZE + request_buffer_size);
+  out = (struct io_uring_recvmsg_out *)buffer;
+  client_addr = (struct sockaddr_in *)(buffer + sizeof(*out));
+  memset((void *)&control_msg, 0, sizeof(control_msg));
+  control_msg.msg_control = buffer + sizeof(*out) + self->recv_layout.msg_namelen;
+  control_msg.msg_controllen = out->controllen;
+  request = (char *)control_msg.msg_control + self->recv_layout.msg_controllen;
+
+  // the payload length also counts bytes that did not fit into the buffer
+  length = out->payloadlen < (unsigned)request_buffer_size - 1
+               ? out->payloadlen
+               : (unsigned)request_buffer_size - 1;
+  offset = 0;
+  if (!*locked) {
+    offset = handle_received(request, length, 0, &control_msg, client_addr,
+                             false, self);
+  }
+  if (offset >= 0) {
+    if (!*locked) {
+      pthread_mutex_lock(&broker_lock);
+      *locked = true;
+    }
+    handle_received(request, length, offset, &control_msg, client_addr, true,
+                    self);
+  }
+
+  provide_receive_buffer(self, buffer_id);
+  return 0;
+}
+
+/**
+ * Receives a batch of requests on the Unix domain socket into the buffers of
+ * the provided worker
+ *
+ * Returns the number of received requests, which may be 0 if no request was
+ * waiting
+ */
+int receive_unix_requests(worker *self) {
+  struct mmsghdr *msg;
+  int nrequests, i;
+
+  for (i = 0; i < receive_batch_size; i++) {
+    msg = &self->request_msgs[i];
+    // leave room for the terminating null byte of the request
+    self->request_iovs[i].iov_base = self->buffers + i * request_buffer_size;
+    self->request_iovs[i].iov_len = MESSAGE_BUFFER_SIZE - 1;
+    memset((void *)&msg->msg_hdr, 0, sizeof(msg->msg_hdr));
+    msg->msg_hdr.msg_name = &self->unix_addrs[i];
+    msg->msg_hdr.msg_namelen = sizeof(self->unix_addrs[i]);
+    msg->msg_hdr.msg_iov = &self->request_iovs[i];
+    msg->msg_hdr.msg_iovlen = 1;
+  }
+
+  nrequests =
+      recvmmsg(unix_fd, self->request_msgs, receive_batch_size, 0, NULL);
+  if (nrequests < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      log_line(LOG_LEVEL_ERROR, "Failed to receive request");
+    }
+    return 0;
+  }
+
+  return nrequests;
+}
+
+/**
+ * Handles a single request that was received on the Unix domain socket from
+ * the client with the provided address
+ *
+ * The client is known by the address of its endpoint entry from now on. A
+ * client whose socket is not bound to an address, or for which there is no
+ * free entry, can only publish, since nothing could be sent to it.
+ */
+void handle_unix_request(char *request, int length,
+                         const struct sockaddr_un *unix_addr,
+                         socklen_t unix_addr_length, worker *self) {
+  struct sockaddr_in client_addr;
+  int index;
+
+  request[length] = '\0';
+  memset((void *)&client_addr, 0, sizeof(client_addr));
+  client_addr.sin_family = AF_INET;
+  client_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  index = -1;
+  if (unix_addr_length > offsetof(struct sockaddr_un, sun_path)) {
+    index = find_or_insert_unix_endpoint(unix_addr, unix_addr_length);
+  }
+  if (index >= 0) {
+    client_addr.sin_port = htons(index + 1);
+  } else if (strncmp(request, method_publish, strlen(method_publish)) != 0 &&
+             strncmp(request, method_publish_id, strlen(method_publish_id)) !=
+                 0) {
+    log_line(LOG_LEVEL_WARNING,
+             "Unix socket client without address or endpoint entry may only "
+             "publish, discarding request");
+    return;
+  }
+
+  __atomic_add_fetch(&received_request_count, 1, __ATOMIC_RELAXED);
+  handle_request(request, &client_addr, self);
+}
+
+/**
+ * Receives and forwards messages with poll, recvmmsg and sendmmsg in an
+ * infinite loop
+ */
+void run_poll_loop(worker *self) {
+  struct pollfd poll_fds[2];
+  uint64_t wakeups;
+  int nrequests, offset, i;
+
+  // the event file descriptor is ignored by poll if fan-outs are not split
+  poll_fds[0].fd = self->sock_fd;
+  poll_fds[1].fd = fanout_event_fd;
+  poll_fds[1].events = POLLIN;
+  while (1) {
+    if (__atomic_exchange_n(&stats_requested, 0, __ATOMIC_RELAXED)) {
+      pthread_mutex_lock(&broker_lock);
+      log_stats();
+      release_broker_lock();
+    }
+
+    // wait for requests, and also for the socket to become writable while
+    // there are queued messages
+    poll_fds[0].events = POLLIN;
+    if (__atomic_load_n(&queued_subscriber_count, __ATOMIC_RELAXED) > 0) {
+      poll_fds[0].events |= POLLOUT;
+    }
+
+    if (poll(poll_fds, 2, -1) < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+      }
+      continue;
+    }
+
+    // help sending the chunks of large fan-outs, the event is reset before
+    // the lanes are checked so that no chunk is missed
+    if (poll_fds[1].revents & POLLIN) {
+      if (read(fanout_event_fd, &wakeups, sizeof(wakeups)) < 0 &&
+          errno != EAGAIN) {
+        perror("read");
+      }
+      send_fanout_chunks(self);
+    }
+    if (poll_fds[0].revents & POLLOUT) {
+      pthread_mutex_lock(&broker_lock);
+      drain_egress_queues(self);
+      release_broker_lock();
+    }
+    if (!(poll_fds[0].revents & POLLIN)) {
+      continue;
+    }
+
+    // receive a batch of requests without holding the lock, and publish from
+    // snapshots until a request has to be handled while holding it
+    nrequests = receive_requests(self);
+    offset = -1;
+    for (i = 0; i < nrequests && offset < 0; i++) {
+      offset = handle_received(self->buffers + i * request_buffer_size,
+                               self->request_msgs[i].msg_len, 0,
+                               &self->request_msgs[i].msg_hdr,
+                               &self->client_addrs[i], false, self);
+    }
+
+    // the remaining requests are handled in order while holding the lock
+    if (offset >= 0) {
+      pthread_mutex_lock(&broker_lock);
+      for (i--; i < nrequests; i++) {
+        handle_received(self->buffers + i * request_buffer_size,
+                        self->request_msgs[i].msg_len, offset,
+                        &self->request_msgs[i].msg_hdr, &self->client_addrs[i],
+                        true, self);
+        offset = 0;
+      }
+
+      // send the publishes of the batch to interested peers
+      flush_peer_batches(self);
+
+      // subscribers may have been marked for disconnection while forwarding
+      if (disconnect_pending_count > 0) {
+        disconnect_slow_subscribers();
+      }
+      release_broker_lock();
+    }
+
+    // take part in sending the fan-outs that the batch split into chunks
+    if (fanout_event_fd >= 0) {
+      send_fanout_chunks(self);
+    }
+  }
+}
+
+/**
+ * Receives and forwards messages through the io_uring instances of the worker
+ * in an infinite loop
+ *
+ * Requests are received by a multishot recvmsg operation, so that submitting
+ * pending operations and waiting for requests only takes a single system call
+ * per iteration. If the kernel turns out not to support multishot recvmsg, the
+ * worker falls back to the poll loop.
  */
-int handle_unsubscribe(char *request, const struct sockaddr_in *sub_address) {
-  char *topic;
-  topic_subs *topic_struct;
-  int i;
+void run_uring_loop(worker *self) {
+  struct io_uring_cqe *cqe;
+  bool unsupported = false;
+  bool locked;
 
-  // isolate topic from subscriber message
-  // first jump over method, then get the remaining substring after the first
-  // delimiter
-  strtok(request, "!");
-  topic = strtok(NULL, "");
+  while (!unsupported) {
+    if (__atomic_exchange_n(&stats_requested, 0, __ATOMIC_RELAXED)) {
+      pthread_mutex_lock(&broker_lock);
+      log_stats();
+      release_broker_lock();
+    }
+    if (!self->receive_armed) {
+      arm_receive(self);
+    }
+    // wait for the socket to become writable while there are queued messages
+    if (__atomic_load_n(&queued_subscriber_count, __ATOMIC_RELAXED) > 0 &&
+        !self->writable_armed) {
+      arm_writable(self);
+    }
 
-  // validate topic
-  if (validate_topic(topic, true) != 0) {
+    if (submit_uring(&self->recv_ring, 1) != 0) {
+      if (errno != EINTR) {
+        perror("io_uring_enter");
+      }
+      continue;
+    }
+
+    // the lock is only taken once a completion has to be handled while
+    // holding it, and then kept for the remaining ones to keep their order
+    locked = false;
+    while (!unsupported && (cqe = peek_uring_cqe(&self->recv_ring)) != NULL) {
+      if (cqe->user_data == URING_WRITABLE) {
+        if (!locked) {
+          pthread_mutex_lock(&broker_lock);
+          locked = true;
+        }
+        self->writable_armed = false;
+        drain_egress_queues(self);
+      } else if (handle_receive_completion(cqe, &locked, self) != 0) {
+        unsupported = true;
+      }
+      advance_uring_cq(&self->recv_ring);
+    }
+
+    if (locked) {
+      // send the publishes of the batch to interested peers
+      flush_peer_batches(self);
+
+      // subscribers may have been marked for disconnection while forwarding
+      if (disconnect_pending_count > 0) {
+        disconnect_slow_subscribers();
+      }
+      release_broker_lock();
+    }
+
+    // take part in sending the fan-outs that the batch split into chunks
+    if (fanout_event_fd >= 0) {
+      send_fanout_chunks(self);
+    }
+  }
+
+  snprintf(log_buffer, LOG_BUFFER_SIZE,
+           "Kernel does not support multishot recvmsg, worker %d falls back "
+           "to poll",
+           self->index);
+  log_line(LOG_LEVEL_WARNING, log_buffer);
+  self->use_uring = false;
+  run_poll_loop(self);
+}
+
+/**
+ * Issues the provided bpf system call command
+ *
+ * Returns the result of the system call
+ */
+int call_bpf(int command, union bpf_attr *attr) {
+  return syscall(__NR_bpf, command, attr, sizeof(*attr));
+}
+
+/**
+ * Loads the XDP program of the fast path, which redirects UDP datagrams to the
+ * broker port whose payload starts with "PUB" to the AF_XDP socket in the
+ * provided XSKMAP, and passes all other packets on to the kernel
+ *
+ * Only IPv4 packets without options and fragmentation are considered.
+ *
+ * Returns the file descriptor of the program, or -1 on failure
+ */
+int load_xdp_program(int map_fd) {
+  // placeholder jump offset that is replaced by the offset of the final
+  // instructions which pass the packet on
+  const short pass = SHRT_MIN;
+  struct bpf_insn program[] = {
+      // r2 = data, r3 = data_end, r6 = context
+      {BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0},
+      {BPF_LDX | BPF_MEM | BPF_W, 2, 6, offsetof(struct xdp_md, data), 0},
+      {BPF_LDX | BPF_MEM | BPF_W, 3, 6, offsetof(struct xdp_md, data_end), 0},
+      // headers and the first three bytes of the payload have to be present
+      {BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0},
+      {BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, XDP_HEADERS_LENGTH + 3},
+      {BPF_JMP | BPF_JGT | BPF_X, 4, 3, pass, 0},
+      // ethernet type, IP version and header length, protocol and fragment
+      {BPF_LDX | BPF_MEM | BPF_H, 5, 2, 12, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, htons(ETHERTYPE_IP)},
+      {BPF_LDX | BPF_MEM | BPF_B, 5, 2, 14, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, 0x45},
+      {BPF_LDX | BPF_MEM | BPF_B, 5, 2, 23, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, IPPROTO_UDP},
+      {BPF_LDX | BPF_MEM | BPF_H, 5, 2, 20, 0},
+      {BPF_ALU64 | BPF_AND | BPF_K, 5, 0, 0, htons(IP_MF | IP_OFFMASK)},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, 0},
+      // UDP destination port
+      {BPF_LDX | BPF_MEM | BPF_H, 5, 2, 36, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, htons(listen_port)},
+      // method
+      {BPF_LDX | BPF_MEM | BPF_B, 5, 2, XDP_HEADERS_LENGTH, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, 'P'},
+      {BPF_LDX | BPF_MEM | BPF_B, 5, 2, XDP_HEADERS_LENGTH + 1, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, 'U'},
+      {BPF_LDX | BPF_MEM | BPF_B, 5, 2, XDP_HEADERS_LENGTH + 2, 0},
+      {BPF_JMP | BPF_JNE | BPF_K, 5, 0, pass, 'B'},
+      // return bpf_redirect_map(map, rx_queue_index, XDP_PASS)
+      {BPF_LDX | BPF_MEM | BPF_W, 2, 6, offsetof(struct xdp_md, rx_queue_index),
+       0},
+      {BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd},
+      {0, 0, 0, 0, 0},
+      {BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS},
+      {BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map},
+      {BPF_JMP | BPF_EXIT, 0, 0, 0, 0},
+      // return XDP_PASS
+      {BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS},
+      {BPF_JMP | BPF_EXIT, 0, 0, 0, 0}};
+  int length = sizeof(program) / sizeof(program[0]);
+  static char verifier_log[4096];
+  union bpf_attr attr;
+  int prog_fd, i;
+
+  for (i = 0; i < length; i++) {
+    if (program[i].off == pass) {
+      program[i].off = length - 2 - (i + 1);
+    }
+  }
+
+  memset((void *)&attr, 0, sizeof(attr));
+  attr.prog_type = BPF_PROG_TYPE_XDP;
+  attr.insns = (uintptr_t)program;
+  attr.insn_cnt = length;
+  attr.license = (uintptr_t) "Dual MIT/GPL";
+  attr.log_buf = (uintptr_t)verifier_log;
+  attr.log_size = sizeof(verifier_log);
+  attr.log_level = 1;
+  prog_fd = call_bpf(BPF_PROG_LOAD, &attr);
+  if (prog_fd < 0) {
+    perror("bpf BPF_PROG_LOAD");
+    fprintf(stderr, "%s", verifier_log);
+  }
+  return prog_fd;
+}
+
+/**
+ * Maps the provided ring of an AF_XDP socket, whose entries have the provided
+ * size
+ *
+ * Returns 0 if the ring could be mapped, otherwise returns 1
+ */
+int map_xsk_ring(xsk_ring *ring, int xsk_fd, const struct xdp_ring_offset *off,
+                 size_t entry_size, off_t page_offset) {
+  char *ptr = mmap(NULL, off->desc + XDP_RING_SIZE * entry_size,
+                   PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xsk_fd,
+                   page_offset);
+
+  if (ptr == MAP_FAILED) {
+    perror("mmap");
     return 1;
   }
+  ring->producer = (uint32_t *)(ptr + off->producer);
+  ring->consumer = (uint32_t *)(ptr + off->consumer);
+  ring->flags = (uint32_t *)(ptr + off->flags);
+  ring->entries = ptr + off->desc;
+  ring->mask = XDP_RING_SIZE - 1;
+  return 0;
+}
 
-  // get instance that stores subscribers for requested topic
-  topic_struct = find_topic_sub(topic);
-  if (topic_struct == NULL) {
-    snprintf(
-        log_buffer, LOG_BUFFER_SIZE,
-        "Topic '%s' not found, nothing to unsubscribe host %s:%d to topic from",
-        topic, inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port));
-    fprintln_and_log(stderr, log_buffer);
-    return 0;
+/**
+ * Sets up the AF_XDP fast path of the provided worker on the configured
+ * interface and queue: creates the socket with its UMEM and rings, registers it
+ * in an XSKMAP and attaches the XDP program to the interface
+ *
+ * Returns 0 if the fast path could be set up, otherwise returns 1
+ */
+int setup_xdp_path(worker *self) {
+  struct xdp_mmap_offsets offsets;
+  struct sockaddr_xdp xsk_addr;
+  struct xdp_umem_reg umem_reg;
+  union bpf_attr attr;
+  struct ifreq ifr;
+  xdp_path *xdp;
+  socklen_t optlen;
+  uint32_t key;
+  int ring_size, i;
+
+  xdp = calloc(1, sizeof(*xdp));
+  if (xdp == NULL) {
+    perror("malloc");
+    return 1;
   }
+  self->xdp = xdp;
 
-  // search subscriber via IP address and port
-  for (i = 0; i < SUB_ADDRESSES_LENGTH; i++) {
-    if (is_same_address(&topic_struct->sub_addresses[i], sub_address)) {
-      // matching address found, unregister it by resetting data of entry
-      set_addr_empty(&topic_struct->sub_addresses[i]);
-      snprintf(log_buffer, LOG_BUFFER_SIZE,
-               "Host %s:%d has been unsubscribed from topic '%s'",
-               inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
-               topic);
-      fprintln_and_log(stderr, log_buffer);
+  // address of the interface, which is the source of all sent frames
+  xdp->ifindex = if_nametoindex(xdp_interface);
+  if (xdp->ifindex == 0) {
+    perror("if_nametoindex");
+    return 1;
+  }
+  memset((void *)&ifr, 0, sizeof(ifr));
+  memcpy(ifr.ifr_name, xdp_interface, sizeof(ifr.ifr_name));
+  if (ioctl(self->sock_fd, SIOCGIFHWADDR, &ifr) != 0) {
+    perror("ioctl SIOCGIFHWADDR");
+    return 1;
+  }
+  memcpy(xdp->mac, ifr.ifr_hwaddr.sa_data, ETH_ALEN);
+  if (ioctl(self->sock_fd, SIOCGIFADDR, &ifr) != 0) {
+    perror("ioctl SIOCGIFADDR");
+    return 1;
+  }
+  xdp->address = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr.s_addr;
+  if (ioctl(self->sock_fd, SIOCGIFNETMASK, &ifr) != 0) {
+    perror("ioctl SIOCGIFNETMASK");
+    return 1;
+  }
+  xdp->netmask = ((struct sockaddr_in *)&ifr.ifr_netmask)->sin_addr.s_addr;
 
-      // in addition, check if the topic now has no subscribers, in which case
-      // it can be removed to make space for other topics
-      remove_unused_topic(topic_struct);
+  // socket with its UMEM and rings
+  xdp->xsk_fd = socket(AF_XDP, SOCK_RAW, 0);
+  if (xdp->xsk_fd < 0) {
+    perror("socket AF_XDP");
+    return 1;
+  }
+  xdp->umem = mmap(NULL, (size_t)XDP_FRAME_COUNT * XDP_FRAME_SIZE,
+                   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  xdp->free_frames = calloc(XDP_RING_SIZE, sizeof(*xdp->free_frames));
+  if (xdp->umem == MAP_FAILED || xdp->free_frames == NULL) {
+    perror("malloc");
+    return 1;
+  }
+  memset((void *)&umem_reg, 0, sizeof(umem_reg));
+  umem_reg.addr = (uintptr_t)xdp->umem;
+  umem_reg.len = (uint64_t)XDP_FRAME_COUNT * XDP_FRAME_SIZE;
+  umem_reg.chunk_size = XDP_FRAME_SIZE;
+  ring_size = XDP_RING_SIZE;
+  if (setsockopt(xdp->xsk_fd, SOL_XDP, XDP_UMEM_REG, &umem_reg,
+                 sizeof(umem_reg)) != 0 ||
+      setsockopt(xdp->xsk_fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size,
+                 sizeof(ring_size)) != 0 ||
+      setsockopt(xdp->xsk_fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size,
+                 sizeof(ring_size)) != 0 ||
+      setsockopt(xdp->xsk_fd, SOL_XDP, XDP_RX_RING, &ring_size,
+                 sizeof(ring_size)) != 0 ||
+      setsockopt(xdp->xsk_fd, SOL_XDP, XDP_TX_RING, &ring_size,
+                 sizeof(ring_size)) != 0) {
+    perror("setsockopt SOL_XDP");
+    return 1;
+  }
+  optlen = sizeof(offsets);
+  if (getsockopt(xdp->xsk_fd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &optlen) !=
+      0) {
+    perror("getsockopt XDP_MMAP_OFFSETS");
+    return 1;
+  }
+  if (map_xsk_ring(&xdp->rx, xdp->xsk_fd, &offsets.rx, sizeof(struct xdp_desc),
+                   XDP_PGOFF_RX_RING) != 0 ||
+      map_xsk_ring(&xdp->tx, xdp->xsk_fd, &offsets.tx, sizeof(struct xdp_desc),
+                   XDP_PGOFF_TX_RING) != 0 ||
+      map_xsk_ring(&xdp->fill, xdp->xsk_fd, &offsets.fr, sizeof(uint64_t),
+                   XDP_UMEM_PGOFF_FILL_RING) != 0 ||
+      map_xsk_ring(&xdp->completion, xdp->xsk_fd, &offsets.cr,
+                   sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) != 0) {
+    return 1;
+  }
 
-      return 0;
-    }
+  // the first half of the frames is handed to the kernel for receiving, the
+  // second half is kept for sending
+  for (i = 0; i < XDP_RING_SIZE; i++) {
+    ((uint64_t *)xdp->fill.entries)[i] = (uint64_t)i * XDP_FRAME_SIZE;
+    xdp->free_frames[i] = (uint64_t)(XDP_RING_SIZE + i) * XDP_FRAME_SIZE;
+  }
+  __atomic_store_n(xdp->fill.producer, XDP_RING_SIZE, __ATOMIC_RELEASE);
+  xdp->free_frame_count = XDP_RING_SIZE;
+
+  memset((void *)&xsk_addr, 0, sizeof(xsk_addr));
+  xsk_addr.sxdp_family = AF_XDP;
+  xsk_addr.sxdp_flags = XDP_USE_NEED_WAKEUP;
+  xsk_addr.sxdp_ifindex = xdp->ifindex;
+  xsk_addr.sxdp_queue_id = xdp_queue;
+  if (bind(xdp->xsk_fd, (struct sockaddr *)&xsk_addr, sizeof(xsk_addr)) != 0) {
+    perror("bind AF_XDP");
+    return 1;
+  }
+
+  // register the socket for its queue before the program starts redirecting
+  memset((void *)&attr, 0, sizeof(attr));
+  attr.map_type = BPF_MAP_TYPE_XSKMAP;
+  attr.key_size = sizeof(uint32_t);
+  attr.value_size = sizeof(int);
+  attr.max_entries = xdp_queue + 1;
+  xdp->map_fd = call_bpf(BPF_MAP_CREATE, &attr);
+  if (xdp->map_fd < 0) {
+    perror("bpf BPF_MAP_CREATE");
+    return 1;
+  }
+  key = xdp_queue;
+  memset((void *)&attr, 0, sizeof(attr));
+  attr.map_fd = xdp->map_fd;
+  attr.key = (uintptr_t)&key;
+  attr.value = (uintptr_t)&xdp->xsk_fd;
+  if (call_bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0) {
+    perror("bpf BPF_MAP_UPDATE_ELEM");
+    return 1;
+  }
+
+  // the program stays attached as long as the link is open, i.e. until the
+  // broker exits
+  xdp->prog_fd = load_xdp_program(xdp->map_fd);
+  if (xdp->prog_fd < 0) {
+    return 1;
+  }
+  memset((void *)&attr, 0, sizeof(attr));
+  attr.link_create.prog_fd = xdp->prog_fd;
+  attr.link_create.target_ifindex = xdp->ifindex;
+  attr.link_create.attach_type = BPF_XDP;
+  xdp->link_fd = call_bpf(BPF_LINK_CREATE, &attr);
+  if (xdp->link_fd < 0) {
+    perror("bpf BPF_LINK_CREATE");
+    return 1;
   }
 
-  snprintf(log_buffer, LOG_BUFFER_SIZE,
-           "Host %s:%d was not subscribed to topic '%s', nothing to do",
-           inet_ntoa(sub_address->sin_addr), ntohs(sub_address->sin_port),
-           topic);
-  fprintln_and_log(stderr, log_buffer);
   return 0;
 }
 
-int main() {
-  struct sockaddr_in *current_sub_addr;
-  int sock_fd;
-  struct sockaddr_in broker_addr, client_addr;
-  socklen_t broker_size, client_size;
-  char buffer[512];
-  int nbytes, length, i, j;
-  char *method;
+/**
+ * Handles a publish request that was received as raw frame through the AF_XDP
+ * fast path, the XDP program only redirects IPv4 UDP datagrams without options
+ */
+void handle_xdp_frame(const char *frame, uint32_t length, worker *self) {
+  const struct iphdr *ip =
+      (const struct iphdr *)(frame + sizeof(struct ether_header));
+  const struct udphdr *udp = (const struct udphdr *)(ip + 1);
+  struct sockaddr_in client_addr;
+  uint32_t payload_length;
+
+  if (length < XDP_HEADERS_LENGTH ||
+      ntohs(udp->len) < sizeof(*udp)) {
+    return;
+  }
+  payload_length = length - XDP_HEADERS_LENGTH;
+  if (payload_length > ntohs(udp->len) - sizeof(*udp)) {
+    payload_length = ntohs(udp->len) - sizeof(*udp);
+  }
+  if (payload_length > MESSAGE_BUFFER_SIZE - 1) {
+    payload_length = MESSAGE_BUFFER_SIZE - 1;
+  }
+  memcpy(self->buffers, udp + 1, payload_length);
+  self->buffers[payload_length] = '\0';
+
+  memset((void *)&client_addr, 0, sizeof(client_addr));
+  client_addr.sin_family = AF_INET;
+  client_addr.sin_addr.s_addr = ip->saddr;
+  client_addr.sin_port = udp->source;
+  // 0.0.0.0 stands for clients of the Unix domain socket
+  if (is_unix_client(&client_addr)) {
+    return;
+  }
+
+  __atomic_add_fetch(&received_request_count, 1, __ATOMIC_RELAXED);
+  handle_request(self->buffers, &client_addr, self);
+}
+
+/**
+ * Handles all requests in the receive ring of the AF_XDP fast path and returns
+ * their frames to the fill ring
+ */
+void receive_xdp_requests(worker *self) {
+  xdp_path *xdp = self->xdp;
+  uint32_t consumer = *xdp->rx.consumer;
+  uint32_t producer = __atomic_load_n(xdp->rx.producer, __ATOMIC_ACQUIRE);
+  uint32_t fill_tail = *xdp->fill.producer;
+  struct xdp_desc *desc;
+
+  // frames are either in the fill ring, with the kernel or in the receive ring,
+  // so the fill ring always has room for the frames that are returned
+  for (; consumer != producer; consumer++) {
+    desc = &((struct xdp_desc *)xdp->rx.entries)[consumer & xdp->rx.mask];
+    handle_xdp_frame(xdp->umem + desc->addr, desc->len, self);
+    ((uint64_t *)xdp->fill.entries)[fill_tail++ & xdp->fill.mask] = desc->addr;
+  }
+  __atomic_store_n(xdp->rx.consumer, consumer, __ATOMIC_RELEASE);
+  __atomic_store_n(xdp->fill.producer, fill_tail, __ATOMIC_RELEASE);
+}
 
-  // initialize topic subs list to be recognizably empty
-  for (i = 0; i < TOPIC_SUBS_MAP_LENGTH; i++) {
-    strcpy(topic_subs_map[i].topic, empty_topic);
-    for (j = 0; j < SUB_ADDRESSES_LENGTH; j++) {
-      current_sub_addr = &topic_subs_map[i].sub_addresses[j];
-      set_addr_empty(current_sub_addr);
+/**
+ * Main function of the worker of the AF_XDP fast path, receives publish
+ * requests from the AF_XDP socket and forwards them in an infinite loop
+ */
+void *run_xdp_worker(void *arg) {
+  worker *self = (worker *)arg;
+  struct pollfd poll_fds[2];
+  cpu_set_t cpus;
+
+  if (self->cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET(self->cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+      fprintf(stderr, "Could not pin worker %d to CPU %d\n", self->index,
+              self->cpu);
     }
   }
+  if (allocate_worker_arena(self) != 0) {
+    exit(1);
+  }
 
-  // already configure wildcard topic to ensure that it is always available
-  strcpy(topic_subs_map[INDEX_WILDCARD_TOPIC].topic, "#");
+  poll_fds[0].fd = self->xdp->xsk_fd;
+  poll_fds[0].events = POLLIN;
+  poll_fds[1].fd = self->sock_fd;
+  while (1) {
+    // wait for requests, and also for the regular socket to become writable
+    // while there are queued messages
+    pthread_mutex_lock(&broker_lock);
+    if (__atomic_exchange_n(&stats_requested, 0, __ATOMIC_RELAXED)) {
+      log_stats();
+    }
+    poll_fds[1].events = queued_subscriber_count > 0 ? POLLOUT : 0;
+    release_broker_lock();
 
-  // create UPD socket
-  sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (sock_fd < 0) {
-    perror("socket");
+    if (poll(poll_fds, 2, -1) < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+      }
+      continue;
+    }
+
+    pthread_mutex_lock(&broker_lock);
+    if (poll_fds[1].revents & POLLOUT) {
+      drain_egress_queues(self);
+    }
+    if (poll_fds[0].revents & POLLIN) {
+      receive_xdp_requests(self);
+    }
+
+    // send the publishes of the batch to interested peers
+    flush_peer_batches(self);
+
+    // subscribers may have been marked for disconnection while forwarding
+    if (disconnect_pending_count > 0) {
+      disconnect_slow_subscribers();
+    }
+    release_broker_lock();
+
+    // take part in sending the fan-outs that the batch split into chunks
+    if (fanout_event_fd >= 0) {
+      send_fanout_chunks(self);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Main function of the worker of the Unix domain socket, receives requests
+ * from local clients and forwards them in an infinite loop
+ */
+void *run_unix_worker(void *arg) {
+  worker *self = (worker *)arg;
+  struct pollfd poll_fds[2];
+  cpu_set_t cpus;
+  int nrequests, i;
+
+  if (self->cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET(self->cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+      fprintf(stderr, "Could not pin worker %d to CPU %d\n", self->index,
+              self->cpu);
+    }
+  }
+  if (allocate_worker_arena(self) != 0 ||
+      (self->unix_addrs =
+           calloc(receive_batch_size, sizeof(*self->unix_addrs))) == NULL) {
+    exit(1);
+  }
+
+  poll_fds[0].fd = unix_fd;
+  poll_fds[0].events = POLLIN;
+  poll_fds[1].fd = self->sock_fd;
+  while (1) {
+    // wait for requests, and also for the regular socket to become writable
+    // while there are queued messages
+    pthread_mutex_lock(&broker_lock);
+    if (__atomic_exchange_n(&stats_requested, 0, __ATOMIC_RELAXED)) {
+      log_stats();
+    }
+    poll_fds[1].events = queued_subscriber_count > 0 ? POLLOUT : 0;
+    release_broker_lock();
+
+    if (poll(poll_fds, 2, -1) < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+      }
+      continue;
+    }
+
+    // receive a batch of requests without holding the lock
+    nrequests = 0;
+    if (poll_fds[0].revents & POLLIN) {
+      nrequests = receive_unix_requests(self);
+    }
+
+    pthread_mutex_lock(&broker_lock);
+    if (poll_fds[1].revents & POLLOUT) {
+      drain_egress_queues(self);
+    }
+    for (i = 0; i < nrequests; i++) {
+      handle_unix_request(self->buffers + i * request_buffer_size,
+                          self->request_msgs[i].msg_len, &self->unix_addrs[i],
+                          self->request_msgs[i].msg_hdr.msg_namelen, self);
+    }
+
+    // send the publishes of the batch to interested peers
+    flush_peer_batches(self);
+
+    // subscribers may have been marked for disconnection while forwarding
+    if (disconnect_pending_count > 0) {
+      disconnect_slow_subscribers();
+    }
+    release_broker_lock();
+
+    // take part in sending the fan-outs that the batch split into chunks
+    if (fanout_event_fd >= 0) {
+      send_fanout_chunks(self);
+    }
+  }
+
+  return NULL;
+}
+
+/**
+ * Announces the interest summary of the broker to its peers in an infinite
+ * loop, periodically and shortly after subscriptions have changed
+ */
+void run_cluster_loop() {
+  struct timespec tick = {0, 100 * 1000000};
+  long long last_announced_ms = 0, now_ms;
+
+  while (1) {
+    now_ms = get_time_ms();
+    pthread_mutex_lock(&broker_lock);
+    if (interest_changed ||
+        now_ms - last_announced_ms >= ANNOUNCE_INTERVAL_MS) {
+      interest_changed = false;
+      last_announced_ms = now_ms;
+      announce_interest(&workers[0]);
+    }
+    release_broker_lock();
+    nanosleep(&tick, NULL);
+  }
+}
+
+/**
+ * Main function of a worker thread, pins the worker to its CPU, allocates its
+ * arena and runs the loop of the selected I/O backend
+ */
+void *run_worker(void *arg) {
+  worker *self = (worker *)arg;
+  cpu_set_t cpus;
+
+  // pin worker to its CPU before its arena is allocated and touched
+  if (self->cpu >= 0) {
+    CPU_ZERO(&cpus);
+    CPU_SET(self->cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0) {
+      fprintf(stderr, "Could not pin worker %d to CPU %d\n", self->index,
+              self->cpu);
+    }
+  }
+  if (allocate_worker_arena(self) != 0) {
+    exit(1);
+  }
+
+  if (selected_io_backend == IO_BACKEND_IO_URING) {
+    if (setup_worker_uring(self) == 0) {
+      run_uring_loop(self);
+      return NULL;
+    }
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Could not set up io_uring (%s), worker %d falls back to poll",
+             strerror(errno), self->index);
+    pthread_mutex_lock(&broker_lock);
+    log_line(LOG_LEVEL_WARNING, log_buffer);
+    release_broker_lock();
+  }
+  run_poll_loop(self);
+
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_in broker_addr;
+  struct sigaction stats_action;
+  sigset_t stats_signal;
+  int i;
+
+  if (parse_arguments(argc, argv) != 0) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (allocate_tables() != 0) {
+    return 1;
+  }
+
+  // workers that wait for requests are woken once chunks of a large fan-out
+  // are scheduled
+  if (fanout_chunk_pool != NULL &&
+      (fanout_event_fd = eventfd(0, EFD_NONBLOCK)) < 0) {
+    perror("eventfd");
     return 1;
   }
 
+  // the cookie key only has to remain valid while the broker is running
+  if (verify_subscribers &&
+      getrandom(cookie_key, sizeof(cookie_key), 0) != sizeof(cookie_key)) {
+    perror("getrandom");
+    return 1;
+  }
+
+  // open log file in append mode, unless logging to a file is disabled
+  if (strcmp(log_file_name, log_file_disabled) != 0) {
+    log_file = fopen(log_file_name, "a");
+    if (log_file == NULL) {
+      fprintf(stderr, "Could not open log file, proceeding anyway\n");
+    }
+  }
+
   // configure address structure for broker
-  broker_size = sizeof(broker_addr);
   memset((void *)&broker_addr, 0, sizeof(broker_addr));
   broker_addr.sin_family = AF_INET;
-  broker_addr.sin_addr.s_addr = INADDR_ANY;
-  broker_addr.sin_port = htons(broker_port);
+  inet_pton(AF_INET, listen_address, &broker_addr.sin_addr);
+  broker_addr.sin_port = htons(listen_port);
 
-  // bind address structure to socket
-  bind(sock_fd, (struct sockaddr *)&broker_addr, broker_size);
-
-  // open log file in append mode
-  log_file = fopen(log_file_name, "a");
-  if (log_file == NULL) {
-    fprintf(stderr, "Could not open log file, proceeding anyway\n");
+  // set up the sockets of all workers before any of them starts, so that
+  // errors are reported right away
+  for (i = 0; i < worker_count; i++) {
+    workers[i].index = i;
+    workers[i].cpu = get_worker_cpu(i);
+    if (create_worker_socket(&workers[i], &broker_addr) != 0) {
+      return 1;
+    }
   }
 
-  snprintf(log_buffer, LOG_BUFFER_SIZE, "Broker listening on port %u",
-           broker_port);
-  fprintln_and_log(stderr, log_buffer);
+  snprintf(log_buffer, LOG_BUFFER_SIZE, "Broker listening on %s:%u with %d %s",
+           listen_address, listen_port, worker_count,
+           worker_count == 1 ? "worker" : "workers");
+  log_line(LOG_LEVEL_INFO, log_buffer);
 
-  // receive and forward messages in infinite loop
-  while (1) {
-    // receive message
-    client_size = sizeof(client_addr);
-    nbytes = recvfrom(sock_fd, buffer, sizeof(buffer) - 1, 0,
-                      (struct sockaddr *)&client_addr, &client_size);
-    if (nbytes < 0) {
-      sprintf(log_buffer, "Failed to receive request");
-      fprintln_and_log(stderr, log_buffer);
-      continue;
+  // the worker of the AF_XDP fast path sends through the socket of the first
+  // worker whenever a subscriber cannot be reached through AF_XDP
+  if (xdp_interface[0] != '\0') {
+    xdp_worker.index = worker_count;
+    xdp_worker.cpu = get_worker_cpu(worker_count);
+    xdp_worker.sock_fd = workers[0].sock_fd;
+    if (setup_xdp_path(&xdp_worker) != 0) {
+      return 1;
     }
-    buffer[nbytes] = '\0';
+    snprintf(log_buffer, LOG_BUFFER_SIZE,
+             "Receiving publishes on queue %d of %s through AF_XDP", xdp_queue,
+             xdp_interface);
+    log_line(LOG_LEVEL_INFO, log_buffer);
+  }
 
+  // the worker of the Unix domain socket also sends datagrams through the
+  // socket of the first worker
+  if (unix_socket_path[0] != '\0') {
+    unix_worker.index = worker_count + (xdp_worker.xdp != NULL);
+    unix_worker.cpu = get_worker_cpu(unix_worker.index);
+    unix_worker.sock_fd = workers[0].sock_fd;
+    if (create_unix_socket() != 0) {
+      return 1;
+    }
     snprintf(log_buffer, LOG_BUFFER_SIZE,
-             "Received request '%s' from host %s:%d", buffer,
-             inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port));
-    fprintln_and_log(stderr, log_buffer);
+             "Receiving requests of local clients on Unix socket %s",
+             unix_socket_path);
+    log_line(LOG_LEVEL_INFO, log_buffer);
+  }
 
-    // identify method and proceed to appropriate logic
-    if (strncmp(buffer, method_publish, strlen(method_publish)) == 0) {
-      handle_publish(buffer, sock_fd);
-    } else if (strncmp(buffer, method_subscribe, strlen(method_subscribe)) ==
-               0) {
-      handle_subscribe(buffer, &client_addr);
-    } else if (strncmp(buffer, method_unsubscribe, strlen(method_subscribe)) ==
-               0) {
-      handle_unsubscribe(buffer, &client_addr);
-    } else {
-      snprintf(log_buffer, LOG_BUFFER_SIZE, "Request contains invalid method");
-      fprintln_and_log(stderr, log_buffer);
-      continue;
+  // log subscriber statistics on SIGUSR1, without restarting the interrupted
+  // poll so that the request is handled right away
+  memset((void *)&stats_action, 0, sizeof(stats_action));
+  stats_action.sa_handler = handle_stats_signal;
+  sigaction(SIGUSR1, &stats_action, NULL);
+
+  for (i = 0; i < worker_count; i++) {
+    if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) !=
+        0) {
+      perror("pthread_create");
+      return 1;
     }
   }
+  if (xdp_worker.xdp != NULL &&
+      pthread_create(&xdp_worker.thread, NULL, run_xdp_worker, &xdp_worker) !=
+          0) {
+    perror("pthread_create");
+    return 1;
+  }
+  if (unix_fd >= 0 && pthread_create(&unix_worker.thread, NULL,
+                                     run_unix_worker, &unix_worker) != 0) {
+    perror("pthread_create");
+    return 1;
+  }
+
+  // leave SIGUSR1 to the workers, which are the only threads that wait in poll
+  sigemptyset(&stats_signal);
+  sigaddset(&stats_signal, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &stats_signal, NULL);
+
+  // the main thread keeps the peers informed about the interest of the broker
+  if (peer_count > 0) {
+    run_cluster_loop();
+  }
+
+  for (i = 0; i < worker_count; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  if (xdp_worker.xdp != NULL) {
+    pthread_join(xdp_worker.thread, NULL);
+  }
+  if (unix_fd >= 0) {
+    pthread_join(unix_worker.thread, NULL);
+  }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,176 @@
+/**
+ * smbbrokers.h
+ *
+ * Defines the broker list that is shared by smb client programs, which
+ * partitions topics across multiple brokers
+ *
+ * A broker list is either a comma separated list of brokers in the format
+ * host[:port], or the name of a file prefixed with '@' that contains one such
+ * broker per line. Every topic is owned by a single broker of the list, which
+ * is chosen by rendezvous hashing: the broker whose address yields the highest
+ * hash together with the topic. Adding a broker to the list therefore only
+ * moves the topics that the new broker wins to it, all other topics keep their
+ * broker.
+ */
+
+#ifndef _SMBBROKERS_H_
+#define _SMBBROKERS_H_
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "smbconstants.h"
+
+#define MAX_BROKERS 64
+
+/**
+ * Resolves the provided broker in the format host[:port] into the provided
+ * address structure, the port defaults to the broker port
+ *
+ * Returns 0 if the broker could be resolved, otherwise returns 1
+ */
+static int resolve_broker(char *broker, struct sockaddr_in *broker_addr) {
+  struct hostent *broker_hent;
+  char *port, *end;
+  long port_number;
+
+  port_number = broker_port;
+  if ((port = strchr(broker, ':')) != NULL) {
+    *port++ = '\0';
+    port_number = strtol(port, &end, 10);
+    if (end == port || *end != '\0' || port_number < 1 ||
+        port_number > UINT16_MAX) {
+      fprintf(stderr, "Invalid port of broker %s: %s\n", broker, port);
+      return 1;
+    }
+  }
+
+  // determine address of broker
+  if ((broker_hent = gethostbyname(broker)) == NULL) {
+    fprintf(stderr, "Could not resolve broker %s\n", broker);
+    return 1;
+  }
+
+  memset((void *)broker_addr, 0, sizeof(*broker_addr));
+  broker_addr->sin_family = AF_INET;
+  memcpy((void *)&broker_addr->sin_addr.s_addr, (void *)broker_hent->h_addr,
+         broker_hent->h_length);
+  broker_addr->sin_port = htons(port_number);
+  return 0;
+}
+
+/**
+ * Reads the provided broker list into the provided array of MAX_BROKERS
+ * addresses
+ *
+ * Returns the number of brokers, or -1 if the list is empty or invalid
+ */
+static int read_broker_list(const char *list, struct sockaddr_in *brokers) {
+  char entries[4096];
+  char *entry, *save;
+  FILE *file;
+  size_t length;
+  int count;
+
+  // a file contains the brokers on separate lines
+  if (list[0] == '@') {
+    if ((file = fopen(list + 1, "r")) == NULL) {
+      perror("fopen");
+      return -1;
+    }
+    length = fread(entries, 1, sizeof(entries) - 1, file);
+    fclose(file);
+    entries[length] = '\0';
+  } else {
+    snprintf(entries, sizeof(entries), "%s", list);
+  }
+
+  count = 0;
+  for (entry = strtok_r(entries, ",\n", &save); entry != NULL;
+       entry = strtok_r(NULL, ",\n", &save)) {
+    while (isspace((unsigned char)*entry)) {
+      entry++;
+    }
+    if (*entry == '\0' || *entry == '#') {
+      continue;
+    }
+    if (count == MAX_BROKERS) {
+      fprintf(stderr, "Broker list exceeds max length of %d\n", MAX_BROKERS);
+      return -1;
+    }
+    if (resolve_broker(entry, &brokers[count]) != 0) {
+      return -1;
+    }
+    count++;
+  }
+
+  if (count == 0) {
+    fprintf(stderr, "Broker list is empty\n");
+    return -1;
+  }
+  return count;
+}
+
+/**
+ * Calculates the rendezvous hash of the provided topic on the provided broker,
+ * which is the FNV-1a hash of both followed by a finalizer that spreads the
+ * bits of the hash
+ */
+static uint32_t hash_topic_broker(const char *topic,
+                                  const struct sockaddr_in *broker_addr) {
+  const unsigned char *bytes;
+  uint32_t hash = 2166136261u;
+  size_t i;
+
+  for (bytes = (const unsigned char *)topic; *bytes != '\0'; bytes++) {
+    hash ^= *bytes;
+    hash *= 16777619u;
+  }
+  bytes = (const unsigned char *)&broker_addr->sin_addr.s_addr;
+  for (i = 0; i < sizeof(broker_addr->sin_addr.s_addr); i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+  bytes = (const unsigned char *)&broker_addr->sin_port;
+  for (i = 0; i < sizeof(broker_addr->sin_port); i++) {
+    hash ^= bytes[i];
+    hash *= 16777619u;
+  }
+
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+/**
+ * Returns the index of the broker that owns the provided topic among the
+ * provided brokers
+ */
+static int select_broker(const char *topic, const struct sockaddr_in *brokers,
+                         int count) {
+  uint32_t hash, best_hash;
+  int i, best;
+
+  best = 0;
+  best_hash = 0;
+  for (i = 0; i < count; i++) {
+    hash = hash_topic_broker(topic, &brokers[i]);
+    if (i == 0 || hash > best_hash) {
+      best = i;
+      best_hash = hash;
+    }
+  }
+
+  return best;
+}
+
+#endif
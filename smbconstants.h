@@ -8,6 +8,8 @@
 #define _SMBCONSTANTS_H_
 
 #define TOPIC_LENGTH 20
+#define FILTER_LENGTH 64
+#define GROUP_LENGTH 20
 
 static const int broker_port = 8080;
 /**
@@ -19,5 +21,17 @@ static const char topic_wildcard = '#';
 static const char *method_publish = "PUB!";
 static const char *method_subscribe = "SUB!";
 static const char *method_unsubscribe = "UNSUB!";
+static const char *method_resolve = "RES!";
+static const char *method_publish_id = "PUBID!";
+static const char *method_join = "JOIN!";
+static const char *method_leave = "LEAVE!";
+static const char *method_interest = "INT!";
+static const char *method_forward = "FWD!";
+static const char *method_cookie = "CHK!";
+static const char *method_subscribe_many = "MSUB!";
+static const char *method_unsubscribe_many = "MUNSUB!";
+static const char *method_framed = "FRM!";
+static const char *method_message = "MSG!";
+static const char *method_ring = "RING!";
 
 #endif
\ No newline at end of file
@@ -6,45 +6,98 @@
  *
  * Broker address and message contents are supplied as program call arguments
  * in the following format:
- * smbpublish broker topic message
- * where broker is the host name or IP-address of the broker
+ * smbpublish brokers topic message
+ * where brokers is the host name or IP-address of the broker, or a list of
+ * brokers that the topics are partitioned across (see smbbrokers.h)
+ *
+ * The message is published to the broker of the list that owns the topic
  *
  * After publishing the message to the broker, the program terminates
+ *
+ * In stream mode (-s), the program instead reads records in the format
+ * "topic message" from stdin, or from the file given with -i, and publishes
+ * every record until the end of the input:
+ * smbpublish -s [-i file] [-d format] brokers
+ * Records are delimited in one of the following formats:
+ * - line (default): each record on its own line
+ * - length: each record preceded by its length as a 4 byte unsigned integer in
+ *   network byte order, as written by smbsubscribe -o length
+ * Every broker is sent to through its own connected socket, and all records
+ * that are read at once are sent with a single system call per broker. Runs
+ * of requests of the same length are handed to the kernel as a single buffer
+ * that it segments into datagrams (UDP GSO), if the kernel supports it.
+ *
+ * A broker that is not running is reported as soon as the kernel learns about
+ * it through ICMP port unreachable.
  */
 
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "smbbrokers.h"
 #include "smbconstants.h"
 
-int main(int argc, char **argv) {
-  char *broker, *topic, *message;
-  struct hostent *broker_hent;
+#define REQUEST_SIZE 512
+#define SEND_BATCH 64
+#define GSO_CONTROL_SIZE CMSG_SPACE(sizeof(uint16_t))
+#define INPUT_BUFFER_SIZE 65536
+
+/**
+ * Formats in which records are delimited in stream mode
+ */
+typedef enum input_format_enum { INPUT_LINE, INPUT_LENGTH } input_format;
+
+const char *input_format_names[] = {"line", "length"};
+
+/**
+ * Publish requests to a single broker that are collected to be sent with a
+ * single system call through a socket that is connected to the broker
+ *
+ * The messages of a send are built from the requests when they are sent,
+ * where a message covers a run of requests if they are segmented by the kernel
+ */
+typedef struct publish_batch_struct {
   int sock_fd;
-  struct sockaddr_in broker_addr, sender_addr;
-  socklen_t broker_size, sender_size;
-  char buffer[512];
-  int nbytes, length;
+  int broker;
+  int count;
+  bool gso;
+  bool refused;
+  char requests[SEND_BATCH][REQUEST_SIZE];
+  struct iovec iovecs[SEND_BATCH];
+  struct mmsghdr msgs[SEND_BATCH];
+  char controls[SEND_BATCH][GSO_CONTROL_SIZE];
+} publish_batch;
 
-  // assert expected number of program call arguments
-  if (argc != 4) {
-    fprintf(
-        stderr,
-        "Invalid call pattern. Expected pattern is:\n%s broker topic message\n",
-        argv[0]);
+struct sockaddr_in brokers[MAX_BROKERS];
+int broker_count;
+publish_batch *batches[MAX_BROKERS];
+
+/**
+ * Validates the provided topic and message of a publish
+ *
+ * Returns 0 if both are valid, otherwise returns 1
+ */
+int validate_publish(const char *topic, const char *message) {
+  // assert that topic is not an empty string
+  if (strlen(topic) == 0) {
+    fprintf(stderr, "Topic is not allowed to be an empty string\n");
     return 1;
   }
 
-  broker = argv[1];
-  topic = argv[2];
-  message = argv[3];
-
   // assert that topic does not contain the wildcard character
   if (strchr(topic, topic_wildcard) != NULL) {
     fprintf(stderr, "Topic is not allowed to contain wildcard character %c\n",
@@ -68,41 +121,449 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  // determine address of broker
-  if ((broker_hent = gethostbyname(broker)) == NULL) {
-    perror("gethostbyname");
-    return 1;
+  return 0;
+}
+
+/**
+ * Returns the batch of the broker with the provided index, which is created
+ * along with a socket that is connected to the broker when it is used for the
+ * first time
+ *
+ * Returns NULL if the batch could not be created
+ */
+publish_batch *get_batch(int broker) {
+  publish_batch *batch;
+  int segment, i;
+
+  if (batches[broker] != NULL) {
+    return batches[broker];
   }
 
-  // create UPD socket
-  sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (sock_fd < 0) {
+  if ((batch = calloc(1, sizeof(publish_batch))) == NULL) {
+    perror("calloc");
+    return NULL;
+  }
+
+  // create UPD socket, connecting it spares the kernel from looking up the
+  // route to the broker for every request
+  batch->sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (batch->sock_fd < 0) {
     perror("socket");
+    free(batch);
+    return NULL;
+  }
+  if (connect(batch->sock_fd, (struct sockaddr *)&brokers[broker],
+              sizeof(brokers[broker])) != 0) {
+    perror("connect");
+    close(batch->sock_fd);
+    free(batch);
+    return NULL;
+  }
+
+  // the kernel supports UDP GSO if it accepts a segment size, which is only
+  // set for the sends that cover several requests though
+  segment = 0;
+  batch->gso = setsockopt(batch->sock_fd, SOL_UDP, UDP_SEGMENT, &segment,
+                          sizeof(segment)) == 0;
+
+  for (i = 0; i < SEND_BATCH; i++) {
+    batch->iovecs[i].iov_base = batch->requests[i];
+  }
+
+  batch->broker = broker;
+  batches[broker] = batch;
+  return batch;
+}
+
+/**
+ * Reports that the broker of the provided batch refused a request, which the
+ * kernel learns through ICMP port unreachable if the broker is not running
+ *
+ * The broker is only reported again once it has accepted requests in between
+ */
+void report_refused(publish_batch *batch) {
+  if (!batch->refused) {
+    fprintf(stderr, "Broker %s:%d refused requests, it may not be running\n",
+            inet_ntoa(brokers[batch->broker].sin_addr),
+            ntohs(brokers[batch->broker].sin_port));
+  }
+  batch->refused = true;
+}
+
+/**
+ * Builds the messages that send the requests of the provided batch from the
+ * request with the provided index on
+ *
+ * With UDP GSO, a run of requests of the same length, optionally followed by
+ * a shorter one, is covered by a single message, which the kernel segments
+ * into one datagram per request
+ *
+ * Returns the number of messages
+ */
+int build_messages(publish_batch *batch, int first) {
+  struct msghdr *msg_hdr;
+  struct cmsghdr *cmsg;
+  size_t segment;
+  int count, last;
+
+  count = 0;
+  while (first < batch->count) {
+    segment = batch->iovecs[first].iov_len;
+    last = first + 1;
+    if (batch->gso) {
+      while (last < batch->count && batch->iovecs[last].iov_len == segment) {
+        last++;
+      }
+      if (last < batch->count && batch->iovecs[last].iov_len < segment) {
+        last++;
+      }
+    }
+
+    msg_hdr = &batch->msgs[count].msg_hdr;
+    memset(msg_hdr, 0, sizeof(*msg_hdr));
+    msg_hdr->msg_iov = &batch->iovecs[first];
+    msg_hdr->msg_iovlen = last - first;
+    if (last - first > 1) {
+      msg_hdr->msg_control = batch->controls[count];
+      msg_hdr->msg_controllen = GSO_CONTROL_SIZE;
+      cmsg = CMSG_FIRSTHDR(msg_hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+      *(uint16_t *)CMSG_DATA(cmsg) = segment;
+    }
+
+    count++;
+    first = last;
+  }
+
+  return count;
+}
+
+/**
+ * Sends all requests of the provided batch to its broker
+ *
+ * Returns 0 if all requests could be sent and the broker did not refuse any
+ * request since the previous send, otherwise returns 1
+ */
+int flush_batch(publish_batch *batch) {
+  int first, count, nsent, result, i;
+
+  result = 0;
+  first = 0;
+  while (first < batch->count) {
+    count = build_messages(batch, first);
+    nsent = sendmmsg(batch->sock_fd, batch->msgs, count, 0);
+    if (nsent < 0 && errno == EINTR) {
+      continue;
+    }
+    // a connected socket reports that the broker refused an earlier request
+    // on the next send, which does not send anything then
+    if (nsent < 0 && errno == ECONNREFUSED) {
+      report_refused(batch);
+      result = 1;
+      continue;
+    }
+    // devices that cannot checksum segments reject segmented sends
+    if (nsent < 0 && errno == EIO && batch->gso) {
+      batch->gso = false;
+      continue;
+    }
+    if (nsent < 0) {
+      perror("sendmmsg");
+      batch->count = 0;
+      return 1;
+    }
+    for (i = 0; i < nsent; i++) {
+      first += batch->msgs[i].msg_hdr.msg_iovlen;
+    }
+  }
+
+  if (result == 0) {
+    batch->refused = false;
+  }
+  batch->count = 0;
+  return result;
+}
+
+/**
+ * Closes the sockets of the batches of all brokers
+ *
+ * Returns 0 if no broker refused the last requests that were sent to it,
+ * otherwise returns 1
+ */
+int close_batches() {
+  int result, error, i;
+  socklen_t error_size;
+
+  result = 0;
+  for (i = 0; i < broker_count; i++) {
+    if (batches[i] == NULL) {
+      continue;
+    }
+    // a refusal of the last requests is still pending on the socket
+    error_size = sizeof(error);
+    if (getsockopt(batches[i]->sock_fd, SOL_SOCKET, SO_ERROR, &error,
+                   &error_size) == 0 &&
+        error == ECONNREFUSED) {
+      report_refused(batches[i]);
+      result = 1;
+    }
+    close(batches[i]->sock_fd);
+  }
+
+  return result;
+}
+
+/**
+ * Sends the requests of the batches of all brokers
+ *
+ * Returns 0 if all requests could be sent, otherwise returns 1
+ */
+int flush_batches() {
+  int result, i;
+
+  result = 0;
+  for (i = 0; i < broker_count; i++) {
+    if (batches[i] != NULL && batches[i]->count > 0) {
+      result |= flush_batch(batches[i]);
+    }
+  }
+
+  return result;
+}
+
+/**
+ * Adds a request to publish the provided message under the provided topic to
+ * the batch of the broker that owns the topic, which is sent once it is full
+ *
+ * Returns 0 if the request could be added, otherwise returns 1
+ */
+int queue_publish(const char *topic, const char *message) {
+  publish_batch *batch;
+  int length;
+
+  if ((batch = get_batch(select_broker(topic, brokers, broker_count))) ==
+      NULL) {
     return 1;
   }
 
-  // configure address structure for broker
-  broker_size = sizeof(broker_addr);
-  memset((void *)&broker_addr, 0, sizeof(broker_addr));
-  broker_addr.sin_family = AF_INET;
-  memcpy((void *)&broker_addr.sin_addr.s_addr, (void *)broker_hent->h_addr,
-         broker_hent->h_length);
-  broker_addr.sin_port = htons(broker_port);
-
-  // assemble message for broker
-  sprintf(buffer, "%s%s%c%s", method_publish, topic, msg_delim, message);
-
-  // publish message to broker
-  fprintf(stderr, "Publishing message: %s\n", buffer);
-  length = strlen(buffer);
-  nbytes = sendto(sock_fd, buffer, length, 0, (struct sockaddr *)&broker_addr,
-                  broker_size);
-  if (nbytes != length) {
-    perror("sendto");
+  // assemble request for broker
+  length = snprintf(batch->requests[batch->count], REQUEST_SIZE, "%s%s%c%s",
+                    method_publish, topic, msg_delim, message);
+  if (length >= REQUEST_SIZE) {
+    fprintf(stderr, "Request exceeds max length of %d\n", REQUEST_SIZE - 1);
     return 1;
   }
+  batch->iovecs[batch->count].iov_len = length;
 
-  // close socket and terminate
-  close(sock_fd);
+  if (++batch->count == SEND_BATCH) {
+    return flush_batch(batch);
+  }
   return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * Publishes the provided record in the format "topic message", the number of
+ * the record is used to report invalid records
+ *
+ * Returns 0 if the record could be published, otherwise returns 1
+ */
+int publish_record(const char *data, int length, long number) {
+  char record[REQUEST_SIZE];
+  char *message;
+
+  // strip the line ending of files that were written on other systems
+  if (length > 0 && data[length - 1] == '\r') {
+    length--;
+  }
+
+  if (length >= REQUEST_SIZE) {
+    fprintf(stderr, "Record %ld exceeds max length of %d\n", number,
+            REQUEST_SIZE - 1);
+    return 1;
+  }
+  memcpy(record, data, length);
+  record[length] = '\0';
+
+  if ((message = strchr(record, ' ')) == NULL) {
+    fprintf(stderr, "Record %ld is not in the format 'topic message'\n",
+            number);
+    return 1;
+  }
+  *message++ = '\0';
+
+  if (validate_publish(record, message) != 0) {
+    fprintf(stderr, "Skipped record %ld\n", number);
+    return 1;
+  }
+  return queue_publish(record, message);
+}
+
+/**
+ * Reads records in the provided format from the provided file descriptor until
+ * the end of the input and publishes them, all records that are read at once
+ * are sent together
+ *
+ * Returns 0 if all records could be published, otherwise returns 1
+ */
+int publish_stream(int fd, input_format format) {
+  static char input[INPUT_BUFFER_SIZE];
+  char *record, *end;
+  uint32_t record_length;
+  int result, filled, used, nbytes;
+  long number;
+
+  result = 0;
+  filled = 0;
+  number = 0;
+  for (;;) {
+    nbytes = read(fd, input + filled, sizeof(input) - filled);
+    if (nbytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (nbytes < 0) {
+      perror("read");
+      return 1;
+    }
+    filled += nbytes;
+
+    // publish all complete records of the input
+    used = 0;
+    while (used < filled) {
+      record = input + used;
+      if (format == INPUT_LINE) {
+        end = memchr(record, '\n', filled - used);
+        if (end == NULL && nbytes > 0) {
+          break;
+        }
+        if (end == NULL) {
+          end = input + filled;
+        }
+        used = end - input + 1;
+        // empty lines separate nothing and are skipped
+        if (end > record) {
+          result |= publish_record(record, end - record, ++number);
+        }
+      } else {
+        if (filled - used < (int)sizeof(record_length)) {
+          break;
+        }
+        memcpy(&record_length, record, sizeof(record_length));
+        record_length = ntohl(record_length);
+        if (record_length > sizeof(input) - sizeof(record_length)) {
+          fprintf(stderr, "Record %ld exceeds max length of %zu\n",
+                  number + 1, sizeof(input) - sizeof(record_length));
+          return 1;
+        }
+        if (filled - used < (int)(sizeof(record_length) + record_length)) {
+          break;
+        }
+        used += sizeof(record_length) + record_length;
+        result |= publish_record(record + sizeof(record_length),
+                                 record_length, ++number);
+      }
+    }
+    result |= flush_batches();
+
+    // keep the incomplete record at the start of the input
+    if (used > filled) {
+      used = filled;
+    }
+    memmove(input, input + used, filled - used);
+    filled -= used;
+
+    if (nbytes == 0) {
+      break;
+    }
+    if (filled == sizeof(input)) {
+      fprintf(stderr, "Record %ld exceeds max length of %zu\n", number + 1,
+              sizeof(input));
+      return 1;
+    }
+  }
+
+  if (filled > 0) {
+    fprintf(stderr, "Record %ld is truncated\n", number + 1);
+    return 1;
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  input_format format;
+  char *program, *input_file;
+  int stream, input_fd, option, result, i;
+
+  program = argv[0];
+  stream = 0;
+  input_file = NULL;
+  format = INPUT_LINE;
+  while ((option = getopt(argc, argv, "si:d:")) != -1) {
+    switch (option) {
+    case 's':
+      stream = 1;
+      break;
+    case 'i':
+      stream = 1;
+      input_file = optarg;
+      break;
+    case 'd':
+      for (i = 0; i <= INPUT_LENGTH; i++) {
+        if (strcmp(optarg, input_format_names[i]) == 0) {
+          break;
+        }
+      }
+      if (i > INPUT_LENGTH) {
+        fprintf(stderr, "Unknown input format '%s'\n", optarg);
+        return 1;
+      }
+      format = (input_format)i;
+      break;
+    default:
+      argc = 0;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+
+  // assert expected number of program call arguments
+  if (argc != (stream ? 2 : 4)) {
+    fprintf(stderr,
+            "Invalid call pattern. Expected pattern is:\n%s brokers topic "
+            "message\nor:\n%s -s [options] brokers\n"
+            "  -i FILE        read records from FILE instead of stdin\n"
+            "  -d FORMAT      record delimiting line or length (line)\n",
+            program, program);
+    return 1;
+  }
+
+  if (!stream && validate_publish(argv[2], argv[3]) != 0) {
+    return 1;
+  }
+
+  // determine addresses of brokers
+  if ((broker_count = read_broker_list(argv[1], brokers)) < 0) {
+    return 1;
+  }
+
+  if (!stream) {
+    // publish message to the broker that owns the topic
+    fprintf(stderr, "Publishing message: %s%s%c%s\n", method_publish, argv[2],
+            msg_delim, argv[3]);
+    result = queue_publish(argv[2], argv[3]);
+    result |= flush_batches();
+    return result | close_batches();
+  }
+
+  input_fd = STDIN_FILENO;
+  if (input_file != NULL && (input_fd = open(input_file, O_RDONLY)) < 0) {
+    perror("open");
+    return 1;
+  }
+
+  result = publish_stream(input_fd, format);
+
+  // close sockets and terminate
+  return result | close_batches();
+}
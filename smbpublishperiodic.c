@@ -6,46 +6,160 @@
  *
  * Broker address and topic are supplied as program call arguments
  * in the following format:
- * smbpublish broker topic
- * where broker is the host name or IP-address of the broker
+ * smbpublish brokers topic
+ * where brokers is the host name or IP-address of the broker, or a list of
+ * brokers that the topics are partitioned across (see smbbrokers.h)
  *
  * Will run indefinitely and periodically publish the current Unix timestamp to
  * the configured topic
+ *
+ * The topic is resolved to its numeric ID at the broker once a minute, so that
+ * publishes in between can address the topic by ID. If the broker does not
+ * answer the resolve request, the topic name is used instead.
+ *
+ * Messages are published to the broker of the list that owns the topic. On
+ * SIGHUP, the broker list is read again, so that a list file can be updated
+ * when brokers are added and the topic moves to its new broker.
+ *
+ * The socket is connected to the broker, so that the kernel looks up the route
+ * to the broker only once and reports when the broker is not running, which it
+ * learns through ICMP port unreachable.
  */
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "smbbrokers.h"
 #include "smbconstants.h"
 
 const int publish_delay_seconds = 5;
+const int resolve_interval_publishes = 12;
+const int resolve_timeout_seconds = 1;
+
+/**
+ * Set by the SIGHUP handler to request the broker list to be read again
+ */
+volatile sig_atomic_t reload_requested;
+
+/**
+ * Signal handler that requests the broker list to be read again by the main
+ * loop
+ */
+void handle_reload(int signal) { reload_requested = 1; }
+
+/**
+ * Sends the provided request through the provided socket, which is connected
+ * to the broker
+ *
+ * A connected socket reports that the broker refused an earlier request on the
+ * next send, which does not send anything then and is repeated
+ *
+ * Returns 0 if the request was sent, otherwise returns 1
+ */
+int send_request(int sock_fd, const char *request) {
+  int nbytes, length;
+
+  length = strlen(request);
+  for (;;) {
+    nbytes = send(sock_fd, request, length, 0);
+    if (nbytes < 0 && errno == ECONNREFUSED) {
+      fprintf(stderr, "Broker refused a request, it may not be running\n");
+      continue;
+    }
+    if (nbytes != length) {
+      perror("send");
+      return 1;
+    }
+    return 0;
+  }
+}
+
+/**
+ * Requests the ID of the provided topic from the broker that the provided
+ * socket is connected to and waits for the reply for a limited amount of time
+ *
+ * Returns the ID of the topic, or -1 if the broker did not reply in time or
+ * sent an invalid reply
+ */
+long resolve_topic(int sock_fd, const char *topic) {
+  struct timeval timeout;
+  char buffer[512], expected[512];
+  char *end;
+  int nbytes, length;
+  long topic_id;
+
+  // limit how long to wait for the reply of the broker
+  timeout.tv_sec = resolve_timeout_seconds;
+  timeout.tv_usec = 0;
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                 sizeof(timeout)) != 0) {
+    perror("setsockopt");
+    return -1;
+  }
+
+  // send resolve request to broker
+  sprintf(buffer, "%s%s", method_resolve, topic);
+  if (send_request(sock_fd, buffer) != 0) {
+    return -1;
+  }
+
+  // await reply in the format RES!topic!id, a broker that is not running is
+  // reported right away instead of after the timeout
+  nbytes = recv(sock_fd, buffer, sizeof(buffer) - 1, 0);
+  if (nbytes < 0 && errno == ECONNREFUSED) {
+    fprintf(stderr, "Broker refused a request, it may not be running\n");
+    return -1;
+  }
+  if (nbytes < 0) {
+    fprintf(stderr, "Broker did not resolve topic, publishing by name\n");
+    return -1;
+  }
+  buffer[nbytes] = '\0';
+
+  sprintf(expected, "%s%s%c", method_resolve, topic, msg_delim);
+  length = strlen(expected);
+  if (strncmp(buffer, expected, length) != 0) {
+    fprintf(stderr, "Received invalid resolve reply: %s\n", buffer);
+    return -1;
+  }
+  topic_id = strtol(buffer + length, &end, 10);
+  if (end == buffer + length || *end != '\0' || topic_id < 0) {
+    fprintf(stderr, "Received invalid resolve reply: %s\n", buffer);
+    return -1;
+  }
+
+  return topic_id;
+}
 
 int main(int argc, char **argv) {
-  char *broker, *topic;
-  struct hostent *broker_hent;
+  char *topic;
   int sock_fd;
-  struct sockaddr_in broker_addr, sender_addr;
-  socklen_t broker_size, sender_size;
+  struct sockaddr_in brokers[MAX_BROKERS], broker_addr;
+  struct sigaction reload_action;
   char buffer[512];
-  int nbytes, length;
+  int publish_count, broker_count, owner;
+  long topic_id;
 
   // assert expected number of program call arguments
   if (argc != 3) {
     fprintf(
         stderr,
-        "Invalid call pattern. Expected pattern is:\n%s broker topic message\n",
+        "Invalid call pattern. Expected pattern is:\n%s brokers topic\n",
         argv[0]);
     return 1;
   }
 
-  broker = argv[1];
   topic = argv[2];
 
   // assert that topic does not contain the wildcard character
@@ -63,9 +177,8 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  // determine address of broker
-  if ((broker_hent = gethostbyname(broker)) == NULL) {
-    perror("gethostbyname");
+  // determine addresses of brokers
+  if ((broker_count = read_broker_list(argv[1], brokers)) < 0) {
     return 1;
   }
 
@@ -76,26 +189,61 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  // configure address structure for broker
-  broker_size = sizeof(broker_addr);
-  memset((void *)&broker_addr, 0, sizeof(broker_addr));
-  broker_addr.sin_family = AF_INET;
-  memcpy((void *)&broker_addr.sin_addr.s_addr, (void *)broker_hent->h_addr,
-         broker_hent->h_length);
-  broker_addr.sin_port = htons(broker_port);
+  // publish to the broker that owns the topic
+  broker_addr = brokers[select_broker(topic, brokers, broker_count)];
+  if (connect(sock_fd, (struct sockaddr *)&broker_addr, sizeof(broker_addr)) !=
+      0) {
+    perror("connect");
+    return 1;
+  }
+
+  // read the broker list again on SIGHUP, without restarting the interrupted
+  // delay so that the topic moves right away
+  memset((void *)&reload_action, 0, sizeof(reload_action));
+  reload_action.sa_handler = handle_reload;
+  sigaction(SIGHUP, &reload_action, NULL);
 
   // periodically publish current Unix timestamp in infinite loop
-  while (1) {
+  topic_id = -1;
+  for (publish_count = 0;; publish_count++) {
+    // move to the broker that owns the topic according to the new list, the
+    // topic ID is only valid at the previous broker
+    if (reload_requested) {
+      reload_requested = 0;
+      broker_count = read_broker_list(argv[1], brokers);
+      owner = broker_count > 0 ? select_broker(topic, brokers, broker_count)
+                               : -1;
+      if (owner >= 0 && memcmp(&broker_addr, &brokers[owner],
+                               sizeof(broker_addr)) != 0) {
+        broker_addr = brokers[owner];
+        fprintf(stderr, "Topic moved to broker %s:%d\n",
+                inet_ntoa(broker_addr.sin_addr), ntohs(broker_addr.sin_port));
+        if (connect(sock_fd, (struct sockaddr *)&broker_addr,
+                    sizeof(broker_addr)) != 0) {
+          perror("connect");
+          return 1;
+        }
+        publish_count = 0;
+      }
+    }
+
+    // refresh the topic ID, in case the broker has been restarted
+    if (publish_count % resolve_interval_publishes == 0) {
+      topic_id = resolve_topic(sock_fd, topic);
+    }
+
     // assemble message for broker
-    sprintf(buffer, "%s%s%c%lu", method_publish, topic, msg_delim, time(NULL));
+    if (topic_id >= 0) {
+      sprintf(buffer, "%s%ld%c%lu", method_publish_id, topic_id, msg_delim,
+              time(NULL));
+    } else {
+      sprintf(buffer, "%s%s%c%lu", method_publish, topic, msg_delim,
+              time(NULL));
+    }
 
     // publish message to broker
     fprintf(stderr, "Publishing message: %s\n", buffer);
-    length = strlen(buffer);
-    nbytes = sendto(sock_fd, buffer, length, 0, (struct sockaddr *)&broker_addr,
-                    broker_size);
-    if (nbytes != length) {
-      perror("sendto");
+    if (send_request(sock_fd, buffer) != 0) {
       return 1;
     }
 
@@ -0,0 +1,87 @@
+/**
+ * smbring.h
+ *
+ * Defines the shared memory rings through which smbbroker delivers messages to
+ * subscribers on the same host
+ *
+ * A subscriber creates a ring as a POSIX shared memory object whose name
+ * starts with "smb-", and requests delivery through it by preceding its
+ * subscription with RING!name!key!, where key is the secret in the header of
+ * the ring as 16 hexadecimal digits. The broker maps the ring, checks the key
+ * and writes every message for the subscriber into it instead of sending a
+ * datagram. Since only processes that can read the ring know its key, no other
+ * client can make the broker write into it.
+ *
+ * The ring has a single writer, the broker, and a single reader, the
+ * subscriber, which only synchronize through the positions in the header of
+ * the ring, so that neither needs a system call per message. A reader that
+ * runs out of messages sleeps on a futex in the header, which the broker only
+ * wakes if the reader announced that it sleeps.
+ *
+ * Every record consists of its length as a 4 byte unsigned integer followed by
+ * the message, and is padded to a multiple of 8 bytes. A record that does not
+ * fit before the end of the data area is written at its beginning, after a
+ * record length of RING_WRAP at the end.
+ */
+
+#ifndef _SMBRING_H_
+#define _SMBRING_H_
+
+#include <linux/futex.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define RING_MAGIC 0x52424d53u
+#define RING_NAME_PREFIX "smb-"
+#define RING_NAME_LENGTH 32
+#define RING_ALIGNMENT 8
+#define RING_WRAP UINT32_MAX
+
+/**
+ * Header of a ring, which is followed by the data area of the ring
+ *
+ * Positions count the bytes written to or read from the ring since it was
+ * created, their offset in the data area is the position modulo the capacity.
+ * The fields of the writer and of the reader are kept on separate cache lines.
+ */
+typedef struct ring_header_struct {
+  uint32_t magic;
+  // size of the data area, a power of two
+  uint32_t capacity;
+  // random secret that the subscriber sends with its request for the ring
+  uint64_t key;
+  // written by the broker: position after the last written record, and a
+  // futex word that it increments to wake the reader
+  _Alignas(64) uint64_t head;
+  uint32_t wakeup;
+  // written by the subscriber: position after the last read record, and
+  // whether it sleeps on the futex word
+  _Alignas(64) uint64_t tail;
+  uint32_t sleeping;
+} ring_header;
+
+/**
+ * Returns the data area of the provided ring
+ */
+static inline char *ring_data(ring_header *ring) { return (char *)(ring + 1); }
+
+/**
+ * Returns the number of bytes that a record with a message of the provided
+ * length takes up in a ring
+ */
+static inline uint64_t ring_record_size(uint32_t length) {
+  return ((uint64_t)sizeof(uint32_t) + length + RING_ALIGNMENT - 1) &
+         ~(uint64_t)(RING_ALIGNMENT - 1);
+}
+
+/**
+ * Performs the provided operation on the futex word of the provided ring,
+ * which is shared between processes
+ */
+static inline long ring_futex(ring_header *ring, int operation, uint32_t value,
+                              const struct timespec *timeout) {
+  return syscall(SYS_futex, &ring->wakeup, operation, value, timeout, NULL, 0);
+}
+
+#endif
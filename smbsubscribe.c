@@ -4,60 +4,634 @@
  * A subscriber program that is compatible with the message broker program
  * smbbroker
  *
- * Broker address and a single topic to subscribe to are supplied as program
- * call arguments in the following format:
- * smbsubscribe broker topic
- * where broker is the host name or IP-address of the broker.
+ * Broker address and the topics to subscribe to are supplied as program call
+ * arguments in the following format:
+ * smbsubscribe [-g group] [-t] [-f] [-m] [-r bytes] [-o format] brokers
+ *              topics [filter]
+ * where brokers is the host name or IP-address of the broker, or a list of
+ * brokers that the topics are partitioned across (see smbbrokers.h), and topics
+ * is a single topic, a comma separated list of topics, or the name of a file
+ * prefixed with '@' that contains one topic per line.
  *
- * After subscribing to the specified topic at the broker, the program
+ * The program subscribes to every topic at the broker of the list that owns
+ * it, or at all brokers of the list for the wildcard topic. The topics at the
+ * same broker are subscribed with as few requests as possible. On SIGHUP, the
+ * broker list is read again and the subscriptions move to the new owners of
+ * their topics. They are kept at the previous brokers for a while, so that no
+ * messages are lost while publishers still use the previous list.
+ *
+ * If a filter expression is supplied, the broker only forwards messages of the
+ * topics that match the filter
+ *
+ * If a group is supplied, the program joins that group on the topics instead
+ * of subscribing to them, so that the messages of the topics are shared among
+ * all members of the group. Group members cannot use a filter.
+ *
+ * After subscribing to the specified topics at the brokers, the program
  * will run in an endless loop, waiting to receive messages from the broker,
  * which it will then print to stdout
  *
  * When the wildcard topic '#' is subscribed to, the subscriber will receive
  * messages for all topics
+ *
+ * Received messages are printed in one of the following formats:
+ * - text (default): each message preceded by a line "Received message:"
+ * - raw: each message on its own line
+ * - length: each message preceded by its length as a 4 byte unsigned integer
+ *   in network byte order, for tools that read the messages as a stream
+ * The output of all messages that are received at once is written to stdout
+ * in a single system call.
+ *
+ * With -t, the program requests delivery frames from the brokers, so that
+ * every message is tagged with its topic, the sequence number that the broker
+ * assigned to it and the time at which the broker received it. In the raw and
+ * length formats, these precede the message separated by spaces.
+ *
+ * In fast mode (-f), up to 64 messages are received per system call and the
+ * socket receive buffer is enlarged to 4 MiB, or the size given with -r, so
+ * that the program keeps up with thousands of messages per second.
+ *
+ * With -m, the program receives messages through a shared memory ring that
+ * the broker writes into, which requires the broker to run on the same host
+ * with shared memory enabled (see smbring.h). Until the broker confirms the
+ * ring with RING!name, the program waits for datagrams like without -m, so
+ * messages arrive without delay if the broker does not accept the ring.
+ * Afterwards, datagrams are still received while the ring is empty. The broker
+ * list has to consist of a single broker.
+ *
+ * If a broker verifies its subscribers, it answers the subscription with a
+ * cookie, which the program returns with the repeated subscription
  */
 
+#define _GNU_SOURCE
+
 #include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/random.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "smbbrokers.h"
 #include "smbconstants.h"
+#include "smbring.h"
+
+// requests are limited by the receive buffer of the broker, messages may be
+// preceded by the header of a delivery frame
+#define REQUEST_SIZE 512
+#define MESSAGE_SIZE 1024
+#define RECEIVE_BATCH 64
+#define MAX_TOPICS 256
+// only the wildcard topic is subscribed at more than one broker
+#define MAX_SUBSCRIPTIONS (MAX_TOPICS + MAX_BROKERS)
+
+const int move_grace_seconds = 10;
+const int fast_rcvbuf_size = 4 << 20;
+const uint32_t ring_capacity = 4 << 20;
+const int ring_wait_ms = 100;
+
+/**
+ * Formats of the messages that are written to stdout
+ */
+typedef enum output_format_enum {
+  OUTPUT_TEXT,
+  OUTPUT_RAW,
+  OUTPUT_LENGTH
+} output_format;
+
+const char *output_format_names[] = {"text", "raw", "length"};
 
 // these variables are global so that the signal handler can access them
-char topic[TOPIC_LENGTH];
-struct sockaddr_in broker_addr;
+char topics[MAX_TOPICS][TOPIC_LENGTH];
+int topic_count;
+char *group;
+char *filter;
+int framed;
 int sock_fd;
+// shared memory ring that the broker writes messages into, or NULL, the name
+// of its shared memory object including the leading slash, and whether the
+// broker confirmed that it writes into the ring
+ring_header *ring;
+char ring_name[RING_NAME_LENGTH + 1];
+int ring_attached;
 
 /**
- * Signal handler that unsubscribes at the broker before terminating the program
+ * Subscription of a topic, given by its index, at a broker
  */
-void handle_exit(int signal) {
-  char buffer[512];
-  int nbytes, length;
+typedef struct subscription_struct {
+  int topic;
+  struct sockaddr_in broker;
+} subscription;
 
-  // assemble message for broker
-  sprintf(buffer, "%s%s", method_unsubscribe, topic);
+// subscriptions that the program holds, and subscriptions that it keeps until
+// the grace period after their topic moved to another broker has passed
+subscription subscribed[MAX_SUBSCRIPTIONS];
+int subscribed_count;
+subscription leaving[MAX_SUBSCRIPTIONS];
+int leaving_count;
 
-  // unsubscribe topic at broker
-  fprintf(stderr, "Unsubscribing from topic: %s\n", buffer);
+/**
+ * Set by the signal handlers to request the broker list to be read again, or
+ * the subscriptions at previous brokers to be removed
+ */
+volatile sig_atomic_t reload_requested;
+volatile sig_atomic_t leave_requested;
+
+/**
+ * Returns whether the provided broker addresses are equal
+ */
+int is_same_broker(const struct sockaddr_in *a, const struct sockaddr_in *b) {
+  return a->sin_addr.s_addr == b->sin_addr.s_addr && a->sin_port == b->sin_port;
+}
+
+/**
+ * Sends a single subscribe or unsubscribe request for the provided topics to
+ * the provided broker, preceded by the provided cookie of the broker unless it
+ * is NULL
+ *
+ * Returns 0 if the request could be sent, otherwise returns 1
+ */
+int send_request(const struct sockaddr_in *broker_addr, const int *batch,
+                 int batch_count, int subscribe, const char *cookie) {
+  char buffer[REQUEST_SIZE];
+  const char *topic;
+  int nbytes, length, i;
+
+  // assemble message for broker, a filter or group only applies to a single
+  // topic, multiple topics are listed after a method for multiple topics
+  length = 0;
+  if (cookie != NULL) {
+    length = sprintf(buffer, "%s%s%c", method_cookie, cookie, msg_delim);
+  }
+  if (subscribe && ring != NULL) {
+    length += sprintf(buffer + length, "%s%s%c%016llx%c", method_ring,
+                      ring_name + 1, msg_delim,
+                      (unsigned long long)ring->key, msg_delim);
+  }
+  if (subscribe && framed) {
+    length += sprintf(buffer + length, "%s", method_framed);
+  }
+  topic = topics[batch[0]];
+  if (group != NULL) {
+    sprintf(buffer + length, "%s%s%c%s", subscribe ? method_join : method_leave,
+            topic, msg_delim, group);
+  } else if (subscribe && filter != NULL) {
+    sprintf(buffer + length, "%s%s%c%s", method_subscribe, topic, msg_delim,
+            filter);
+  } else if (batch_count == 1) {
+    sprintf(buffer + length, "%s%s",
+            subscribe ? method_subscribe : method_unsubscribe, topic);
+  } else {
+    length += sprintf(buffer + length, "%s",
+                      subscribe ? method_subscribe_many
+                                : method_unsubscribe_many);
+    for (i = 0; i < batch_count; i++) {
+      length += sprintf(buffer + length, "%s%c", topics[batch[i]], msg_delim);
+    }
+    buffer[length - 1] = '\0';
+  }
+
+  // subscribe to or unsubscribe from topics at broker
+  fprintf(stderr, "%s at broker %s:%d: %s\n",
+          subscribe ? "Subscribing" : "Unsubscribing",
+          inet_ntoa(broker_addr->sin_addr), ntohs(broker_addr->sin_port),
+          buffer);
   length = strlen(buffer);
-  nbytes = sendto(sock_fd, buffer, length, 0, (struct sockaddr *)&broker_addr,
-                  sizeof(broker_addr));
+  nbytes = sendto(sock_fd, buffer, length, 0, (struct sockaddr *)broker_addr,
+                  sizeof(*broker_addr));
   if (nbytes != length) {
     perror("sendto");
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Sends subscribe or unsubscribe requests for the provided subscriptions,
+ * preceded by the provided cookie unless it is NULL
+ *
+ * The subscriptions at the same broker are combined into as few requests as
+ * fit, unless a filter or group is used.
+ *
+ * Returns 0 if all requests could be sent, otherwise returns 1
+ */
+int send_subscriptions(const subscription *list, int count, int subscribe,
+                       const char *cookie) {
+  char sent[MAX_SUBSCRIPTIONS];
+  int batch[MAX_SUBSCRIPTIONS];
+  int batch_count, length, result, single, i, j;
+
+  memset(sent, 0, sizeof(sent));
+  single = group != NULL || (subscribe && filter != NULL);
+  result = 0;
+  for (i = 0; i < count; i++) {
+    if (sent[i]) {
+      continue;
+    }
+    // a cookie, the requests for a ring and for frames and the longest method
+    // precede the topics
+    length = strlen(method_cookie) + 17 + strlen(method_ring) +
+             RING_NAME_LENGTH + 17 + strlen(method_framed) +
+             strlen(method_unsubscribe_many);
+    batch_count = 0;
+    for (j = i; j < count && !(single && batch_count == 1); j++) {
+      if (sent[j] || !is_same_broker(&list[j].broker, &list[i].broker)) {
+        continue;
+      }
+      length += strlen(topics[list[j].topic]) + 1;
+      if (length >= REQUEST_SIZE) {
+        break;
+      }
+      batch[batch_count++] = list[j].topic;
+      sent[j] = 1;
+    }
+    result |= send_request(&list[i].broker, batch, batch_count, subscribe,
+                           cookie);
   }
 
+  return result;
+}
+
+/**
+ * Returns the index of the subscription of the provided topic at the provided
+ * broker in the provided list of subscriptions, or -1 if the list does not
+ * contain it
+ */
+int find_subscription(const subscription *list, int count, int topic,
+                      const struct sockaddr_in *broker_addr) {
+  int i;
+
+  for (i = 0; i < count; i++) {
+    if (list[i].topic == topic &&
+        is_same_broker(&list[i].broker, broker_addr)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+/**
+ * Reads the provided broker list and subscribes at the brokers that the topics
+ * belong to according to it, which are all brokers for the wildcard topic
+ *
+ * Subscriptions that the program is no longer meant to hold are moved to the
+ * leaving subscriptions.
+ *
+ * Returns 0 if the list could be read and all requests could be sent,
+ * otherwise returns 1
+ */
+int update_subscriptions(const char *list) {
+  struct sockaddr_in brokers[MAX_BROKERS];
+  subscription wanted[MAX_SUBSCRIPTIONS], added[MAX_SUBSCRIPTIONS],
+      removed[MAX_SUBSCRIPTIONS];
+  int broker_count, wanted_count, added_count, removed_count, result, first,
+      last, i, j, index;
+
+  if ((broker_count = read_broker_list(list, brokers)) < 0) {
+    return 1;
+  }
+  // the ring has a single writer
+  if (ring != NULL &&
+      (broker_count > 1 ||
+       (subscribed_count > 0 && !is_same_broker(&subscribed[0].broker,
+                                                &brokers[0])))) {
+    fprintf(stderr, "A shared memory ring can only be used with a single "
+                    "broker, which cannot change\n");
+    return 1;
+  }
+  wanted_count = 0;
+  for (i = 0; i < topic_count; i++) {
+    first = 0;
+    last = broker_count;
+    if (strcmp(topics[i], "#") != 0) {
+      first = select_broker(topics[i], brokers, broker_count);
+      last = first + 1;
+    }
+    for (j = first; j < last; j++) {
+      if (wanted_count == MAX_SUBSCRIPTIONS) {
+        fprintf(stderr, "Subscriptions exceed max count of %d\n",
+                MAX_SUBSCRIPTIONS);
+        return 1;
+      }
+      wanted[wanted_count].topic = i;
+      wanted[wanted_count++].broker = brokers[j];
+    }
+  }
+
+  // subscribe at new brokers first, so that no message is lost in between
+  added_count = 0;
+  for (i = 0; i < wanted_count; i++) {
+    if (find_subscription(subscribed, subscribed_count, wanted[i].topic,
+                          &wanted[i].broker) >= 0) {
+      continue;
+    }
+    if ((index = find_subscription(leaving, leaving_count, wanted[i].topic,
+                                   &wanted[i].broker)) >= 0) {
+      // still subscribed from before
+      leaving[index] = leaving[--leaving_count];
+      continue;
+    }
+    added[added_count++] = wanted[i];
+  }
+  result = send_subscriptions(added, added_count, 1, NULL);
+
+  removed_count = 0;
+  for (i = 0; i < subscribed_count; i++) {
+    if (find_subscription(wanted, wanted_count, subscribed[i].topic,
+                          &subscribed[i].broker) >= 0) {
+      continue;
+    }
+    if (leaving_count < MAX_SUBSCRIPTIONS) {
+      leaving[leaving_count++] = subscribed[i];
+    } else {
+      removed[removed_count++] = subscribed[i];
+    }
+  }
+  send_subscriptions(removed, removed_count, 0, NULL);
+
+  memcpy(subscribed, wanted, wanted_count * sizeof(*wanted));
+  subscribed_count = wanted_count;
+  return result;
+}
+
+/**
+ * Repeats the subscriptions at the provided broker with the provided cookie
+ * that the broker answered them with
+ */
+void return_cookie(const struct sockaddr_in *broker_addr, const char *cookie) {
+  subscription list[MAX_SUBSCRIPTIONS];
+  int count, i;
+
+  count = 0;
+  for (i = 0; i < subscribed_count; i++) {
+    if (is_same_broker(&subscribed[i].broker, broker_addr)) {
+      list[count++] = subscribed[i];
+    }
+  }
+  send_subscriptions(list, count, 1, cookie);
+}
+
+/**
+ * Removes all leaving subscriptions
+ */
+void leave_brokers() {
+  send_subscriptions(leaving, leaving_count, 0, NULL);
+  leaving_count = 0;
+}
+
+/**
+ * Signal handler that unsubscribes at the brokers before terminating the
+ * program
+ */
+void handle_exit(int signal) {
+  send_subscriptions(subscribed, subscribed_count, 0, NULL);
+  leave_brokers();
+
+  // the broker keeps its mapping of the ring until it has unsubscribed
+  if (ring != NULL) {
+    shm_unlink(ring_name);
+  }
   close(sock_fd);
   exit(0);
 }
 
+/**
+ * Signal handler that requests the broker list to be read again by the main
+ * loop
+ */
+void handle_reload(int signal) { reload_requested = 1; }
+
+/**
+ * Signal handler that requests the subscriptions at leaving brokers to be
+ * removed by the main loop
+ */
+void handle_leave(int signal) { leave_requested = 1; }
+
+/**
+ * Appends the provided message to the provided output buffer in the provided
+ * format
+ *
+ * Returns the number of bytes appended
+ */
+int format_message(char *output, const char *message, int length,
+                   output_format format) {
+  uint32_t prefix;
+
+  switch (format) {
+  case OUTPUT_RAW:
+    memcpy(output, message, length);
+    output[length] = '\n';
+    return length + 1;
+  case OUTPUT_LENGTH:
+    prefix = htonl(length);
+    memcpy(output, &prefix, sizeof(prefix));
+    memcpy(output + sizeof(prefix), message, length);
+    return sizeof(prefix) + length;
+  default:
+    return sprintf(output, "Received message:\n%.*s\n", length, message);
+  }
+}
+
+/**
+ * Appends the provided delivery frame, which consists of the topic, sequence
+ * number, receive timestamp and message of a message, to the provided output
+ * buffer in the provided format. In the raw and length formats, the fields
+ * are separated by spaces.
+ *
+ * Returns the number of bytes appended
+ */
+int format_frame(char *output, char *frame, int length, output_format format) {
+  char *fields[4];
+  int i;
+
+  // the fields are separated by delimiters, which the message cannot contain
+  fields[0] = frame;
+  for (i = 1; i < 4; i++) {
+    if ((fields[i] = strchr(fields[i - 1], msg_delim)) == NULL) {
+      break;
+    }
+    *fields[i]++ = ' ';
+  }
+  if (i < 4 || format != OUTPUT_TEXT) {
+    return format_message(output, frame, length, format);
+  }
+
+  for (i = 1; i < 4; i++) {
+    fields[i][-1] = '\0';
+  }
+  return sprintf(output,
+                 "Received message on topic '%s' (sequence %s, timestamp "
+                 "%s):\n%s\n",
+                 fields[0], fields[1], fields[2], fields[3]);
+}
+
+/**
+ * Creates the shared memory ring of the program and maps it
+ *
+ * Returns 0 if the ring could be created, otherwise returns 1
+ */
+int create_ring() {
+  size_t size = sizeof(ring_header) + ring_capacity;
+  int ring_fd;
+
+  snprintf(ring_name, sizeof(ring_name), "/%s%d", RING_NAME_PREFIX,
+           (int)getpid());
+  if ((ring_fd = shm_open(ring_name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0) {
+    perror("shm_open");
+    return 1;
+  }
+  if (ftruncate(ring_fd, size) != 0) {
+    perror("ftruncate");
+    close(ring_fd);
+    shm_unlink(ring_name);
+    return 1;
+  }
+  ring = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, ring_fd, 0);
+  close(ring_fd);
+  if (ring == MAP_FAILED) {
+    perror("mmap");
+    ring = NULL;
+    shm_unlink(ring_name);
+    return 1;
+  }
+
+  // the object is zero filled, so that both positions start at 0, and only
+  // the user of the program can read the key
+  ring->capacity = ring_capacity;
+  if (getrandom(&ring->key, sizeof(ring->key), 0) != sizeof(ring->key)) {
+    perror("getrandom");
+    munmap(ring, size);
+    ring = NULL;
+    shm_unlink(ring_name);
+    return 1;
+  }
+  __atomic_store_n(&ring->magic, RING_MAGIC, __ATOMIC_RELEASE);
+  return 0;
+}
+
+/**
+ * Reads the next record of the ring into the provided buffer of the provided
+ * size, longer messages are truncated
+ *
+ * Returns the length of the message in the buffer, or -1 if the ring is empty
+ */
+int read_ring(char *buffer, uint32_t size) {
+  char *data = ring_data(ring);
+  uint64_t tail, offset;
+  uint32_t length;
+
+  tail = ring->tail;
+  if (tail == __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE)) {
+    return -1;
+  }
+  offset = tail & (ring_capacity - 1);
+  memcpy(&length, data + offset, sizeof(length));
+  if (length == RING_WRAP) {
+    tail += ring_capacity - offset;
+    offset = 0;
+    memcpy(&length, data, sizeof(length));
+  }
+
+  memcpy(buffer, data + offset + sizeof(length),
+         length < size ? length : size);
+  __atomic_store_n(&ring->tail, tail + ring_record_size(length),
+                   __ATOMIC_RELEASE);
+  return length < size ? length : size;
+}
+
+/**
+ * Waits until the broker writes into the empty ring, a signal arrives or a
+ * short timeout passes
+ */
+void wait_ring() {
+  struct timespec timeout;
+  uint32_t wakeup;
+
+  timeout.tv_sec = 0;
+  timeout.tv_nsec = ring_wait_ms * 1000000L;
+
+  // announce sleeping before checking for records for the last time, the
+  // broker wakes the futex if it writes a record afterwards
+  wakeup = __atomic_load_n(&ring->wakeup, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) == ring->tail) {
+    ring_futex(ring, FUTEX_WAIT, wakeup, &timeout);
+  }
+  __atomic_store_n(&ring->sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+/**
+ * Appends the provided received message to the provided output buffer in the
+ * provided format, unless it is a cookie of the broker with the provided
+ * address, which is returned to the broker instead, or the confirmation of the
+ * ring
+ *
+ * The buffer has to leave room for a terminating null byte after the message.
+ *
+ * Returns the number of bytes appended
+ */
+int format_received(char *output, char *buffer, int length,
+                    const struct sockaddr_in *sender_addr,
+                    output_format format) {
+  buffer[length] = '\0';
+
+  // repeat the subscription with the cookie that the broker answered it with
+  if (sender_addr != NULL &&
+      strncmp(buffer, method_cookie, strlen(method_cookie)) == 0) {
+    if (length == (int)strlen(method_cookie) + 16) {
+      return_cookie(sender_addr, buffer + strlen(method_cookie));
+    }
+    return 0;
+  }
+  if (sender_addr != NULL && ring != NULL &&
+      strncmp(buffer, method_ring, strlen(method_ring)) == 0 &&
+      strcmp(buffer + strlen(method_ring), ring_name + 1) == 0) {
+    ring_attached = 1;
+    return 0;
+  }
+  if (framed && strncmp(buffer, method_message, strlen(method_message)) == 0) {
+    return format_frame(output, buffer + strlen(method_message),
+                        length - strlen(method_message), format);
+  }
+  return format_message(output, buffer, length, format);
+}
+
+/**
+ * Writes the provided output buffer to stdout
+ *
+ * Returns 0 if the whole buffer could be written, otherwise returns 1
+ */
+int write_output(const char *output, int length) {
+  int nbytes;
+
+  while (length > 0) {
+    nbytes = write(STDOUT_FILENO, output, length);
+    if (nbytes < 0 && errno == EINTR) {
+      continue;
+    }
+    if (nbytes < 0) {
+      perror("write");
+      return 1;
+    }
+    output += nbytes;
+    length -= nbytes;
+  }
+
+  return 0;
+}
+
 /**
  * Validates the provided topic string
  *
@@ -88,33 +662,187 @@ int validate_topic(const char *topic) {
   return 0;
 }
 
+/**
+ * Reads the provided topic list, which is either a comma separated list of
+ * topics or the name of a file prefixed with '@' that contains one topic per
+ * line, into the topics
+ *
+ * Returns 0 if the list is valid, otherwise returns 1
+ */
+int read_topic_list(const char *list) {
+  char entries[MAX_TOPICS * (TOPIC_LENGTH + 2)];
+  char *entry, *save;
+  FILE *file;
+  size_t length;
+
+  // a file contains the topics on separate lines
+  if (list[0] == '@') {
+    if ((file = fopen(list + 1, "r")) == NULL) {
+      perror("fopen");
+      return 1;
+    }
+    length = fread(entries, 1, sizeof(entries) - 1, file);
+    fclose(file);
+    entries[length] = '\0';
+  } else {
+    snprintf(entries, sizeof(entries), "%s", list);
+  }
+
+  topic_count = 0;
+  for (entry = strtok_r(entries, ",\n", &save); entry != NULL;
+       entry = strtok_r(NULL, ",\n", &save)) {
+    if (topic_count == MAX_TOPICS) {
+      fprintf(stderr, "Topic list exceeds max length of %d\n", MAX_TOPICS);
+      return 1;
+    }
+    if (validate_topic(entry)) {
+      return 1;
+    }
+    strcpy(topics[topic_count++], entry);
+  }
+
+  if (topic_count == 0) {
+    fprintf(stderr, "Topic list is empty\n");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ * Validates the provided group name string
+ *
+ * Returns 0 if group name is valid, otherwise returns 1
+ */
+int validate_group(const char *group) {
+  // assert that group name is not an empty string
+  if (strlen(group) == 0) {
+    fprintf(stderr, "Group is not allowed to be an empty string\n");
+    return 1;
+  }
+
+  // assert that group name is not too long to store
+  if (strlen(group) >= GROUP_LENGTH) {
+    fprintf(stderr, "Group exceeds max length of %u\n", GROUP_LENGTH);
+    return 1;
+  }
+
+  // assert that group name does not contain the message delimiter character
+  if (strchr(group, msg_delim) != NULL) {
+    fprintf(stderr,
+            "Group is not allowed to contain message delimiter character %c\n",
+            msg_delim);
+    return 1;
+  }
+
+  return 0;
+}
+
+/**
+ * Validates the provided filter expression string
+ *
+ * Returns 0 if filter is valid, otherwise returns 1
+ */
+int validate_filter(const char *filter) {
+  // assert that filter is not too long to store
+  if (strlen(filter) >= FILTER_LENGTH) {
+    fprintf(stderr, "Filter exceeds max length of %u\n", FILTER_LENGTH);
+    return 1;
+  }
+
+  // assert that filter does not contain the message delimiter character
+  if (strchr(filter, msg_delim) != NULL) {
+    fprintf(stderr,
+            "Filter is not allowed to contain message delimiter character %c\n",
+            msg_delim);
+    return 1;
+  }
+
+  return 0;
+}
+
 int main(int argc, char **argv) {
-  char *broker;
-  struct hostent *broker_hent;
-  struct sockaddr_in sender_addr;
-  socklen_t broker_size, sender_size;
-  char buffer[512];
-  int nbytes, length;
+  static char buffers[RECEIVE_BATCH][MESSAGE_SIZE];
+  static char output[RECEIVE_BATCH * (MESSAGE_SIZE + 64)];
+  struct sockaddr_in sender_addrs[RECEIVE_BATCH];
+  struct mmsghdr msgs[RECEIVE_BATCH];
+  struct iovec iovecs[RECEIVE_BATCH];
+  struct sigaction action;
+  output_format format;
+  char *program, *end;
+  int fast, shared, rcvbuf, batch_size, count, length, nbytes, option, nargs,
+      i;
+
+  program = argv[0];
+  fast = 0;
+  shared = 0;
+  rcvbuf = 0;
+  format = OUTPUT_TEXT;
+  while ((option = getopt(argc, argv, "g:tfmr:o:")) != -1) {
+    switch (option) {
+    case 'g':
+      group = optarg;
+      break;
+    case 't':
+      framed = 1;
+      break;
+    case 'f':
+      fast = 1;
+      break;
+    case 'm':
+      shared = 1;
+      break;
+    case 'r':
+      rcvbuf = strtol(optarg, &end, 10);
+      if (end == optarg || *end != '\0' || rcvbuf <= 0) {
+        fprintf(stderr, "Invalid receive buffer size '%s'\n", optarg);
+        return 1;
+      }
+      break;
+    case 'o':
+      for (i = 0; i <= OUTPUT_LENGTH; i++) {
+        if (strcmp(optarg, output_format_names[i]) == 0) {
+          break;
+        }
+      }
+      if (i > OUTPUT_LENGTH) {
+        fprintf(stderr, "Unknown output format '%s'\n", optarg);
+        return 1;
+      }
+      format = (output_format)i;
+      break;
+    default:
+      argc = 0;
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  nargs = group != NULL ? 3 : 4;
 
   // assert expected number of program call arguments
-  if (argc != 3) {
+  if (argc != 3 && argc != nargs) {
     fprintf(stderr,
-            "Invalid call pattern. Expected pattern is:\n%s broker topic\n",
-            argv[0]);
+            "Invalid call pattern. Expected pattern is:\n%s [options] brokers "
+            "topics [filter]\nor:\n%s [options] -g group brokers topics\n"
+            "  -t             tag messages with topic, sequence and timestamp\n"
+            "  -f             receive messages in batches into a large buffer\n"
+            "  -m             receive messages through shared memory from a\n"
+            "                 broker on the same host\n"
+            "  -r BYTES       socket receive buffer size (4 MiB with -f)\n"
+            "  -o FORMAT      output format text, raw or length (text)\n",
+            program, program);
     return 1;
   }
 
-  broker = argv[1];
-  strncpy(topic, argv[2], sizeof(topic));
+  filter = argc == 4 ? argv[3] : NULL;
 
-  // assert that topic does not contain the message delimiter character
-  if (validate_topic(topic)) {
+  // assert that topics do not contain the message delimiter character
+  if (read_topic_list(argv[2])) {
     return 1;
   }
-
-  // determine address of broker
-  if ((broker_hent = gethostbyname(broker)) == NULL) {
-    perror("gethostbyname");
+  if (filter != NULL && validate_filter(filter)) {
+    return 1;
+  }
+  if (group != NULL && validate_group(group)) {
     return 1;
   }
 
@@ -125,24 +853,37 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  // configure address structure for broker
-  broker_size = sizeof(broker_addr);
-  memset((void *)&broker_addr, 0, sizeof(broker_addr));
-  broker_addr.sin_family = AF_INET;
-  memcpy((void *)&broker_addr.sin_addr.s_addr, (void *)broker_hent->h_addr,
-         broker_hent->h_length);
-  broker_addr.sin_port = htons(broker_port);
+  // a large receive buffer absorbs bursts while the output is written, the
+  // kernel may cap it at net.core.rmem_max
+  if (rcvbuf == 0 && fast) {
+    rcvbuf = fast_rcvbuf_size;
+  }
+  if (rcvbuf > 0 && setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+                               sizeof(rcvbuf)) != 0) {
+    perror("setsockopt");
+    return 1;
+  }
 
-  // assemble message for broker
-  sprintf(buffer, "%s%s", method_subscribe, topic);
+  batch_size = fast ? RECEIVE_BATCH : 1;
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < batch_size; i++) {
+    iovecs[i].iov_base = buffers[i];
+    iovecs[i].iov_len = MESSAGE_SIZE - 1;
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &sender_addrs[i];
+  }
 
-  // subscribe to topic at broker
-  fprintf(stderr, "Subscribing to topic: %s\n", buffer);
-  length = strlen(buffer);
-  nbytes = sendto(sock_fd, buffer, length, 0, (struct sockaddr *)&broker_addr,
-                  broker_size);
-  if (nbytes != length) {
-    perror("sendto");
+  // the ring is requested with the subscriptions
+  if (shared && create_ring() != 0) {
+    return 1;
+  }
+
+  // subscribe to topics at the brokers that own them
+  if (update_subscriptions(argv[1]) != 0) {
+    if (ring != NULL) {
+      shm_unlink(ring_name);
+    }
     return 1;
   }
 
@@ -152,17 +893,61 @@ int main(int argc, char **argv) {
   signal(SIGQUIT, handle_exit);
   signal(SIGTERM, handle_exit);
 
+  // the broker list is read again on SIGHUP, and the subscriptions at previous
+  // brokers are removed once the alarm of the grace period goes off, both
+  // interrupt waiting for messages
+  memset((void *)&action, 0, sizeof(action));
+  action.sa_handler = handle_reload;
+  sigaction(SIGHUP, &action, NULL);
+  action.sa_handler = handle_leave;
+  sigaction(SIGALRM, &action, NULL);
+
   // wait for messages from broker in infinite loop and print received messages
-  // to stdout
+  // to stdout, a batch is returned as soon as it contains one message
   while (1) {
-    nbytes = recvfrom(sock_fd, buffer, sizeof(buffer) - 1, 0,
-                      (struct sockaddr *)&sender_addr, &sender_size);
-    if (nbytes < 0) {
-      perror("recvfrom");
+    // messages in the ring are taken without a system call, datagrams are only
+    // received once the ring is empty
+    length = 0;
+    count = 0;
+    while (ring_attached && count < RECEIVE_BATCH &&
+           (nbytes = read_ring(buffers[0], MESSAGE_SIZE - 1)) >= 0) {
+      length += format_received(output + length, buffers[0], nbytes, NULL,
+                                format);
+      count++;
+    }
+    if (count == 0) {
+      for (i = 0; i < batch_size; i++) {
+        msgs[i].msg_hdr.msg_namelen = sizeof(sender_addrs[i]);
+      }
+      count = recvmmsg(sock_fd, msgs, batch_size,
+                       ring_attached ? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
+      if (count < 0 && ring_attached &&
+          (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        wait_ring();
+      } else if (count < 0 && errno != EINTR) {
+        perror("recvmmsg");
+        return 1;
+      }
+      for (i = 0; i < count; i++) {
+        length += format_received(output + length, buffers[i],
+                                  msgs[i].msg_len, &sender_addrs[i], format);
+      }
+    }
+    if (length > 0 && write_output(output, length) != 0) {
       return 1;
     }
-    buffer[nbytes] = '\0';
-    printf("Received message:\n%s\n", buffer);
+
+    if (reload_requested) {
+      reload_requested = 0;
+      update_subscriptions(argv[1]);
+      if (leaving_count > 0) {
+        alarm(move_grace_seconds);
+      }
+    }
+    if (leave_requested) {
+      leave_requested = 0;
+      leave_brokers();
+    }
   }
 
   // close socket and terminate
@@ -0,0 +1,145 @@
+/**
+ * fanoutorder.c
+ *
+ * A test of the message order of split fan-outs against a running smbbroker
+ *
+ * The test is called in the following format:
+ * fanoutorder host port
+ * where the broker at host and port runs with at least two workers and a
+ * fan-out chunk size (-K) below SUBSCRIBER_COUNT.
+ *
+ * All subscribers subscribe to a large topic, whose fan-outs are split into
+ * chunks, and the first subscriber also to a small topic, whose fan-out is not
+ * large enough to be split. Messages are published to both topics in turns and
+ * numbered in the order in which they are published, so the first subscriber
+ * has to receive them in increasing order.
+ *
+ * Returns 0 if the messages arrived in order, otherwise returns 1
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define SUBSCRIBER_COUNT 256
+#define ROUND_COUNT 200
+#define RECEIVE_BUFFER_SIZE (1 << 20)
+#define MESSAGE_SIZE 64
+
+/**
+ * Opens a socket on an ephemeral port of the loopback address
+ *
+ * Returns the socket, otherwise returns -1 on errors
+ */
+int open_socket() {
+  struct sockaddr_in address;
+  struct timeval timeout = {1, 0};
+  int sock_fd, size = RECEIVE_BUFFER_SIZE;
+
+  if ((sock_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+    perror("socket");
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) < 0 ||
+      setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                 sizeof(timeout)) < 0 ||
+      bind(sock_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    perror("socket setup");
+    close(sock_fd);
+    return -1;
+  }
+  return sock_fd;
+}
+
+/**
+ * Sends the provided request to the broker
+ *
+ * Returns 0 if the request was sent, otherwise returns 1
+ */
+int send_request(int sock_fd, const struct sockaddr_in *broker,
+                 const char *request) {
+  if (sendto(sock_fd, request, strlen(request), 0,
+             (const struct sockaddr *)broker, sizeof(*broker)) < 0) {
+    perror("sendto");
+    return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_in broker;
+  char request[MESSAGE_SIZE], message[MESSAGE_SIZE];
+  int subs[SUBSCRIBER_COUNT];
+  int publisher, received, last, number, length, i;
+
+  if (argc != 3) {
+    fprintf(stderr, "Usage: %s host port\n", argv[0]);
+    return 1;
+  }
+  memset(&broker, 0, sizeof(broker));
+  broker.sin_family = AF_INET;
+  broker.sin_port = htons(atoi(argv[2]));
+  if (inet_pton(AF_INET, argv[1], &broker.sin_addr) != 1) {
+    fprintf(stderr, "Invalid broker address '%s'\n", argv[1]);
+    return 1;
+  }
+
+  for (i = 0; i < SUBSCRIBER_COUNT; i++) {
+    if ((subs[i] = open_socket()) < 0 ||
+        send_request(subs[i], &broker, "SUB!large") != 0) {
+      return 1;
+    }
+  }
+  if (send_request(subs[0], &broker, "SUB!small") != 0 ||
+      (publisher = open_socket()) < 0) {
+    return 1;
+  }
+  usleep(300 * 1000);
+
+  // a single publisher socket keeps the requests on the same worker, which
+  // handles them in the order in which they were sent
+  for (i = 0; i < ROUND_COUNT; i++) {
+    snprintf(request, sizeof(request), "PUB!large!%d", 2 * i);
+    send_request(publisher, &broker, request);
+    snprintf(request, sizeof(request), "PUB!small!%d", 2 * i + 1);
+    send_request(publisher, &broker, request);
+    if (i % 10 == 9) {
+      usleep(2 * 1000);
+    }
+  }
+
+  received = 0;
+  last = -1;
+  while ((length = recv(subs[0], message, sizeof(message) - 1, 0)) > 0) {
+    message[length] = '\0';
+    number = atoi(message);
+    if (number <= last) {
+      fprintf(stderr, "Message %d arrived after message %d\n", number, last);
+      return 1;
+    }
+    last = number;
+    received++;
+  }
+  if (length < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+    perror("recv");
+    return 1;
+  }
+
+  for (i = 0; i < SUBSCRIBER_COUNT; i++) {
+    send_request(subs[i], &broker, "UNSUB!large");
+  }
+  send_request(subs[0], &broker, "UNSUB!small");
+
+  printf("Received %d of %d messages in order\n", received, 2 * ROUND_COUNT);
+  // most messages have to arrive for the order to be meaningful
+  return received >= ROUND_COUNT ? 0 : 1;
+}
@@ -0,0 +1,231 @@
+/**
+ * snapshotstress.c
+ *
+ * A stress test of the topic snapshots of smbbroker, which is compiled together
+ * with the broker and built with -fsanitize=thread, so that ThreadSanitizer
+ * reports any data race between the workers
+ *
+ * The test is called without arguments. Half of the workers keep publishing to
+ * a topic with more subscribers than the fan-out chunk size from its snapshot,
+ * while all of them send the chunks of the fan-outs, both without holding the
+ * broker lock, as they do in the broker. At the same time another thread keeps
+ * subscribing, unsubscribing and changing the filters and delivery frames of
+ * subscribers while holding the lock, so that snapshots are replaced and
+ * retired while publishers and chunks read them. Messages go to sink sockets
+ * on the loopback interface, which drop what they cannot hold.
+ *
+ * Returns 0 if messages were published without the broker lock, all chunks
+ * were sent and all retired snapshots were freed once the workers stopped,
+ * otherwise returns 1
+ */
+
+// the broker is included as a whole, under a different name for its main
+#define main smbbroker_main
+#include "../smbbroker.c"
+#undef main
+
+#define STRESS_WORKERS 4
+#define STRESS_SUBSCRIBERS 512
+#define STRESS_SECONDS 3
+#define SINK_COUNT 4
+
+const char *stress_topic = "stress";
+
+in_port_t sink_ports[SINK_COUNT];
+
+// set once the test is over, read and written atomically
+bool stress_stopped;
+
+// publishes with and without the broker lock, updated atomically
+unsigned long publish_count;
+unsigned long locked_publish_count;
+unsigned long change_count;
+
+/**
+ * Sets the provided address to the address of the subscriber with the
+ * provided number, every subscriber has its own address on the loopback
+ * network and the port of one of the sinks
+ */
+void get_subscriber_address(int number, struct sockaddr_in *address) {
+  memset((void *)address, 0, sizeof(*address));
+  address->sin_family = AF_INET;
+  address->sin_addr.s_addr = htonl(0x7f010000 + number);
+  address->sin_port = sink_ports[number % SINK_COUNT];
+}
+
+/**
+ * Runs a worker of the test, which publishes if its index is even and sends
+ * chunks of fan-outs until the test is over
+ *
+ * Like in the broker, a request is only handled while holding the broker lock
+ * if it cannot be published from the snapshots.
+ */
+void *run_stress_worker(void *arg) {
+  worker *self = (worker *)arg;
+  struct sockaddr_in address;
+  char request[64];
+  unsigned long sequence = 0;
+
+  get_subscriber_address(STRESS_SUBSCRIBERS + self->index, &address);
+  while (!__atomic_load_n(&stress_stopped, __ATOMIC_ACQUIRE)) {
+    if (self->index % 2 == 0) {
+      snprintf(request, sizeof(request), "%s%s!%d-%lu", method_publish,
+               stress_topic, self->index, sequence++);
+      if (publish_unlocked(request, self)) {
+        __atomic_add_fetch(&publish_count, 1, __ATOMIC_RELAXED);
+      } else {
+        pthread_mutex_lock(&broker_lock);
+        handle_request(request, &address, self);
+        release_broker_lock();
+        __atomic_add_fetch(&locked_publish_count, 1, __ATOMIC_RELAXED);
+      }
+    }
+    send_fanout_chunks(self);
+  }
+
+  return NULL;
+}
+
+/**
+ * Runs the thread that changes subscriptions until the test is over
+ */
+void *run_churn(void *arg) {
+  struct sockaddr_in address;
+  unsigned seed = 1;
+  int number;
+
+  (void)arg;
+  while (!__atomic_load_n(&stress_stopped, __ATOMIC_ACQUIRE)) {
+    number = rand_r(&seed) % STRESS_SUBSCRIBERS;
+    get_subscriber_address(number, &address);
+    pthread_mutex_lock(&broker_lock);
+    switch (rand_r(&seed) % 4) {
+    case 0:
+      unsubscribe_topic(stress_topic, &address);
+      break;
+    case 1:
+      // a filter excludes the subscriber from the snapshot, which therefore
+      // no longer holds every destination, until the subscriber leaves again
+      // within the same batch of changes
+      subscribe_topic(stress_topic, "prefix:0", false, &address);
+      unsubscribe_topic(stress_topic, &address);
+      break;
+    default:
+      // the format only changes for subscribers without subscriptions, the
+      // broker rejects the request of all others
+      subscribe_topic(stress_topic, NULL, rand_r(&seed) % 2 == 0, &address);
+      break;
+    }
+    change_count++;
+    release_broker_lock();
+  }
+
+  return NULL;
+}
+
+/**
+ * Opens the sink sockets on ephemeral ports of all local addresses
+ *
+ * Returns 0 if all sinks could be opened, otherwise returns 1
+ */
+int open_sinks() {
+  struct sockaddr_in address;
+  socklen_t length;
+  int sink_fd, i;
+
+  for (i = 0; i < SINK_COUNT; i++) {
+    memset((void *)&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    length = sizeof(address);
+    if ((sink_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+        bind(sink_fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        getsockname(sink_fd, (struct sockaddr *)&address, &length) < 0) {
+      perror("sink");
+      return 1;
+    }
+    sink_ports[i] = address.sin_port;
+  }
+  return 0;
+}
+
+int main() {
+  char *arguments[] = {"snapshotstress", "-w", "4", "-K", "16", "-T", "4",
+                       "-S", "512", "-N", "512", "-Q", "4", "-L", "error",
+                       "-f", "none", NULL};
+  struct sockaddr_in address;
+  pthread_t churn_thread;
+  int result, lane, i;
+
+  if (parse_arguments(sizeof(arguments) / sizeof(arguments[0]) - 1,
+                      arguments) != 0 ||
+      allocate_tables() != 0 || open_sinks() != 0) {
+    return 1;
+  }
+  if ((fanout_event_fd = eventfd(0, EFD_NONBLOCK)) < 0) {
+    perror("eventfd");
+    return 1;
+  }
+  pthread_mutex_lock(&broker_lock);
+  for (i = 0; i < STRESS_SUBSCRIBERS; i++) {
+    get_subscriber_address(i, &address);
+    if (subscribe_topic(stress_topic, NULL, i % 3 == 0, &address) != 0) {
+      return 1;
+    }
+  }
+  release_broker_lock();
+
+  for (i = 0; i < STRESS_WORKERS; i++) {
+    workers[i].index = i;
+    if ((workers[i].sock_fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+        allocate_worker_arena(&workers[i]) != 0) {
+      perror("worker");
+      return 1;
+    }
+  }
+  for (i = 0; i < STRESS_WORKERS; i++) {
+    if (pthread_create(&workers[i].thread, NULL, run_stress_worker,
+                       &workers[i]) != 0) {
+      perror("pthread_create");
+      return 1;
+    }
+  }
+  if (pthread_create(&churn_thread, NULL, run_churn, NULL) != 0) {
+    perror("pthread_create");
+    return 1;
+  }
+
+  sleep(STRESS_SECONDS);
+  __atomic_store_n(&stress_stopped, true, __ATOMIC_RELEASE);
+  for (i = 0; i < STRESS_WORKERS; i++) {
+    pthread_join(workers[i].thread, NULL);
+  }
+  pthread_join(churn_thread, NULL);
+
+  // send the chunks that are left, after which no job may hold a snapshot
+  send_fanout_chunks(&workers[0]);
+  result = 0;
+  if (publish_count == 0) {
+    fprintf(stderr, "No message was published without the broker lock\n");
+    result = 1;
+  }
+  pthread_mutex_lock(&fanout_lock);
+  for (lane = 0; lane < FANOUT_LANES; lane++) {
+    if (fanout_lanes[lane].head != NULL || fanout_lanes[lane].pending != 0) {
+      fprintf(stderr, "Lane %d still has chunks\n", lane);
+      result = 1;
+    }
+  }
+  reclaim_topic_snapshots();
+  if (retired_snapshots != NULL) {
+    fprintf(stderr, "Retired snapshots were not freed\n");
+    result = 1;
+  }
+  pthread_mutex_unlock(&fanout_lock);
+
+  printf("%lu publishes without and %lu with the broker lock, %lu "
+         "subscription changes, %lu messages sent in chunks, %lu snapshot "
+         "replacements\n",
+         publish_count, locked_publish_count, change_count,
+         chunk_sent_message_count, snapshot_epoch - 1);
+  return result;
+}